@@ -0,0 +1,144 @@
+#include "utils/chunk_hash_map.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ChunkHashMap against the unordered_map + PairHash it replaced in
+// WorldManager, on a full chunk ring: insert every cell into an empty map,
+// look every cell up in random order, and iterate all entries. Times are per
+// operation, the best of several rounds.
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using Value = intptr_t;
+
+    // The hash WorldManager used before ChunkHashMap.
+    struct PairHash {
+        template <class T1, class T2>
+        std::size_t operator()(const std::pair<T1, T2>& p) const {
+            auto hash1 = std::hash<T1>{}(p.first);
+            auto hash2 = std::hash<T2>{}(p.second);
+            return hash1 ^ (hash2 << 1);
+        }
+    };
+
+    using PairMap = std::unordered_map<std::pair<int, int>, Value, PairHash>;
+
+    constexpr int ROUNDS = 7;
+    // Enough repetitions per round that even radius 7 runs for a while.
+    constexpr size_t MIN_OPERATIONS = 2000000;
+
+    Value sink = 0;
+
+    template <typename F>
+    double bestNanosecondsPerOp(size_t operationsPerRep, F repetition) {
+        size_t reps = std::max<size_t>(1, MIN_OPERATIONS / operationsPerRep);
+        double best = 1e30;
+        for (int round = 0; round < ROUNDS; round++) {
+            auto start = Clock::now();
+            for (size_t rep = 0; rep < reps; rep++) {
+                repetition();
+            }
+            std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+            best = std::min(best, elapsed.count() / (reps * operationsPerRep));
+        }
+        return best;
+    }
+
+    struct Timings {
+        double insert;
+        double lookup;
+        double iterate;
+    };
+
+    Timings benchPairMap(const std::vector<std::pair<int, int>>& ring,
+                         const std::vector<std::pair<int, int>>& lookups) {
+        Timings timings;
+        timings.insert = bestNanosecondsPerOp(ring.size(), [&]() {
+            PairMap map;
+            for (const auto& cell : ring) {
+                map[cell] = cell.first;
+            }
+            sink += static_cast<Value>(map.size());
+        });
+
+        PairMap map;
+        for (const auto& cell : ring) {
+            map[cell] = cell.first;
+        }
+        timings.lookup = bestNanosecondsPerOp(lookups.size(), [&]() {
+            for (const auto& cell : lookups) {
+                sink += map.find(cell)->second;
+            }
+        });
+        timings.iterate = bestNanosecondsPerOp(map.size(), [&]() {
+            for (const auto& entry : map) {
+                sink += entry.second;
+            }
+        });
+        return timings;
+    }
+
+    Timings benchChunkMap(const std::vector<std::pair<int, int>>& ring,
+                          const std::vector<std::pair<int, int>>& lookups) {
+        Timings timings;
+        timings.insert = bestNanosecondsPerOp(ring.size(), [&]() {
+            ChunkHashMap<Value> map;
+            for (const auto& cell : ring) {
+                map.findOrInsert(cell.first, cell.second) = cell.first;
+            }
+            sink += static_cast<Value>(map.size());
+        });
+
+        ChunkHashMap<Value> map;
+        for (const auto& cell : ring) {
+            map.findOrInsert(cell.first, cell.second) = cell.first;
+        }
+        timings.lookup = bestNanosecondsPerOp(lookups.size(), [&]() {
+            for (const auto& cell : lookups) {
+                sink += *map.find(cell.first, cell.second);
+            }
+        });
+        timings.iterate = bestNanosecondsPerOp(map.size(), [&]() {
+            for (const auto& entry : map) {
+                sink += entry.value;
+            }
+        });
+        return timings;
+    }
+}
+
+int main() {
+    std::mt19937 random(42);
+    std::cout << "ns per operation, unordered_map+PairHash / ChunkHashMap" << std::endl;
+    std::cout << "radius  cells      insert             lookup             iterate" << std::endl;
+    for (int radius : { 7, 12, 16, 24, 32 }) {
+        // The square of chunks WorldManager keeps around the camera; the
+        // negative and mirrored coordinates are where PairHash collides.
+        std::vector<std::pair<int, int>> ring;
+        for (int x = -radius; x <= radius; x++) {
+            for (int z = -radius; z <= radius; z++) {
+                ring.emplace_back(x, z);
+            }
+        }
+        std::vector<std::pair<int, int>> lookups = ring;
+        std::shuffle(lookups.begin(), lookups.end(), random);
+
+        Timings old = benchPairMap(ring, lookups);
+        Timings now = benchChunkMap(ring, lookups);
+        std::cout << std::fixed << std::setprecision(2) << std::setw(6) << radius << std::setw(7) << ring.size()
+                  << std::setw(10) << old.insert << " / " << std::setw(6) << now.insert
+                  << std::setw(10) << old.lookup << " / " << std::setw(6) << now.lookup
+                  << std::setw(10) << old.iterate << " / " << std::setw(6) << now.iterate << std::endl;
+    }
+    // Printed so the work cannot be optimized away.
+    std::cout << "checksum " << sink << std::endl;
+    return 0;
+}
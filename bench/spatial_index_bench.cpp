@@ -0,0 +1,151 @@
+#include "utils/spatial_index.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// SpatialIndex queries against a linear scan of every box as the instance
+// count grows at constant density, so a fixed-size query sees about the same
+// number of hits at every size. Build is per insert, churn is one remove plus
+// one insert; query times are microseconds per query, the mean of QUERIES.
+// Runs at two densities: the world's and a far denser stress case.
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Density {
+        const char* name;
+        float areaPerInstance;
+    };
+
+    // The world has at most 9 trees, or one prop, per 1000x1000 m chunk. The
+    // stress case puts one instance on every 10x10 m, about 1000 times that.
+    constexpr Density DENSITIES[] = {
+        { "world", 1000.0f * 1000.0f / 9.0f },
+        { "stress", 100.0f },
+    };
+    constexpr int QUERIES = 200;
+    constexpr float SPHERE_RADIUS = 150.0f;
+    constexpr float RAY_LENGTH = 1000.0f;
+
+    size_t sink = 0;
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    struct Query {
+        glm::vec3 position;
+        glm::vec3 direction;
+        Frustum frustum;
+    };
+
+    std::vector<Query> makeQueries(std::mt19937& random, float halfSide) {
+        std::uniform_real_distribution<float> coordinate(-halfSide, halfSide);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 1.0f, 800.0f);
+        std::vector<Query> queries(QUERIES);
+        for (Query& query : queries) {
+            float heading = angle(random);
+            query.position = glm::vec3(coordinate(random), 2.0f, coordinate(random));
+            query.direction = glm::normalize(glm::vec3(std::cos(heading), -0.05f, std::sin(heading)));
+            glm::mat4 view = glm::lookAt(query.position, query.position + query.direction, glm::vec3(0.0f, 1.0f, 0.0f));
+            query.frustum.update(projection * view);
+        }
+        return queries;
+    }
+
+    // Mean microseconds per call of run(query).
+    template <typename F>
+    double microsecondsPerQuery(const std::vector<Query>& queries, F run) {
+        auto start = Clock::now();
+        for (const Query& query : queries) {
+            run(query);
+        }
+        return secondsSince(start) * 1e6 / queries.size();
+    }
+
+    void benchmark(int count, float areaPerInstance) {
+        std::mt19937 random(count);
+        float halfSide = 0.5f * std::sqrt(count * areaPerInstance);
+        std::uniform_real_distribution<float> coordinate(-halfSide, halfSide);
+        std::uniform_real_distribution<float> size(0.5f, 6.0f);
+
+        std::vector<AABB> boxes(count);
+        for (AABB& box : boxes) {
+            glm::vec3 base(coordinate(random), 0.0f, coordinate(random));
+            float radius = size(random);
+            box = AABB(base - glm::vec3(radius, 0.0f, radius), base + glm::vec3(radius, 4.0f * radius, radius));
+        }
+        std::vector<Query> queries = makeQueries(random, halfSide);
+
+        SpatialIndex index;
+        std::vector<SpatialIndex::Handle> handles(count);
+        auto start = Clock::now();
+        for (int i = 0; i < count; i++) {
+            handles[i] = index.insert(boxes[i], i);
+        }
+        double buildNs = secondsSince(start) * 1e9 / count;
+
+        std::vector<SpatialIndex::Handle> hits;
+        size_t frustumHits = 0;
+        double frustumUs = microsecondsPerQuery(queries, [&](const Query& query) {
+            hits.clear();
+            index.queryFrustum(query.frustum, hits);
+            frustumHits += hits.size();
+        });
+        double linearUs = microsecondsPerQuery(queries, [&](const Query& query) {
+            size_t visible = 0;
+            for (const AABB& box : boxes) {
+                visible += query.frustum.intersects(box) ? 1 : 0;
+            }
+            sink += visible;
+        });
+        double sphereUs = microsecondsPerQuery(queries, [&](const Query& query) {
+            hits.clear();
+            index.querySphere(query.position, SPHERE_RADIUS, hits);
+            sink += hits.size();
+        });
+        double rayUs = microsecondsPerQuery(queries, [&](const Query& query) {
+            hits.clear();
+            index.queryRay(query.position, query.direction, RAY_LENGTH, hits);
+            sink += hits.size();
+        });
+
+        // Chunks streaming out and back in: remove and reinsert a tenth.
+        int churn = std::max(1, count / 10);
+        start = Clock::now();
+        for (int i = 0; i < churn; i++) {
+            index.remove(handles[i]);
+            handles[i] = index.insert(boxes[i], i);
+        }
+        double churnNs = secondsSince(start) * 1e9 / churn;
+
+        std::cout << std::fixed << std::setw(8) << count << std::setprecision(0) << std::setw(8) << buildNs
+                  << std::setw(8) << churnNs << std::setprecision(1) << std::setw(10) << frustumUs << std::setw(10)
+                  << linearUs << std::setw(8) << linearUs / frustumUs << "x" << std::setw(9) << sphereUs
+                  << std::setw(9) << rayUs << std::setw(8) << frustumHits / QUERIES << std::setw(7)
+                  << index.getNodeCount() << std::endl;
+        sink += frustumHits;
+    }
+}
+
+int main() {
+    for (const Density& density : DENSITIES) {
+        std::cout << "SpatialIndex, " << density.name << " density, " << std::fixed << std::setprecision(0)
+                  << density.areaPerInstance << " m^2 per instance, " << QUERIES << " random views per query type"
+                  << std::endl;
+        std::cout << "   count  ins ns churn ns  frust us linear us speedup sphere us   ray us    hits  nodes"
+                  << std::endl;
+        for (int count : { 1000, 10000, 100000, 250000, 500000 }) {
+            benchmark(count, density.areaPerInstance);
+        }
+    }
+    // Printed so the work cannot be optimized away.
+    std::cout << "checksum " << sink << std::endl;
+    return 0;
+}
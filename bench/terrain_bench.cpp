@@ -0,0 +1,90 @@
+#include "entities/terrain.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Heights per second per core of generateHeightGrid, on one thread and on
+// every hardware thread at once, for the baseline path and then the AVX2 one.
+// Each chunk is TERRAIN_SAMPLES^2 heights, border included. Optional
+// argument: seconds per measurement (default 1).
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Generates chunks row by row, starting at firstChunk, until the time is
+    // up; returns the number of chunks.
+    long generateFor(double seconds, int firstChunk, float& checksum) {
+        std::vector<float> heights(TERRAIN_SAMPLES * TERRAIN_SAMPLES);
+        long chunks = 0;
+        float sum = 0.0f;
+        auto end = Clock::now() + std::chrono::duration<double>(seconds);
+        while (Clock::now() < end) {
+            for (int i = 0; i < 64; i++, chunks++) {
+                int index = firstChunk + static_cast<int>(chunks);
+                generateHeightGrid(index % 256 - 128, index / 256 - 128, heights.data());
+                sum += heights[chunks % heights.size()];
+            }
+        }
+        // Written once, so threads do not share a cache line while timed.
+        checksum += sum;
+        return chunks;
+    }
+
+    void report(const char* label, long chunks, double seconds, int threads) {
+        double heights = static_cast<double>(chunks) * TERRAIN_SAMPLES * TERRAIN_SAMPLES;
+        std::cout << std::left << std::setw(10) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(8) << heights / seconds / threads / 1e6 << " M heights/s/core  ("
+                  << std::setprecision(0) << chunks / seconds / threads << " chunks/s/core, " << threads
+                  << (threads == 1 ? " thread)" : " threads)") << std::endl;
+    }
+
+    void benchmark(double seconds, float& checksum) {
+        std::cout << "generateHeightGrid, " << getTerrainSimdPath() << " path, " << TERRAIN_SAMPLES << "x"
+                  << TERRAIN_SAMPLES << " heights per chunk" << std::endl;
+        generateFor(0.1, 0, checksum);
+
+        auto start = Clock::now();
+        long chunks = generateFor(seconds, 0, checksum);
+        report("1 thread", chunks, std::chrono::duration<double>(Clock::now() - start).count(), 1);
+
+        int threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        std::atomic<long> totalChunks(0);
+        std::vector<float> checksums(threadCount, 0.0f);
+        std::vector<std::thread> threads;
+        start = Clock::now();
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&, t]() { totalChunks += generateFor(seconds, t * 4096, checksums[t]); });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        report("all cores", totalChunks, std::chrono::duration<double>(Clock::now() - start).count(), threadCount);
+
+        for (float value : checksums) {
+            checksum += value;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::max(0.1, std::atof(argv[1])) : 1.0;
+    float checksum = 0.0f;
+
+    // The baseline path first, then AVX2 where the build and CPU have it.
+    setTerrainAvx2(false);
+    benchmark(seconds, checksum);
+    if (setTerrainAvx2(true)) {
+        benchmark(seconds, checksum);
+    } else {
+        std::cout << "AVX2 path: not built or not supported by this CPU" << std::endl;
+    }
+
+    // Printed so the work cannot be optimized away.
+    std::cout << "checksum " << std::setprecision(3) << checksum << std::endl;
+    return 0;
+}
@@ -6,7 +6,10 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/detail/type_mat.hpp>
-#include <render/shader.h>
+#include <render/shader_library.h>
+#include <render/gl_state_cache.h>
+#include <render/vertex_format.h>
+#include <render/mesh_optimizer.h>
 #include <iostream>
 #include <map>
 #include <unordered_map>
@@ -52,26 +55,27 @@ AnimatedModel& AnimatedModel::operator=(AnimatedModel&& other) noexcept {
 }
 
 void AnimatedModel::ModelCache::cleanup() {
+    GLStateCache& glState = GLStateCache::getInstance();
     for (auto& primitive : primitiveObjects) {
         if (primitive.vao) {
-            glDeleteVertexArrays(1, &primitive.vao);
+            glState.deleteVertexArray(primitive.vao);
             primitive.vao = 0;
         }
 
         for (auto vbo : primitive.vbos) {
-            glDeleteBuffers(1, &vbo);
+            glState.deleteBuffer(vbo);
         }
         primitive.vbos.clear();
 
         if (primitive.textureID && !primitive.isTextureFromManager) {
-            glDeleteTextures(1, &primitive.textureID);
+            glState.deleteTexture(primitive.textureID);
             primitive.textureID = 0;
         }
     }
     primitiveObjects.clear();
 
     if (programID) {
-        glDeleteProgram(programID);
+        ShaderLibrary::getInstance().release(programID);
         programID = 0;
     }
 }
@@ -290,11 +294,7 @@ std::shared_ptr<AnimatedModel::ModelCache> AnimatedModel::loadModelToCache(const
 
     auto cache = std::make_shared<ModelCache>();
 
-    GLint prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer;
-    GLboolean prevDepthTest, prevCullFace;
-    GLint attribEnabled[5];
-    saveOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                   prevDepthTest, prevCullFace, attribEnabled);
+    GLStateCache& glState = GLStateCache::getInstance();
 
     tinygltf::TinyGLTF loader;
     tinygltf::Model model;
@@ -304,28 +304,20 @@ std::shared_ptr<AnimatedModel::ModelCache> AnimatedModel::loadModelToCache(const
     bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
     if (!res) {
         std::cout << "Failed to load glTF: " << filename << " - " << err << std::endl;
-        restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                          prevDepthTest, prevCullFace, attribEnabled);
         return nullptr;
     }
 
     cache->model = model;
 
-    cache->programID = LoadShadersFromFile("../scene/shaders/animated.vert", "../scene/shaders/animated.frag");
+    ShaderLibrary& shaders = ShaderLibrary::getInstance();
+    cache->programID = shaders.acquire("../scene/shaders/animated.vert", "../scene/shaders/animated.frag");
     if (cache->programID == 0) {
         std::cerr << "Failed to load animated model shaders" << std::endl;
-        restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                          prevDepthTest, prevCullFace, attribEnabled);
         return nullptr;
     }
 
-    cache->mvpMatrixID = glGetUniformLocation(cache->programID, "MVP");
-    cache->jointMatricesID = glGetUniformLocation(cache->programID, "jointMatrices");
-    cache->lightPositionID = glGetUniformLocation(cache->programID, "lightPosition");
-    cache->lightIntensityID = glGetUniformLocation(cache->programID, "lightIntensity");
-    cache->viewPositionID = glGetUniformLocation(cache->programID, "viewPosition");
-    cache->modelMatrixID = glGetUniformLocation(cache->programID, "modelMatrix");
-    cache->textureSamplerID = glGetUniformLocation(cache->programID, "textureSampler");
+    cache->jointMatricesID = shaders.getUniformLocation(cache->programID, "jointMatrices");
+    cache->textureSamplerID = shaders.getUniformLocation(cache->programID, "textureSampler");
 
     cache->localNodeTransforms.resize(model.nodes.size());
     cache->globalNodeTransforms.resize(model.nodes.size());
@@ -434,64 +426,83 @@ std::shared_ptr<AnimatedModel::ModelCache> AnimatedModel::loadModelToCache(const
         cache->animationClips.push_back(clip);
     }
 
+    VertexPackingStats packingStats;
+    MeshOptimizationStats optimizationStats;
     for (const auto& mesh : model.meshes) {
         for (const auto& primitive : mesh.primitives) {
             PrimitiveObject primObj;
             primObj.mode = primitive.mode;
 
-            glGenVertexArrays(1, &primObj.vao);
-            glBindVertexArray(primObj.vao);
-
-            for (const auto& attrib : primitive.attributes) {
-                const auto& accessor = model.accessors[attrib.second];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-
-                GLuint vbo;
-                glGenBuffers(1, &vbo);
-                glBindBuffer(bufferView.target, vbo);
-                glBufferData(bufferView.target, bufferView.byteLength,
-                            buffer.data.data() + bufferView.byteOffset, GL_STATIC_DRAW);
-
-                primObj.vbos.push_back(vbo);
-
-                int location = -1;
-                if (attrib.first == "POSITION") location = 0;
-                else if (attrib.first == "NORMAL") location = 1;
-                else if (attrib.first == "TEXCOORD_0") location = 2;
-                else if (attrib.first == "JOINTS_0") location = 3;
-                else if (attrib.first == "WEIGHTS_0") location = 4;
-
-                if (location >= 0) {
-                    glEnableVertexAttribArray(location);
-                    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-                    GLint size = 1;
-                    if (accessor.type == TINYGLTF_TYPE_VEC2) size = 2;
-                    else if (accessor.type == TINYGLTF_TYPE_VEC3) size = 3;
-                    else if (accessor.type == TINYGLTF_TYPE_VEC4) size = 4;
-
-                    glVertexAttribPointer(location, size, accessor.componentType,
-                                        accessor.normalized ? GL_TRUE : GL_FALSE,
-                                        accessor.ByteStride(bufferView),
-                                        BUFFER_OFFSET(accessor.byteOffset));
-                }
+            std::vector<SkinnedVertex> vertices;
+            if (!packSkinnedVertices(model, primitive, vertices, packingStats)) {
+                std::cerr << "Skipping primitive of " << filename << ": unreadable vertex attributes" << std::endl;
+                continue;
+            }
+
+            const auto& positionAccessor = model.accessors[primitive.attributes.at("POSITION")];
+            if (positionAccessor.minValues.size() == 3 && positionAccessor.maxValues.size() == 3) {
+                cache->bounds.expand(AABB(
+                    glm::vec3(positionAccessor.minValues[0], positionAccessor.minValues[1], positionAccessor.minValues[2]),
+                    glm::vec3(positionAccessor.maxValues[0], positionAccessor.maxValues[1], positionAccessor.maxValues[2])));
             }
 
-            if (primitive.indices >= 0) {
-                const auto& indexAccessor = model.accessors[primitive.indices];
-                const auto& indexBufferView = model.bufferViews[indexAccessor.bufferView];
-                const auto& indexBuffer = model.buffers[indexBufferView.buffer];
+            // Reorder the triangles for the vertex cache and overdraw, then the
+            // vertices into first-use order, before anything is uploaded.
+            std::vector<uint32_t> indices;
+            bool hasIndices = primitive.indices >= 0 && readIndices(model, model.accessors[primitive.indices], indices);
+            bool shortIndices = false;
+            if (hasIndices) {
+                size_t sourceVertexCount = vertices.size();
+                float acmrBefore = computeAcmr(indices, vertices.size());
+                if (primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+                    std::vector<glm::vec3> positions(vertices.size());
+                    for (size_t v = 0; v < vertices.size(); v++) {
+                        positions[v] = vertices[v].position;
+                    }
+                    std::vector<uint32_t> clusters;
+                    indices = optimizeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE, &clusters);
+                    indices = optimizeOverdraw(positions, indices, clusters);
+                }
+
+                std::vector<uint32_t> remap;
+                size_t vertexCount = buildVertexFetchRemap(indices, vertices.size(), remap);
+                remapVertices(vertices, remap, vertexCount);
+                remapIndices(indices, remap);
+                optimizationStats.addAcmr(indices.size() / 3, acmrBefore, computeAcmr(indices, vertices.size()));
+
+                shortIndices = fitsShortIndices(vertexCount);
+                size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+                optimizationStats.primitives++;
+                optimizationStats.shortIndexPrimitives += shortIndices ? 1 : 0;
+                optimizationStats.bytesBefore +=
+                    sourceVertexCount * sizeof(SkinnedVertex) + indices.size() * sizeof(uint32_t);
+                optimizationStats.bytesAfter += vertices.size() * sizeof(SkinnedVertex) + indices.size() * indexSize;
+            }
 
-                GLuint ebo;
-                glGenBuffers(1, &ebo);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferView.byteLength,
-                            indexBuffer.data.data() + indexBufferView.byteOffset, GL_STATIC_DRAW);
+            primObj.vao = glState.genVertexArray();
+            glState.bindVertexArray(primObj.vao);
+
+            GLuint vbo = glState.genBuffer();
+            glState.bindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkinnedVertex), vertices.data(), GL_STATIC_DRAW);
+            primObj.vbos.push_back(vbo);
+            SkinnedVertexLayout::apply();
+
+            if (hasIndices) {
+                GLuint ebo = glState.genBuffer();
+                glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+                if (shortIndices) {
+                    std::vector<uint16_t> shortIndexData = narrowIndices(indices);
+                    glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndexData.size() * sizeof(uint16_t),
+                                 shortIndexData.data(), GL_STATIC_DRAW);
+                } else {
+                    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(),
+                                 GL_STATIC_DRAW);
+                }
 
                 primObj.vbos.push_back(ebo);
-                primObj.indexCount = indexAccessor.count;
-                primObj.indexType = indexAccessor.componentType;
+                primObj.indexCount = static_cast<GLsizei>(indices.size());
+                primObj.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
             }
 
             if (primitive.material >= 0 && primitive.material < model.materials.size()) {
@@ -520,21 +531,25 @@ std::shared_ptr<AnimatedModel::ModelCache> AnimatedModel::loadModelToCache(const
             }
 
             cache->primitiveObjects.push_back(primObj);
-            glBindVertexArray(0);
+            glState.bindVertexArray(0);
         }
     }
 
-    restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                      prevDepthTest, prevCullFace, attribEnabled);
 
     cache->referenceCount = 1;
     modelCache[filename] = cache;
 
     std::cout << "Animated model cached successfully: " << filename << std::endl;
+    packingStats.print();
+    optimizationStats.print();
     return cache;
 }
 
 bool AnimatedModel::loadModel(const char* filename) {
+    if (cachedModel && modelFilename == filename) {
+        return true;
+    }
+
     cleanup();
 
     cachedModel = loadModelToCache(filename);
@@ -562,51 +577,57 @@ bool AnimatedModel::loadModel(const char* filename) {
     return true;
 }
 
-void AnimatedModel::render(const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                                    const glm::vec3& lightIntensity, const glm::vec3& viewPosition) {
-    if (!cachedModel || cachedModel->programID == 0 || cachedModel->primitiveObjects.empty()) {
-        return;
+void AnimatedModel::prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) {
+    const ModelCache* cache = static_cast<const ModelCache*>(packet.owner);
+    if (programChanged && cache->textureSamplerID >= 0) {
+        glUniform1i(cache->textureSamplerID, 0);
     }
 
-    GLint prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer;
-    GLboolean prevDepthTest, prevCullFace;
-    GLint attribEnabled[5];
-    saveOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                   prevDepthTest, prevCullFace, attribEnabled);
-
-    glUseProgram(cachedModel->programID);
+    // The model matrix comes from the object block; userOffset holds the joint palette.
+    if (!cache->skinData.empty() && cache->jointMatricesID >= 0) {
+        glUniformMatrix4fv(cache->jointMatricesID, cache->skinData[0].jointMatrices.size(), GL_FALSE,
+                           queue.getData(packet.userOffset));
+    }
+}
 
-    glm::mat4 mvp = viewProjectionMatrix * modelMatrix;
-    glUniformMatrix4fv(cachedModel->mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-    glUniformMatrix4fv(cachedModel->modelMatrixID, 1, GL_FALSE, &modelMatrix[0][0]);
+void AnimatedModel::submit(RenderQueue& queue, const glm::mat4& modelMatrix) {
+    if (!cachedModel || cachedModel->programID == 0 || cachedModel->primitiveObjects.empty()) {
+        return;
+    }
 
-    if (!cachedModel->skinData.empty() && cachedModel->jointMatricesID != 0) {
+    int objectIndex = queue.pushObject(modelMatrix);
+    size_t dataOffset = 0;
+    if (!cachedModel->skinData.empty() && cachedModel->jointMatricesID >= 0) {
         const auto& skin = cachedModel->skinData[0];
-        glUniformMatrix4fv(cachedModel->jointMatricesID, skin.jointMatrices.size(),
-                          GL_FALSE, glm::value_ptr(skin.jointMatrices[0]));
+        dataOffset = queue.pushData(glm::value_ptr(skin.jointMatrices[0]), skin.jointMatrices.size() * 16);
     }
 
-    glUniform3fv(cachedModel->lightPositionID, 1, &lightPosition[0]);
-    glUniform3fv(cachedModel->lightIntensityID, 1, &lightIntensity[0]);
-    glUniform3fv(cachedModel->viewPositionID, 1, &viewPosition[0]);
-
-    glActiveTexture(GL_TEXTURE0);
-    glUniform1i(cachedModel->textureSamplerID, 0);
-
+    float depth = glm::length(glm::vec3(modelMatrix[3]) - queue.getFrameUniforms().viewPosition);
     for (const auto& primitive : cachedModel->primitiveObjects) {
-        glBindTexture(GL_TEXTURE_2D, primitive.textureID);
-        glBindVertexArray(primitive.vao);
-
-        if (primitive.indexCount > 0) {
-            glDrawElements(primitive.mode, primitive.indexCount,
-                         primitive.indexType, nullptr);
+        if (primitive.indexCount <= 0) {
+            continue;
         }
 
-        glBindVertexArray(0);
+        DrawPacket packet;
+        packet.sortKey = RenderQueue::makeSortKey(RenderLayer::Opaque, cachedModel->programID, primitive.textureID,
+                                                  primitive.vao, depth);
+        packet.program = cachedModel->programID;
+        packet.vertexArray = primitive.vao;
+        packet.texture = primitive.textureID;
+        packet.mode = primitive.mode;
+        packet.indexType = primitive.indexType;
+        packet.indexCount = primitive.indexCount;
+        packet.prepare = &AnimatedModel::prepareDraw;
+        packet.owner = cachedModel.get();
+        packet.userOffset = dataOffset;
+        packet.objectIndex = objectIndex;
+        queue.submit(packet);
     }
+}
 
-    restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                      prevDepthTest, prevCullFace, attribEnabled);
+const AABB& AnimatedModel::getBounds() const {
+    static const AABB emptyBounds;
+    return cachedModel ? cachedModel->bounds : emptyBounds;
 }
 
 void AnimatedModel::cleanup() {
@@ -624,46 +645,10 @@ void AnimatedModel::cleanup() {
     modelFilename.clear();
 }
 
-void AnimatedModel::saveOpenGLState(GLint& program, GLint& vao, GLint& arrayBuffer,
-                                   GLint& elementBuffer, GLboolean& depthTest,
-                                   GLboolean& cullFace, GLint attribEnabled[5]) {
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
-    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
-    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
-
-    depthTest = glIsEnabled(GL_DEPTH_TEST);
-    cullFace = glIsEnabled(GL_CULL_FACE);
-
-    for (int i = 0; i < 5; i++) {
-        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attribEnabled[i]);
-    }
-}
-
-void AnimatedModel::restoreOpenGLState(GLint program, GLint vao, GLint arrayBuffer,
-                                      GLint elementBuffer, GLboolean depthTest,
-                                      GLboolean cullFace, GLint attribEnabled[5]) {
-    glUseProgram(program);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-
-    if (depthTest) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
-    if (cullFace) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
-
-    for (int i = 0; i < 5; i++) {
-        if (attribEnabled[i]) {
-            glEnableVertexAttribArray(i);
-        } else {
-            glDisableVertexAttribArray(i);
-        }
-    }
-}
-
 GLuint AnimatedModel::createDefaultTexture() {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint textureID = glState.genTexture();
+    glState.bindTexture(GL_TEXTURE_2D, textureID);
 
     unsigned char defaultTexture[] = { 128, 128, 128, 255 };
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, defaultTexture);
@@ -677,9 +662,9 @@ GLuint AnimatedModel::createDefaultTexture() {
 }
 
 GLuint AnimatedModel::loadTextureFromMemory(const unsigned char* data, int width, int height, int channels) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint textureID = glState.genTexture();
+    glState.bindTexture(GL_TEXTURE_2D, textureID);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
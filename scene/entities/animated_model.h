@@ -6,6 +6,8 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include "../render/frustum.h"
+#include "../render/render_queue.h"
 #include "tinygltf-2.9.3/tiny_gltf.h"
 
 namespace tinygltf {
@@ -22,9 +24,11 @@ public:
 
     bool loadModel(const char* filename);
     void update(float deltaTime, float globalTime = -1.0f);
-    void render(const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                        const glm::vec3& lightIntensity, const glm::vec3& viewPosition);
+    // Queues one draw per primitive. The current joint palette is copied into
+    // the queue, so instances sharing a model cache keep their own pose.
+    void submit(RenderQueue& queue, const glm::mat4& modelMatrix);
     void cleanup();
+    const AABB& getBounds() const;
     void play() { isPlaying = true; }
     void pause() { isPlaying = false; }
     void setPlaybackSpeed(float speed) { playbackSpeed = speed; }
@@ -75,13 +79,8 @@ private:
         tinygltf::Model model;
         std::vector<PrimitiveObject> primitiveObjects;
         GLuint programID = 0;
-        GLuint mvpMatrixID = 0;
-        GLuint jointMatricesID = 0;
-        GLuint lightPositionID = 0;
-        GLuint lightIntensityID = 0;
-        GLuint viewPositionID = 0;
-        GLuint modelMatrixID = 0;
-        GLuint textureSamplerID = 0;
+        GLint jointMatricesID = -1;
+        GLint textureSamplerID = -1;
 
         std::vector<SkinData> skinData;
         std::vector<AnimationClip> animationClips;
@@ -90,6 +89,7 @@ private:
         std::vector<glm::mat4> localNodeTransforms;
         std::vector<glm::mat4> globalNodeTransforms;
         std::vector<int> nodeParents;
+        AABB bounds;
 
         int referenceCount = 0;
 
@@ -117,12 +117,7 @@ private:
     int findKeyframeIndex(const std::vector<float>& times, float animationTime);
     glm::mat4 interpolateTransform(const AnimationSampler& sampler, float time, const std::string& path);
 
-    void saveOpenGLState(GLint& program, GLint& vao, GLint& arrayBuffer,
-                        GLint& elementBuffer, GLboolean& depthTest,
-                        GLboolean& cullFace, GLint attribEnabled[5]);
-    void restoreOpenGLState(GLint program, GLint vao, GLint arrayBuffer,
-                           GLint elementBuffer, GLboolean depthTest,
-                           GLboolean cullFace, GLint attribEnabled[5]);
+    static void prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged);
 
     GLuint createDefaultTexture();
     GLuint loadTextureFromMemory(const unsigned char* data, int width, int height, int channels);
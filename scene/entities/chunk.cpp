@@ -1,132 +1,214 @@
 #include "chunk.h"
-#include <glm/gtc/matrix_transform.hpp>
-#include <random>
 #include <algorithm>
 #include <iostream>
 
-Chunk::Chunk(int x, int z) : chunkX(x), chunkZ(z) {
-    seed = x * 1000 + z;
+uint64_t ChunkInstanceRef::pack() const {
+    return (static_cast<uint64_t>(chunkX & 0xFFFFFF) << 40) |
+           (static_cast<uint64_t>(chunkZ & 0xFFFFFF) << 16) |
+           (static_cast<uint64_t>(content) << 8) |
+           static_cast<uint64_t>(index & 0xFF);
+}
+
+ChunkInstanceRef ChunkInstanceRef::unpack(uint64_t packed) {
+    ChunkInstanceRef ref;
+    ref.chunkX = static_cast<int32_t>(static_cast<uint32_t>((packed >> 40) & 0xFFFFFF) << 8) >> 8;
+    ref.chunkZ = static_cast<int32_t>(static_cast<uint32_t>((packed >> 16) & 0xFFFFFF) << 8) >> 8;
+    ref.content = static_cast<ChunkContent>((packed >> 8) & 0xFF);
+    ref.index = static_cast<int>(packed & 0xFF);
+    return ref;
+}
+
+Chunk::Chunk(int x, int z) {
+    descriptor.chunkX = x;
+    descriptor.chunkZ = z;
+    descriptor.treeModelMatrices.reserve(9);
+    treeBounds.reserve(9);
+    instanceHandles.reserve(9);
+}
+
+void Chunk::reset(int x, int z) {
+    descriptor.chunkX = x;
+    descriptor.chunkZ = z;
+    descriptor.content = ChunkContent::None;
+    descriptor.modelPath = nullptr;
+    descriptor.treeModelMatrices.clear();
+    treeBounds.clear();
+    terrainTile = 0;
+    cullSlot = -1;
+}
+
+void Chunk::generate() {
+    generateChunkDescriptor(descriptor.chunkX, descriptor.chunkZ, descriptor);
 }
 
 void Chunk::initialize() {
-    ground.initialize();
-
-    std::mt19937 rng(seed);
-    std::uniform_int_distribution<int> countDist(0, 9);
-    numTrees = countDist(rng);
-    std::uniform_int_distribution<int> spawnDist(0, 8);
-    giantAppear = (spawnDist(rng) == 3);
-    caneAppear = (spawnDist(rng) < 3);
-    snowmanAppear = (spawnDist(rng) == 7);
-
-    if (numTrees == 0 && giantAppear) {
-        if (!bot.loadModel("../scene/entities/models/bot/bot.gltf")) {
+    if (descriptor.content == ChunkContent::Bot) {
+        if (!bot.loadModel(descriptor.modelPath)) {
             std::cerr << "Failed to load bot model" << std::endl;
         }
     }
-    else if (numTrees == 0 && caneAppear) {
-        if (!cane.loadModel("../scene/entities/models/candy_cane/cane.gltf")) {
+    else if (descriptor.content == ChunkContent::Cane) {
+        if (!cane.loadModel(descriptor.modelPath)) {
             std::cerr << "Failed to load candy_cane model" << std::endl;
         }
     }
-    else if (numTrees == 0 && snowmanAppear) {
-        if (!snowman.loadModel("../scene/entities/models/snowman/snowman.gltf")) {
+    else if (descriptor.content == ChunkContent::Snowman) {
+        if (!snowman.loadModel(descriptor.modelPath)) {
             std::cerr << "Failed to load snowman model" << std::endl;
         }
     }
-    else {
-        if (!tree.loadModel("../scene/entities/models/fir_tree/winter_fir.gltf")) {
+    else if (descriptor.content == ChunkContent::Trees) {
+        if (!tree.loadModel(descriptor.modelPath)) {
             std::cerr << "Failed to load fir_tree model" << std::endl;
         }
-        generateTrees();
     }
 
+    computeBounds();
+}
+
+AABB Chunk::groundBounds(int x, int z, float minY, float maxY) {
+    glm::vec3 center(x * SIZE, 0.0f, z * SIZE);
+    glm::vec3 halfSize(SIZE / 2.0f, 0.0f, SIZE / 2.0f);
+    return AABB(glm::vec3(center.x - halfSize.x, minY, center.z - halfSize.z),
+                glm::vec3(center.x + halfSize.x, maxY, center.z + halfSize.z));
+}
+
+void Chunk::computeBounds() {
+    bounds = groundBounds(descriptor.chunkX, descriptor.chunkZ, descriptor.minHeight, descriptor.maxHeight);
+    treeBounds.clear();
+
+    if (descriptor.content == ChunkContent::Bot) {
+        // Skinned poses move outside the bind-pose box, so leave some slack.
+        AABB local = bot.getBounds();
+        glm::vec3 slack = local.getExtents() * 0.5f;
+        propBounds = AABB(local.min - slack, local.max + slack).transformed(descriptor.propModelMatrix);
+        bounds.expand(propBounds);
+    }
+    else if (descriptor.content == ChunkContent::Cane) {
+        propBounds = cane.getBounds().transformed(descriptor.propModelMatrix);
+        bounds.expand(propBounds);
+    }
+    else if (descriptor.content == ChunkContent::Snowman) {
+        propBounds = snowman.getBounds().transformed(descriptor.propModelMatrix);
+        bounds.expand(propBounds);
+    }
+    else if (descriptor.content == ChunkContent::Trees) {
+        for (auto& treeModelMatrix : descriptor.treeModelMatrices) {
+            treeBounds.push_back(tree.getBounds().transformed(treeModelMatrix));
+            bounds.expand(treeBounds.back());
+        }
+    }
+}
+
+int Chunk::getCullInstances(GpuCuller::CullInstance* out) const {
+    if (descriptor.content == ChunkContent::Trees) {
+        int count = static_cast<int>(treeBounds.size());
+        if (count > GpuCuller::INSTANCES_PER_SLOT) {
+            return 0;
+        }
+        for (int i = 0; i < count; i++) {
+            out[i] = GpuCuller::makeInstance(CullKind::Tree, descriptor.treeModelMatrices[i], treeBounds[i]);
+        }
+        return count;
+    }
+    if (descriptor.content == ChunkContent::Cane) {
+        out[0] = GpuCuller::makeInstance(CullKind::Cane, descriptor.propModelMatrix, propBounds);
+        return 1;
+    }
+    if (descriptor.content == ChunkContent::Snowman) {
+        out[0] = GpuCuller::makeInstance(CullKind::Snowman, descriptor.propModelMatrix, propBounds);
+        return 1;
+    }
+    return 0;
 }
 
 void Chunk::update(float deltaTime, float globalTime) {
-    if (numTrees == 0 && giantAppear) {
+    if (descriptor.content == ChunkContent::Bot) {
         bot.update(deltaTime, globalTime);
     }
 }
 
-void Chunk::generateTrees()
-{
-    std::vector<glm::vec2> corners = {
-        glm::vec2(0.0f, 0.0f),
-        glm::vec2(250.0f, 0.0f),
-        glm::vec2(0.0f, 250.0f),
-        glm::vec2(250.0f, 250.0f),
-        glm::vec2(250.0f, -250.0f),
-        glm::vec2(-250.0f, 250.0f),
-        glm::vec2(-250.0f, 0.0f),
-        glm::vec2(0.0f, -250.0f),
-        glm::vec2(-250.0f, -250.0f)
-    };
-    std::mt19937 rng(seed);
-    std::shuffle(corners.begin(), corners.end(), rng);
-
-    std::uniform_real_distribution<float> scaleDist(0.7f, 1.3f);
-    std::uniform_real_distribution<float> rotationDist(0.0f, 360.0f);
-
-    for (int i = 0; i < numTrees; i++) {
-        Transformation t {glm::vec3(corners[i].x, 0.0f, corners[i].y), rotationDist(rng), scaleDist(rng) };
-        treeTransforms.push_back(t);
+void Chunk::registerInstances(SpatialIndex& index) {
+    instanceHandles.clear();
+
+    if (descriptor.content == ChunkContent::Trees) {
+        for (size_t i = 0; i < treeBounds.size(); i++) {
+            ChunkInstanceRef ref { descriptor.chunkX, descriptor.chunkZ, descriptor.content, static_cast<int>(i) };
+            instanceHandles.push_back(index.insert(treeBounds[i], ref.pack()));
+        }
+    }
+    else if (descriptor.content != ChunkContent::None) {
+        ChunkInstanceRef ref { descriptor.chunkX, descriptor.chunkZ, descriptor.content, 0 };
+        instanceHandles.push_back(index.insert(propBounds, ref.pack()));
+    }
+}
+
+void Chunk::unregisterInstances(SpatialIndex& index) {
+    for (SpatialIndex::Handle handle : instanceHandles) {
+        index.remove(handle);
     }
+    instanceHandles.clear();
+}
+
+static float screenCoverage(const AABB& bounds, const glm::vec3& viewPosition, float projectionScale) {
+    float radius = glm::length(bounds.getExtents());
+    float distance = std::max(glm::length(bounds.getCenter() - viewPosition), 1.0f);
+    return radius * projectionScale / distance;
 }
 
-void Chunk::render(const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                            const glm::vec3& lightIntensity, const glm::vec3& viewPosition) {
-    glm::mat4 groundModelMatrix = glm::mat4(1.0f);
-    groundModelMatrix = glm::translate(groundModelMatrix,
-                                      glm::vec3(chunkX * SIZE, 0.0f, chunkZ * SIZE));
-    glm::mat4 groundMvp = viewProjectionMatrix * groundModelMatrix;
-    ground.render(groundModelMatrix, viewProjectionMatrix, lightPosition, lightIntensity, viewPosition);
-
-    float centerX = chunkX * SIZE - (SIZE / 2.0f) + 300.0f;
-    float centerZ = chunkZ * SIZE + (SIZE / 2.0f) - 300.0f;
-
-    std::mt19937 rng(seed);
-
-    if (numTrees == 0 && giantAppear) {
-        glm::mat4 botModelMatrix = glm::mat4(1.0f);
-        botModelMatrix = glm::translate(botModelMatrix, glm::vec3(centerX, -135.0f, centerZ));
-        botModelMatrix = glm::scale(botModelMatrix, glm::vec3(4.0f, 4.0f, 4.0f));
-        bot.render(botModelMatrix, viewProjectionMatrix, lightPosition, lightIntensity, viewPosition);
-    }
-    else if (numTrees == 0 && caneAppear) {
-        std::uniform_real_distribution<float> scaleDist(50.0f, 150.0f);
-        std::uniform_real_distribution<float> rotationDist(0.0f, 360.0f);
-        float newScale = scaleDist(rng);
-        glm::mat4 caneModelMatrix = glm::mat4(1.0f);
-        caneModelMatrix = glm::translate(caneModelMatrix, glm::vec3(centerX, -50.0f, centerZ));
-        caneModelMatrix = glm::rotate(caneModelMatrix, glm::radians(90.0f),
-                                    glm::vec3(-1.0f, 0.0f, 0.0f));
-        caneModelMatrix = glm::rotate(caneModelMatrix, glm::radians(rotationDist(rng)),
-                                    glm::vec3(0.0f, 0.0f, 1.0f));
-        caneModelMatrix = glm::scale(caneModelMatrix, glm::vec3(newScale, newScale, newScale));
-        cane.render(caneModelMatrix, viewProjectionMatrix, lightPosition, lightIntensity, viewPosition);
-    }
-    else if (numTrees == 0 && snowmanAppear) {
-        glm::mat4 snowmanModelMatrix = glm::mat4(1.0f);
-        snowmanModelMatrix = glm::translate(snowmanModelMatrix, glm::vec3(centerX, 0.0f, centerZ));
-        snowmanModelMatrix = glm::scale(snowmanModelMatrix, glm::vec3(10.0f, 10.0f, 10.0f));
-        snowman.render(snowmanModelMatrix, viewProjectionMatrix, lightPosition, lightIntensity, viewPosition);
-    }
-    else if (numTrees > 0)
-    {
-        for (auto& t : treeTransforms)
-        {
-            glm::mat4 treeModelMatrix = glm::mat4(1.0f);
-            treeModelMatrix = glm::translate(treeModelMatrix, glm::vec3(centerX + t.translation.x,
-                                   t.translation.y, centerZ + t.translation.z));
-            treeModelMatrix = glm::rotate(treeModelMatrix, glm::radians(90.0f),
-                                    glm::vec3(-1.0f, 0.0f, 0.0f));
-            treeModelMatrix = glm::rotate(treeModelMatrix, glm::radians(t.rotation),
-                                    glm::vec3(0.0f, 0.0f, 1.0f));
-            treeModelMatrix = glm::scale(treeModelMatrix, glm::vec3(t.scale, t.scale, t.scale));
-
-            glm::mat4 treeMvp = viewProjectionMatrix * treeModelMatrix;
-            tree.render(treeModelMatrix, viewProjectionMatrix, lightPosition, lightIntensity, viewPosition);
+// Draws the mesh up to the switch distance and hands the instance to the
+// impostor renderer from the start of the fade band onwards.
+static void submitStaticInstance(const StaticModel& model, const glm::mat4& modelMatrix, const AABB& bounds,
+                                 const glm::vec3& viewPosition, float projectionScale,
+                                 ImpostorRenderer& impostors, StaticInstanceList& instances) {
+    float distance = glm::length(bounds.getCenter() - viewPosition);
+    int impostorId = model.getImpostorId();
+
+    if (impostorId >= 0 && distance >= impostors.getFadeStartDistance()) {
+        impostors.submit(impostorId, modelMatrix, impostors.fadeForDistance(distance));
+        if (distance >= impostors.getSwitchDistance()) {
+            return;
         }
     }
+
+    int lod = model.selectLod(screenCoverage(bounds, viewPosition, projectionScale));
+    instances.add(modelMatrix, lod);
+}
+
+void Chunk::render(const Frustum& frustum, const glm::vec3& viewPosition, float projectionScale, RenderQueue& queue,
+                            ImpostorRenderer& impostors, StaticInstanceBatches& batches, CullingStats& stats) {
+    if (descriptor.content == ChunkContent::Trees) {
+        for (size_t i = 0; i < descriptor.treeModelMatrices.size(); i++) {
+            if (!frustum.intersects(treeBounds[i])) {
+                stats.instancesCulled++;
+                continue;
+            }
+            stats.instancesVisible++;
+            submitStaticInstance(tree, descriptor.treeModelMatrices[i], treeBounds[i], viewPosition,
+                                 projectionScale, impostors, batches.trees);
+        }
+        return;
+    }
+
+    if (descriptor.content == ChunkContent::None) {
+        return;
+    }
+
+    if (!frustum.intersects(propBounds)) {
+        stats.instancesCulled++;
+        return;
+    }
+    stats.instancesVisible++;
+
+    if (descriptor.content == ChunkContent::Bot) {
+        bot.submit(queue, descriptor.propModelMatrix);
+    }
+    else if (descriptor.content == ChunkContent::Cane) {
+        submitStaticInstance(cane, descriptor.propModelMatrix, propBounds, viewPosition,
+                             projectionScale, impostors, batches.canes);
+    }
+    else if (descriptor.content == ChunkContent::Snowman) {
+        submitStaticInstance(snowman, descriptor.propModelMatrix, propBounds, viewPosition,
+                             projectionScale, impostors, batches.snowmen);
+    }
 }
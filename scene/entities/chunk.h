@@ -3,47 +3,90 @@
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include "animated_model.h"
-#include "ground.h"
 #include "entities/static_model.h"
+#include "../render/frustum.h"
+#include "../render/impostor.h"
+#include "../render/gpu_culler.h"
+#include "../utils/spatial_index.h"
+#include "chunk_descriptor.h"
 
-struct Transformation {
-    glm::vec3 translation;
-    float rotation;
-    float scale;
+// Identifies one prop inside a chunk; packs into the user data of a SpatialIndex entry.
+struct ChunkInstanceRef {
+    int chunkX;
+    int chunkZ;
+    ChunkContent content;
+    int index;
+
+    uint64_t pack() const;
+    static ChunkInstanceRef unpack(uint64_t packed);
+};
+
+// Visible static props gathered over every chunk in a frame, so each model
+// is drawn with instanced calls instead of one draw per prop.
+struct StaticInstanceBatches {
+    StaticInstanceList trees;
+    StaticInstanceList canes;
+    StaticInstanceList snowmen;
+
+    void clear() {
+        trees.clear();
+        canes.clear();
+        snowmen.clear();
+    }
 };
 
 class Chunk {
 public:
-    static constexpr int SIZE = 1000;
+    static constexpr int SIZE = CHUNK_SIZE;
 
     Chunk(int x, int z);
+    void reset(int x, int z);
+    // generate() only fills the descriptor and is safe on any thread;
+    // initialize() binds it to GL resources and must run on the GL thread.
+    void generate();
     void initialize();
     void update(float deltaTime, float globalTime);
-    void render(const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                        const glm::vec3& lightIntensity, const glm::vec3& viewPosition);
+    void render(const Frustum& frustum, const glm::vec3& viewPosition, float projectionScale, RenderQueue& queue,
+                        ImpostorRenderer& impostors, StaticInstanceBatches& batches, CullingStats& stats);
 
-    int getX() const { return chunkX; }
-    int getZ() const { return chunkZ; }
+    int getX() const { return descriptor.chunkX; }
+    int getZ() const { return descriptor.chunkZ; }
+    const ChunkDescriptor& getDescriptor() const { return descriptor; }
+    const AABB& getBounds() const { return bounds; }
+    int getTerrainTile() const { return terrainTile; }
+    void setTerrainTile(int tile) { terrainTile = tile; }
+    int getCullSlot() const { return cullSlot; }
+    void setCullSlot(int slot) { cullSlot = slot; }
+    // Fills out (room for GpuCuller::INSTANCES_PER_SLOT) with the chunk's
+    // static props and returns how many there are; the animated bot has none.
+    int getCullInstances(GpuCuller::CullInstance* out) const;
+
+    static AABB groundBounds(int x, int z, float minY = 0.0f, float maxY = 0.0f);
+
+    void registerInstances(SpatialIndex& index);
+    void unregisterInstances(SpatialIndex& index);
 
 private:
-    int chunkX, chunkZ;
-    int seed;
-    int numTrees;
-    bool giantAppear;
-    bool caneAppear;
-    bool snowmanAppear;
+    ChunkDescriptor descriptor;
+    // Height atlas slot owned by the ground renderer; 0 until uploaded.
+    int terrainTile = 0;
+    // GpuCuller slot, or -1 while the chunk is culled on the CPU.
+    int cullSlot = -1;
 
-    GroundPlane ground;
+    AABB bounds;
 
     StaticModel tree;
-    std::vector<Transformation> treeTransforms;
+    std::vector<AABB> treeBounds;
 
     StaticModel cane;
     StaticModel snowman;
+    AABB propBounds;
 
     AnimatedModel bot;
 
-    void generateTrees();
+    std::vector<SpatialIndex::Handle> instanceHandles;
+
+    void computeBounds();
 };
 
-#endif
\ No newline at end of file
+#endif
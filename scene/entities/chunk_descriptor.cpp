@@ -0,0 +1,131 @@
+#include "chunk_descriptor.h"
+#include "terrain.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+#include <array>
+#include <algorithm>
+
+namespace {
+    struct Transformation {
+        glm::vec3 translation;
+        float rotation;
+        float scale;
+    };
+
+    int seedFor(int chunkX, int chunkZ) {
+        return chunkX * 1000 + chunkZ;
+    }
+
+    void generateTrees(int seed, int numTrees, std::array<Transformation, 9>& transforms) {
+        std::array<glm::vec2, 9> corners = {
+            glm::vec2(0.0f, 0.0f),
+            glm::vec2(250.0f, 0.0f),
+            glm::vec2(0.0f, 250.0f),
+            glm::vec2(250.0f, 250.0f),
+            glm::vec2(250.0f, -250.0f),
+            glm::vec2(-250.0f, 250.0f),
+            glm::vec2(-250.0f, 0.0f),
+            glm::vec2(0.0f, -250.0f),
+            glm::vec2(-250.0f, -250.0f)
+        };
+        std::mt19937 rng(seed);
+        std::shuffle(corners.begin(), corners.end(), rng);
+
+        std::uniform_real_distribution<float> scaleDist(0.7f, 1.3f);
+        std::uniform_real_distribution<float> rotationDist(0.0f, 360.0f);
+
+        for (int i = 0; i < numTrees; i++) {
+            transforms[i] = { glm::vec3(corners[i].x, 0.0f, corners[i].y), rotationDist(rng), scaleDist(rng) };
+        }
+    }
+}
+
+void generateChunkDescriptor(int chunkX, int chunkZ, ChunkDescriptor& out) {
+    const int seed = seedFor(chunkX, chunkZ);
+    const float size = static_cast<float>(CHUNK_SIZE);
+
+    out.chunkX = chunkX;
+    out.chunkZ = chunkZ;
+    out.treeModelMatrices.clear();
+
+    out.heights.resize(TERRAIN_SAMPLES * TERRAIN_SAMPLES);
+    generateHeightGrid(chunkX, chunkZ, out.heights.data());
+    out.minHeight = out.heights[TERRAIN_SAMPLES + 1];
+    out.maxHeight = out.minHeight;
+    for (int j = 1; j <= TERRAIN_CELLS + 1; j++) {
+        for (int i = 1; i <= TERRAIN_CELLS + 1; i++) {
+            out.minHeight = std::min(out.minHeight, out.heights[j * TERRAIN_SAMPLES + i]);
+            out.maxHeight = std::max(out.maxHeight, out.heights[j * TERRAIN_SAMPLES + i]);
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> countDist(0, 9);
+    int numTrees = countDist(rng);
+    std::uniform_int_distribution<int> spawnDist(0, 8);
+    bool giantAppear = (spawnDist(rng) == 3);
+    bool caneAppear = (spawnDist(rng) < 3);
+    bool snowmanAppear = (spawnDist(rng) == 7);
+
+    out.propModelMatrix = glm::mat4(1.0f);
+
+    float centerX = chunkX * size - (size / 2.0f) + 300.0f;
+    float centerZ = chunkZ * size + (size / 2.0f) - 300.0f;
+    // Props are placed relative to the terrain under their origin.
+    float localCenterX = centerX - chunkX * size;
+    float localCenterZ = centerZ - chunkZ * size;
+    float centerHeight = sampleHeightGrid(out.heights.data(), localCenterX, localCenterZ);
+
+    std::mt19937 propRng(seed);
+
+    if (numTrees == 0 && giantAppear) {
+        out.content = ChunkContent::Bot;
+        out.modelPath = BOT_MODEL_PATH;
+
+        out.propModelMatrix = glm::translate(out.propModelMatrix, glm::vec3(centerX, centerHeight - 135.0f, centerZ));
+        out.propModelMatrix = glm::scale(out.propModelMatrix, glm::vec3(4.0f, 4.0f, 4.0f));
+    }
+    else if (numTrees == 0 && caneAppear) {
+        out.content = ChunkContent::Cane;
+        out.modelPath = CANE_MODEL_PATH;
+
+        std::uniform_real_distribution<float> scaleDist(50.0f, 150.0f);
+        std::uniform_real_distribution<float> rotationDist(0.0f, 360.0f);
+        float newScale = scaleDist(propRng);
+        out.propModelMatrix = glm::translate(out.propModelMatrix, glm::vec3(centerX, centerHeight - 50.0f, centerZ));
+        out.propModelMatrix = glm::rotate(out.propModelMatrix, glm::radians(90.0f),
+                                          glm::vec3(-1.0f, 0.0f, 0.0f));
+        out.propModelMatrix = glm::rotate(out.propModelMatrix, glm::radians(rotationDist(propRng)),
+                                          glm::vec3(0.0f, 0.0f, 1.0f));
+        out.propModelMatrix = glm::scale(out.propModelMatrix, glm::vec3(newScale, newScale, newScale));
+    }
+    else if (numTrees == 0 && snowmanAppear) {
+        out.content = ChunkContent::Snowman;
+        out.modelPath = SNOWMAN_MODEL_PATH;
+
+        out.propModelMatrix = glm::translate(out.propModelMatrix, glm::vec3(centerX, centerHeight, centerZ));
+        out.propModelMatrix = glm::scale(out.propModelMatrix, glm::vec3(10.0f, 10.0f, 10.0f));
+    }
+    else {
+        out.content = numTrees > 0 ? ChunkContent::Trees : ChunkContent::None;
+        out.modelPath = TREE_MODEL_PATH;
+
+        std::array<Transformation, 9> transforms;
+        generateTrees(seed, numTrees, transforms);
+
+        for (int i = 0; i < numTrees; i++) {
+            const Transformation& t = transforms[i];
+            float groundHeight = sampleHeightGrid(out.heights.data(), localCenterX + t.translation.x,
+                                                  localCenterZ + t.translation.z);
+            glm::mat4 treeModelMatrix = glm::mat4(1.0f);
+            treeModelMatrix = glm::translate(treeModelMatrix, glm::vec3(centerX + t.translation.x,
+                                   t.translation.y + groundHeight, centerZ + t.translation.z));
+            treeModelMatrix = glm::rotate(treeModelMatrix, glm::radians(90.0f),
+                                    glm::vec3(-1.0f, 0.0f, 0.0f));
+            treeModelMatrix = glm::rotate(treeModelMatrix, glm::radians(t.rotation),
+                                    glm::vec3(0.0f, 0.0f, 1.0f));
+            treeModelMatrix = glm::scale(treeModelMatrix, glm::vec3(t.scale, t.scale, t.scale));
+            out.treeModelMatrices.push_back(treeModelMatrix);
+        }
+    }
+}
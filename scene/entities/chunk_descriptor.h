@@ -0,0 +1,43 @@
+#ifndef CHUNK_DESCRIPTOR_H
+#define CHUNK_DESCRIPTOR_H
+#include <glm/glm.hpp>
+#include <vector>
+
+static constexpr int CHUNK_SIZE = 1000;
+
+static constexpr const char* TREE_MODEL_PATH = "../scene/entities/models/fir_tree/winter_fir.gltf";
+static constexpr const char* BOT_MODEL_PATH = "../scene/entities/models/bot/bot.gltf";
+static constexpr const char* CANE_MODEL_PATH = "../scene/entities/models/candy_cane/cane.gltf";
+static constexpr const char* SNOWMAN_MODEL_PATH = "../scene/entities/models/snowman/snowman.gltf";
+
+enum class ChunkContent {
+    None,
+    Trees,
+    Bot,
+    Cane,
+    Snowman
+};
+
+// Everything that decides what a chunk contains, with no GL objects in it.
+// It is a pure function of the chunk coordinates, so it can be built on any
+// thread, cached or compared without a context.
+struct ChunkDescriptor {
+    int chunkX = 0;
+    int chunkZ = 0;
+    ChunkContent content = ChunkContent::None;
+    const char* modelPath = nullptr;
+
+    glm::mat4 propModelMatrix;
+    std::vector<glm::mat4> treeModelMatrices;
+
+    // TERRAIN_SAMPLES^2 heights, see terrain.h. The range covers the
+    // rendered grid only, not the border samples.
+    std::vector<float> heights;
+    float minHeight = 0.0f;
+    float maxHeight = 0.0f;
+};
+
+// Fills out in place so a recycled descriptor keeps its allocations.
+void generateChunkDescriptor(int chunkX, int chunkZ, ChunkDescriptor& out);
+
+#endif
@@ -1,11 +1,14 @@
 #include "ground.h"
 #include "../utils/texture_manager.h"
-#include "../render/shader.h"
+#include "../render/shader_library.h"
+#include "../render/gl_state_cache.h"
 #include <iostream>
+#include <algorithm>
+#include <cstddef>
 
 GroundPlane::GroundPlane()
-    : programID(0), mvpMatrixID(0), textureSamplerID(0), textureID(0), vertexArrayID(0), vertexBufferID(0),
-            uvBufferID(0), indexBufferID(0), normalBufferID(0) {
+    : atlasRows(0), programID(0), textureSamplerID(0), textureID(0), heightAtlasID(0), vertexArrayID(0),
+            vertexBufferID(0), indexBufferID(0), instanceBufferID(0), instanceBufferCapacity(0) {
 }
 
 GroundPlane::~GroundPlane() {
@@ -13,176 +16,240 @@ GroundPlane::~GroundPlane() {
 }
 
 GLuint GroundPlane::loadGroundShaders() {
-    return LoadShadersFromFile("../scene/shaders/ground.vert",
-                              "../scene/shaders/ground.frag");
+    return ShaderLibrary::getInstance().acquire("../scene/shaders/ground.vert",
+                                                "../scene/shaders/ground.frag");
 }
 
-void GroundPlane::initialize() {
-    GLint prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prevVAO);
-    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevArrayBuffer);
-    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &prevElementBuffer);
-
-    GLint attribEnabled[4];
-    for (int i = 0; i < 4; i++) {
-        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attribEnabled[i]);
-    }
+void GroundPlane::initialize(int tileCapacity) {
+    GLStateCache& glState = GLStateCache::getInstance();
+    ShaderLibrary& shaders = ShaderLibrary::getInstance();
 
     programID = loadGroundShaders();
     if (programID == 0) {
         std::cerr << "FAILED TO LOAD GROUND SHADERS!" << std::endl;
-        restoreState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer, attribEnabled);
         return;
     }
 
-    textureSamplerID = glGetUniformLocation(programID, "textureSampler");
-    modelMatrixID = glGetUniformLocation(programID, "modelMatrix");
-    viewProjectionMatrixID = glGetUniformLocation(programID, "viewProjectionMatrix");
-    mvpMatrixID = glGetUniformLocation(programID, "MVP");
-    lightPositionID = glGetUniformLocation(programID, "lightPosition");
-    lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
-    viewPositionID = glGetUniformLocation(programID, "viewPosition");
-
-    GLfloat vertex_buffer_data[12] = {
-        -500.0f, 0.0f, -500.0f,
-        -500.0f, 0.0f, 500.0f,
-        500.0f, 0.0f, 500.0f,
-        500.0f, 0.0f, -500.0f,
-    };
-
-    GLuint index_buffer_data[6] = {
-        0, 1, 2,
-        0, 2, 3,
-    };
-
-    GLfloat uv_buffer_data[8] = {
-        0.0f, 0.0f,
-        0.0f, 2.0f,
-        2.0f, 2.0f,
-        2.0f, 0.0f,
-    };
-
-    GLfloat normal_buffer_data[12] = {
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f
-    };
-
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
-    glGenBuffers(1, &vertexBufferID);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data),
-                 vertex_buffer_data, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &uvBufferID);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data),
-                 uv_buffer_data, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &indexBufferID);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data),
-                 index_buffer_data, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &normalBufferID);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normal_buffer_data),
-                 normal_buffer_data, GL_STATIC_DRAW);
-
-    TextureManager& tm = TextureManager::getInstance();
-    textureID = tm.getTexture("../scene/textures/snowy_ground02.jpg");
-
-    glBindVertexArray(0);
-    restoreState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer, attribEnabled);
-}
+    textureSamplerID = shaders.getUniformLocation(programID, "textureSampler");
+    heightAtlasSamplerID = shaders.getUniformLocation(programID, "heightAtlas");
 
-void GroundPlane::restoreState(GLint program, GLint vao, GLint arrayBuffer,
-                              GLint elementBuffer, GLint attribEnabled[4]) {
-    glUseProgram(program);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-
-    for (int i = 0; i < 4; i++) {
-        if (attribEnabled[i]) {
-            glEnableVertexAttribArray(i);
-        } else {
-            glDisableVertexAttribArray(i);
+    const int gridSide = TERRAIN_CELLS + 1;
+    std::vector<GLfloat> gridCoords;
+    gridCoords.reserve(gridSide * gridSide * 2);
+    for (int j = 0; j < gridSide; j++) {
+        for (int i = 0; i < gridSide; i++) {
+            gridCoords.push_back(static_cast<GLfloat>(i));
+            gridCoords.push_back(static_cast<GLfloat>(j));
         }
     }
-}
 
-void GroundPlane::render(const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                                const glm::vec3& lightIntensity, const glm::vec3& viewPosition) {
-    GLint prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prevVAO);
-    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevArrayBuffer);
-    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &prevElementBuffer);
-
-    GLint attribEnabled[4];
-    for (int i = 0; i < 4; i++) {
-        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attribEnabled[i]);
+    // LOD l keeps every 2^l-th vertex; cells use the same diagonal as sampleHeightGrid.
+    std::vector<GLuint> indices;
+    for (int lod = 0; lod <= TERRAIN_MAX_LOD; lod++) {
+        int step = 1 << lod;
+        lodIndexOffset[lod] = static_cast<GLsizei>(indices.size());
+        for (int j = 0; j < TERRAIN_CELLS; j += step) {
+            for (int i = 0; i < TERRAIN_CELLS; i += step) {
+                GLuint i0j0 = j * gridSide + i;
+                GLuint i0j1 = (j + step) * gridSide + i;
+                GLuint i1j0 = j * gridSide + i + step;
+                GLuint i1j1 = (j + step) * gridSide + i + step;
+                indices.insert(indices.end(), { i0j0, i0j1, i1j1, i0j0, i1j1, i1j0 });
+            }
+        }
+        lodIndexCount[lod] = static_cast<GLsizei>(indices.size()) - lodIndexOffset[lod];
     }
 
-    glUseProgram(programID);
+    vertexArrayID = glState.genVertexArray();
+    glState.bindVertexArray(vertexArrayID);
 
-    glm::mat4 mvp = viewProjectionMatrix * modelMatrix;
-    glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-    glUniformMatrix4fv(modelMatrixID, 1, GL_FALSE, &modelMatrix[0][0]);
-    glUniformMatrix4fv(viewProjectionMatrixID, 1, GL_FALSE, &viewProjectionMatrix[0][0]);
-    glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-    glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
-    glUniform3fv(viewPositionID, 1, &viewPosition[0]);
+    vertexBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+    glBufferData(GL_ARRAY_BUFFER, gridCoords.size() * sizeof(GLfloat),
+                 gridCoords.data(), GL_STATIC_DRAW);
 
-    glBindVertexArray(vertexArrayID);
+    indexBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                 indices.data(), GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
+    instanceBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
     glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    // Tile 0 is all zeros and never handed out.
+    atlasRows = (tileCapacity + ATLAS_TILES_PER_ROW) / ATLAS_TILES_PER_ROW;
+    const int atlasWidth = ATLAS_TILES_PER_ROW * TERRAIN_SAMPLES;
+    const int atlasHeight = atlasRows * TERRAIN_SAMPLES;
+    std::vector<float> zeros(atlasWidth * atlasHeight, 0.0f);
+    heightAtlasID = glState.genTexture();
+    glState.bindTexture(GL_TEXTURE_2D, heightAtlasID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, atlasWidth, atlasHeight, 0, GL_RED, GL_FLOAT, zeros.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+
+    freeTiles.clear();
+    for (int tile = atlasRows * ATLAS_TILES_PER_ROW - 1; tile > 0; tile--) {
+        freeTiles.push_back(tile);
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+    TextureManager& tm = TextureManager::getInstance();
+    textureID = tm.getTexture("../scene/textures/snowy_ground02.jpg");
 
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glState.bindVertexArray(0);
+}
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glUniform1i(textureSamplerID, 0);
+bool GroundPlane::growHeightAtlas() {
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    int newRows = std::min(atlasRows * 2, maxTextureSize / TERRAIN_SAMPLES);
+    if (newRows <= atlasRows) {
+        std::cerr << "Height atlas is full at " << getHeightTileCapacity() << " tiles" << std::endl;
+        return false;
+    }
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+    // Rows are appended below, so every tile keeps its coordinates and only
+    // the old rectangle has to be copied across.
+    GLStateCache& glState = GLStateCache::getInstance();
+    const int atlasWidth = ATLAS_TILES_PER_ROW * TERRAIN_SAMPLES;
+    GLuint grownAtlasID = glState.genTexture();
+    glState.bindTexture(GL_TEXTURE_2D, grownAtlasID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, atlasWidth, newRows * TERRAIN_SAMPLES, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    GLuint prevFramebuffer = glState.getFramebuffer();
+    GLuint framebufferID = glState.genFramebuffer();
+    glState.bindFramebuffer(framebufferID);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, heightAtlasID, 0);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, atlasWidth, atlasRows * TERRAIN_SAMPLES);
+    glState.bindFramebuffer(prevFramebuffer);
+    glState.deleteFramebuffer(framebufferID);
+
+    glState.deleteTexture(heightAtlasID);
+    heightAtlasID = grownAtlasID;
+    for (int tile = newRows * ATLAS_TILES_PER_ROW - 1; tile >= atlasRows * ATLAS_TILES_PER_ROW; tile--) {
+        freeTiles.push_back(tile);
+    }
+    atlasRows = newRows;
+    return true;
+}
 
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
+int GroundPlane::allocateHeightTile(const float* heights) {
+    if (heightAtlasID == 0 || (freeTiles.empty() && !growHeightAtlas())) {
+        return 0;
+    }
+    int tile = freeTiles.back();
+    freeTiles.pop_back();
+
+    // Rows are TERRAIN_SAMPLES floats, so the default unpack alignment of 4 holds.
+    GLStateCache::getInstance().bindTexture(GL_TEXTURE_2D, heightAtlasID);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (tile % ATLAS_TILES_PER_ROW) * TERRAIN_SAMPLES,
+                    (tile / ATLAS_TILES_PER_ROW) * TERRAIN_SAMPLES, TERRAIN_SAMPLES, TERRAIN_SAMPLES,
+                    GL_RED, GL_FLOAT, heights);
+    return tile;
+}
+
+void GroundPlane::releaseHeightTile(int tile) {
+    if (tile > 0) {
+        freeTiles.push_back(tile);
+    }
+}
+
+void GroundPlane::prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) {
+    const GroundPlane* ground = static_cast<const GroundPlane*>(packet.owner);
+    if (programChanged) {
+        glUniform1i(ground->textureSamplerID, 0);
+        glUniform1i(ground->heightAtlasSamplerID, 1);
+    }
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.bindTextureUnit(1, GL_TEXTURE_2D, ground->heightAtlasID);
+    glState.activeTexture(GL_TEXTURE0);
+
+    // Without indirect draws there is no base instance, so the instance
+    // attributes are re-pointed per LOD.
+    size_t instanceOffset = queue.getInstanceByteOffset(packet, sizeof(TerrainInstance));
+    glState.bindBuffer(GL_ARRAY_BUFFER, ground->instanceBufferID);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance),
+                          (void*)(instanceOffset + offsetof(TerrainInstance, chunk)));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance),
+                          (void*)(instanceOffset + offsetof(TerrainInstance, neighborLods)));
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, prevArrayBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, prevElementBuffer);
-    glBindVertexArray(prevVAO);
-    glUseProgram(prevProgram);
+void GroundPlane::submit(RenderQueue& queue, const std::vector<TerrainInstance>& instances) {
+    if (instances.empty() || programID == 0) {
+        return;
+    }
 
-    for (int i = 0; i < 4; i++) {
-        if (attribEnabled[i]) {
-            glEnableVertexAttribArray(i);
-        } else {
-            glDisableVertexAttribArray(i);
+    // Counting sort by LOD so each LOD is one contiguous instance range.
+    int lodStart[TERRAIN_MAX_LOD + 2] = {};
+    for (const TerrainInstance& instance : instances) {
+        lodStart[static_cast<int>(instance.chunk.w) + 1]++;
+    }
+    for (int lod = 0; lod <= TERRAIN_MAX_LOD; lod++) {
+        lodStart[lod + 1] += lodStart[lod];
+    }
+    int lodFill[TERRAIN_MAX_LOD + 1];
+    std::copy(lodStart, lodStart + TERRAIN_MAX_LOD + 1, lodFill);
+    sortedInstances.resize(instances.size());
+    for (const TerrainInstance& instance : instances) {
+        sortedInstances[lodFill[static_cast<int>(instance.chunk.w)]++] = instance;
+    }
+
+    // Orphan the instance buffer every frame; it only grows.
+    size_t instanceBytes = sortedInstances.size() * sizeof(TerrainInstance);
+    GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+    if (instanceBytes > instanceBufferCapacity) {
+        instanceBufferCapacity = instanceBytes * 2;
+    }
+    glBufferData(GL_ARRAY_BUFFER, instanceBufferCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instanceBytes, sortedInstances.data());
+
+    for (int lod = 0; lod <= TERRAIN_MAX_LOD; lod++) {
+        GLsizei count = lodStart[lod + 1] - lodStart[lod];
+        if (count == 0) {
+            continue;
         }
+
+        DrawPacket packet;
+        packet.sortKey = RenderQueue::makeSortKey(RenderLayer::Ground, programID, textureID, vertexArrayID);
+        packet.program = programID;
+        packet.vertexArray = vertexArrayID;
+        packet.texture = textureID;
+        packet.indexCount = lodIndexCount[lod];
+        packet.indexOffset = lodIndexOffset[lod] * sizeof(GLuint);
+        packet.instanceCount = count;
+        packet.baseInstance = static_cast<GLuint>(lodStart[lod]);
+        packet.prepare = &GroundPlane::prepareDraw;
+        packet.owner = this;
+        queue.submit(packet);
     }
 }
 
 void GroundPlane::cleanup() {
-    if (vertexBufferID) glDeleteBuffers(1, &vertexBufferID);
-    if (indexBufferID) glDeleteBuffers(1, &indexBufferID);
-    if (vertexArrayID) glDeleteVertexArrays(1, &vertexArrayID);
-    if (uvBufferID) glDeleteBuffers(1, &uvBufferID);
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.deleteBuffer(vertexBufferID);
+    glState.deleteBuffer(indexBufferID);
+    glState.deleteBuffer(instanceBufferID);
+    glState.deleteTexture(heightAtlasID);
+    glState.deleteVertexArray(vertexArrayID);
+    ShaderLibrary::getInstance().release(programID);
+    vertexBufferID = 0;
+    indexBufferID = 0;
+    instanceBufferID = 0;
+    heightAtlasID = 0;
+    vertexArrayID = 0;
+    programID = 0;
+    atlasRows = 0;
+    freeTiles.clear();
 }
\ No newline at end of file
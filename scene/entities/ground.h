@@ -1,36 +1,67 @@
 #pragma once
 #include <glad/gl.h>
 #include <glm/glm.hpp>
+#include <vector>
+#include "terrain.h"
+#include "../render/render_queue.h"
 
+// One instance of the terrain grid per chunk. Heights live in a shared R32F
+// atlas with one tile per loaded chunk; slot 0 stays flat for chunks that are
+// still in flight. The atlas is ATLAS_TILES_PER_ROW tiles wide (ground.vert
+// relies on that) and grows by rows when it runs out of tiles.
+struct TerrainInstance {
+    glm::vec4 chunk;        // origin x, origin z, height tile, LOD
+    glm::vec4 neighborLods; // -x, +x, -z, +z
+};
+
+// Shared heightfield grid drawn for every chunk. Each LOD is an index range
+// over the same (TERRAIN_CELLS + 1)^2 vertices, and instances are bucketed by
+// LOD so the whole visible ground takes at most TERRAIN_MAX_LOD + 1 draws.
 class GroundPlane {
 private:
-    GLuint modelMatrixID;
-    GLuint viewProjectionMatrixID;
-    GLuint lightPositionID;
-    GLuint lightIntensityID;
-    GLuint viewPositionID;
+    static constexpr int ATLAS_TILES_PER_ROW = 32;
+
+    GLuint heightAtlasSamplerID;
+    int atlasRows;
 
     GLuint programID;
-    GLuint mvpMatrixID;
     GLuint textureSamplerID;
     GLuint textureID;
+    GLuint heightAtlasID;
     GLuint vertexArrayID;
     GLuint vertexBufferID;
-    GLuint uvBufferID;
     GLuint indexBufferID;
-    GLuint normalBufferID;
+    GLuint instanceBufferID;
+    size_t instanceBufferCapacity;
+
+    GLsizei lodIndexOffset[TERRAIN_MAX_LOD + 1];
+    GLsizei lodIndexCount[TERRAIN_MAX_LOD + 1];
+
+    std::vector<int> freeTiles;
+    std::vector<TerrainInstance> sortedInstances;
+
+    static void prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged);
+    // Doubles the atlas rows, up to GL_MAX_TEXTURE_SIZE, keeping every tile
+    // where it is.
+    bool growHeightAtlas();
 
-    
 public:
     GroundPlane();
     ~GroundPlane();
     
-    void initialize();
-    void render(const glm::mat4& modelMatrix , const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                         const glm::vec3& lightIntensity, const glm::vec3& viewPosition);
-    void restoreState(GLint program, GLint vao, GLint arrayBuffer,
-                            GLint elementBuffer, GLint attribEnabled[4]);
+    // Sizes the atlas for tileCapacity chunks besides the flat tile.
+    void initialize(int tileCapacity);
+    bool isInitialized() const { return vertexArrayID != 0; }
+    // Copies a TERRAIN_SAMPLES^2 height grid into a free atlas tile, growing
+    // the atlas if none is left. Returns 0, the flat tile, only when it
+    // cannot grow any further.
+    int allocateHeightTile(const float* heights);
+    bool hasFreeHeightTile() const { return !freeTiles.empty(); }
+    int getHeightTileCapacity() const { return atlasRows * ATLAS_TILES_PER_ROW - 1; }
+    void releaseHeightTile(int tile);
+    // Uploads the instances now and queues one instanced draw per LOD.
+    void submit(RenderQueue& queue, const std::vector<TerrainInstance>& instances);
     void cleanup();
 
     static GLuint loadGroundShaders();
-};
\ No newline at end of file
+};
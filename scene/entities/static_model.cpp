@@ -1,11 +1,17 @@
 #include "static_model.h"
-#include "../render/shader.h"
+#include "../render/shader_library.h"
 #include "../utils/texture_manager.h"
+#include "../render/mesh_simplifier.h"
+#include "../render/mesh_optimizer.h"
+#include "../render/gl_state_cache.h"
+#include "../render/vertex_format.h"
+#include <iomanip>
 #include <iostream>
 #include <vector>
 #include <map>
 #include <string>
 #include <filesystem>
+#include <algorithm>
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -14,6 +20,39 @@
 
 std::unordered_map<std::string, std::shared_ptr<StaticModel::ModelCache>> StaticModel::modelCache;
 
+namespace {
+    // Index budget and error bound (relative to the mesh extent) of each
+    // generated level, and the screen coverage below which it is used.
+    constexpr int MAX_LOD_LEVELS = StaticModel::MAX_LODS;
+    constexpr float LOD_INDEX_RATIOS[MAX_LOD_LEVELS] = { 1.0f, 0.5f, 0.2f, 0.06f };
+    constexpr float LOD_MAX_ERRORS[MAX_LOD_LEVELS] = { 0.0f, 0.01f, 0.03f, 0.08f };
+    constexpr float LOD_COVERAGE_THRESHOLDS[MAX_LOD_LEVELS - 1] = { 0.25f, 0.1f, 0.04f };
+
+    // Instance matrices take locations 4-7, one column each.
+    constexpr GLuint INSTANCE_MATRIX_LOCATION = 4;
+
+    void pointInstanceMatrices(size_t byteOffset) {
+        for (GLuint column = 0; column < 4; column++) {
+            glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  BUFFER_OFFSET(byteOffset + column * sizeof(glm::vec4)));
+        }
+    }
+}
+
+size_t StaticInstanceList::size() const {
+    size_t count = 0;
+    for (const auto& lod : lods) {
+        count += lod.size();
+    }
+    return count;
+}
+
+void StaticInstanceList::clear() {
+    for (auto& lod : lods) {
+        lod.clear();
+    }
+}
+
 StaticModel::StaticModel() : cachedModel(nullptr) {
 }
 
@@ -44,36 +83,40 @@ StaticModel::ModelCache::~ModelCache() {
 }
 
 void StaticModel::ModelCache::cleanup() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    GeometryPool& geometryPool = GeometryPool::forLayout<StaticVertexLayout>();
     for (auto& primitive : primitiveObjects) {
-        if (primitive.vao) {
-            glDeleteVertexArrays(1, &primitive.vao);
-            primitive.vao = 0;
-        }
-
-        for (auto vbo : primitive.vbos) {
-            glDeleteBuffers(1, &vbo);
-        }
-        primitive.vbos.clear();
+        geometryPool.free(primitive.geometry);
 
         if (primitive.textureID && !primitive.isTextureFromManager) {
-            glDeleteTextures(1, &primitive.textureID);
+            glState.deleteTexture(primitive.textureID);
             primitive.textureID = 0;
         }
     }
     primitiveObjects.clear();
 
+    if (instanceBufferID) {
+        glState.deleteBuffer(instanceBufferID);
+        instanceBufferID = 0;
+        instanceBufferCapacity = 0;
+    }
+
     if (programID) {
-        glDeleteProgram(programID);
+        ShaderLibrary::getInstance().release(programID);
         programID = 0;
-        mvpMatrixID = 0;
         textureSamplerID = 0;
     }
+
+    if (instancedProgramID) {
+        ShaderLibrary::getInstance().release(instancedProgramID);
+        instancedProgramID = 0;
+    }
 }
 
 GLuint StaticModel::loadTextureFromMemory(const unsigned char* data, int width, int height, int channels) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint textureID = glState.genTexture();
+    glState.bindTexture(GL_TEXTURE_2D, textureID);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -93,9 +136,9 @@ GLuint StaticModel::loadTextureFromMemory(const unsigned char* data, int width,
 }
 
 GLuint StaticModel::createDefaultTexture() {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint textureID = glState.genTexture();
+    glState.bindTexture(GL_TEXTURE_2D, textureID);
 
     unsigned char defaultTexture[] = { 50, 205, 50, 255 };
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, defaultTexture);
@@ -119,11 +162,7 @@ std::shared_ptr<StaticModel::ModelCache> StaticModel::loadModelToCache(const cha
 
     auto cache = std::make_shared<ModelCache>();
 
-    GLint prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer;
-    GLboolean prevDepthTest, prevCullFace;
-    GLint attribEnabled[4];
-
-    saveOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,prevDepthTest, prevCullFace, attribEnabled);
+    GLStateCache& glState = GLStateCache::getInstance();
 
     tinygltf::TinyGLTF loader;
     tinygltf::Model model;
@@ -134,36 +173,55 @@ std::shared_ptr<StaticModel::ModelCache> StaticModel::loadModelToCache(const cha
 
     if (!res) {
         std::cout << "Failed to load glTF: " << filename << " - " << err << std::endl;
-        restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                          prevDepthTest, prevCullFace, attribEnabled);
         return nullptr;
     }
 
     if (model.meshes.empty()) {
         std::cout << "Model has no meshes: " << filename << std::endl;
-        restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                          prevDepthTest, prevCullFace, attribEnabled);
         return nullptr;
     }
 
-    cache->programID = LoadShadersFromFile("../scene/shaders/static.vert",
-                                          "../scene/shaders/static.frag");
+    ShaderLibrary& shaders = ShaderLibrary::getInstance();
+    cache->programID = shaders.acquire("../scene/shaders/static.vert", "../scene/shaders/static.frag");
     if (cache->programID == 0) {
         std::cerr << "Failed to load static model shaders" << std::endl;
-        restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                          prevDepthTest, prevCullFace, attribEnabled);
         return nullptr;
     }
 
-    cache->modelMatrixID = glGetUniformLocation(cache->programID, "modelMatrix");
-    cache->viewProjectionMatrixID = glGetUniformLocation(cache->programID, "viewProjectionMatrix");
-    cache->mvpMatrixID = glGetUniformLocation(cache->programID, "MVP");
-    cache->lightPositionID = glGetUniformLocation(cache->programID, "lightPosition");
-    cache->lightIntensityID = glGetUniformLocation(cache->programID, "lightIntensity");
-    cache->viewPositionID = glGetUniformLocation(cache->programID, "viewPosition");
-    cache->textureSamplerID = glGetUniformLocation(cache->programID, "textureSampler");
+    cache->textureSamplerID = shaders.getUniformLocation(cache->programID, "textureSampler");
+
+    cache->instancedProgramID = shaders.acquire("../scene/shaders/static_instanced.vert",
+                                                "../scene/shaders/static.frag");
+    if (cache->instancedProgramID == 0) {
+        std::cerr << "Failed to load instanced static model shaders" << std::endl;
+    } else {
+        cache->instancedTextureSamplerID = shaders.getUniformLocation(cache->instancedProgramID, "textureSampler");
+    }
+
+    // Starts with one identity matrix so the instance attributes always have
+    // something to read, even from the non-instanced path.
+    glm::mat4 identity(1.0f);
+    cache->instanceBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_ARRAY_BUFFER, cache->instanceBufferID);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), &identity[0][0], GL_STREAM_DRAW);
+    cache->instanceBufferCapacity = sizeof(glm::mat4);
+
+    // The instance attributes live on the shared VAO next to the pool's
+    // vertex layout; prepareInstancedDraw re-points them for every draw.
+    GeometryPool& geometryPool = GeometryPool::forLayout<StaticVertexLayout>();
+    cache->vertexArrayID = geometryPool.getVertexArray();
+    glState.bindVertexArray(cache->vertexArrayID);
+    glState.bindBuffer(GL_ARRAY_BUFFER, cache->instanceBufferID);
+    for (GLuint column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+        glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+    }
+    pointInstanceMatrices(0);
+    glState.bindVertexArray(0);
 
     const tinygltf::Mesh &mesh = model.meshes[0];
+    VertexPackingStats packingStats;
+    MeshOptimizationStats optimizationStats;
 
     for (size_t i = 0; i < mesh.primitives.size(); ++i) {
         const tinygltf::Primitive &primitive = mesh.primitives[i];
@@ -173,65 +231,107 @@ std::shared_ptr<StaticModel::ModelCache> StaticModel::loadModelToCache(const cha
         primObj.indexCount = 0;
         primObj.indexType = GL_UNSIGNED_INT;
 
-        glGenVertexArrays(1, &primObj.vao);
-        glBindVertexArray(primObj.vao);
+        std::vector<StaticVertex> vertices;
+        if (!packStaticVertices(model, primitive, vertices, packingStats)) {
+            std::cerr << "Skipping primitive " << i << " of " << filename << ": unreadable vertex attributes"
+                      << std::endl;
+            continue;
+        }
+
+        auto positionAttrib = primitive.attributes.find("POSITION");
+        const tinygltf::Accessor &positionAccessor = model.accessors[positionAttrib->second];
+        if (positionAccessor.minValues.size() == 3 && positionAccessor.maxValues.size() == 3) {
+            cache->bounds.expand(AABB(
+                glm::vec3(positionAccessor.minValues[0], positionAccessor.minValues[1], positionAccessor.minValues[2]),
+                glm::vec3(positionAccessor.maxValues[0], positionAccessor.maxValues[1], positionAccessor.maxValues[2])));
+        }
 
-        for (auto &attrib : primitive.attributes) {
-            const tinygltf::Accessor &accessor = model.accessors[attrib.second];
+        const tinygltf::Accessor *indexAccessor = primitive.indices >= 0 ? &model.accessors[primitive.indices] : nullptr;
+        std::vector<uint32_t> indices;
+        if (!indexAccessor || indexAccessor->bufferView < 0 || indexAccessor->bufferView >= model.bufferViews.size() ||
+            !readIndices(model, *indexAccessor, indices)) {
+            std::cerr << "Skipping primitive " << i << " of " << filename << ": no index data" << std::endl;
+            continue;
+        }
 
-            if (accessor.bufferView < 0 || accessor.bufferView >= model.bufferViews.size()) {
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++) {
+            positions[v] = vertices[v].position;
+        }
+        bool isTriangleList = primitive.mode == TINYGLTF_MODE_TRIANGLES;
+
+        // Reorder the full-detail triangles for the post-transform cache and
+        // then for overdraw before any LOD is derived from them.
+        float acmrBefore = computeAcmr(indices, vertices.size());
+        if (isTriangleList) {
+            std::vector<uint32_t> clusters;
+            indices = optimizeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE, &clusters);
+            indices = optimizeOverdraw(positions, indices, clusters);
+        }
+        optimizationStats.addAcmr(indices.size() / 3, acmrBefore, computeAcmr(indices, vertices.size()));
+
+        // Every level is stored back to back in the pool's index buffer and
+        // shares the primitive's vertices. Offsets are counted in indices
+        // until the index size is known.
+        std::vector<uint32_t> lodIndices = indices;
+        LodLevel baseLevel;
+        baseLevel.indexCount = static_cast<int>(indices.size());
+        primObj.lods.push_back(baseLevel);
+
+        for (int level = 1; isTriangleList && level < MAX_LOD_LEVELS; level++) {
+            size_t target = static_cast<size_t>(indices.size() * LOD_INDEX_RATIOS[level]) / 3 * 3;
+            float error = 0.0f;
+            std::vector<uint32_t> simplified = simplifyMesh(positions, indices, target, LOD_MAX_ERRORS[level], &error);
+            if (simplified.empty() || simplified.size() * 10 > primObj.lods.back().indexCount * 9) {
+                // A later level may still get far enough with its larger
+                // error bound.
                 continue;
             }
 
-            const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-            const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-            GLuint vbo;
-            glGenBuffers(1, &vbo);
-            glBindBuffer(bufferView.target, vbo);
-            glBufferData(bufferView.target, bufferView.byteLength,&buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
-
-            primObj.vbos.push_back(vbo);
-
-            int location = -1;
-            if (attrib.first == "POSITION") location = 0;
-            else if (attrib.first == "NORMAL") location = 1;
-            else if (attrib.first == "TEXCOORD_0") location = 2;
-
-            if (location >= 0) {
-                glEnableVertexAttribArray(location);
-                glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-                GLint size = 1;
-                if (accessor.type == TINYGLTF_TYPE_VEC2) size = 2;
-                else if (accessor.type == TINYGLTF_TYPE_VEC3) size = 3;
-                else if (accessor.type == TINYGLTF_TYPE_VEC4) size = 4;
-
-                glVertexAttribPointer(location, size, accessor.componentType,
-                    accessor.normalized ? GL_TRUE : GL_FALSE,
-                    accessor.ByteStride(bufferView),
-                    BUFFER_OFFSET(accessor.byteOffset));
+            // Levels that were skipped reuse the range before them, so
+            // primObj.lods stays indexed by the same coverage thresholds.
+            while (primObj.lods.size() < static_cast<size_t>(level)) {
+                primObj.lods.push_back(primObj.lods.back());
             }
+            LodLevel lodLevel;
+            lodLevel.indexCount = static_cast<int>(simplified.size());
+            lodLevel.indexOffset = lodIndices.size();
+            lodLevel.error = error;
+            primObj.lods.push_back(lodLevel);
+            simplified = optimizeVertexCache(simplified, vertices.size());
+            lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
         }
 
-        if (primitive.indices >= 0) {
-            const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
-
-            if (indexAccessor.bufferView >= 0 && indexAccessor.bufferView < model.bufferViews.size()) {
-                const tinygltf::BufferView &indexBufferView = model.bufferViews[indexAccessor.bufferView];
-                const tinygltf::Buffer &indexBuffer = model.buffers[indexBufferView.buffer];
-
-                GLuint ebo;
-                glGenBuffers(1, &ebo);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferView.byteLength,
-                            &indexBuffer.data.at(0) + indexBufferView.byteOffset, GL_STATIC_DRAW);
+        // Renumber vertices in first-use order over all levels, full detail
+        // first, and drop the ones nothing references.
+        size_t sourceVertexCount = vertices.size();
+        std::vector<uint32_t> remap;
+        size_t vertexCount = buildVertexFetchRemap(lodIndices, vertices.size(), remap);
+        remapVertices(vertices, remap, vertexCount);
+        remapIndices(lodIndices, remap);
+
+        bool shortIndices = fitsShortIndices(vertexCount);
+        size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+        size_t indexBytes = lodIndices.size() * indexSize;
+        for (LodLevel& lodLevel : primObj.lods) {
+            lodLevel.indexOffset *= indexSize;
+        }
 
-                primObj.vbos.push_back(ebo);
-                primObj.indexCount = indexAccessor.count;
-                primObj.indexType = indexAccessor.componentType;
-            }
+        if (shortIndices) {
+            std::vector<uint16_t> shortLodIndices = narrowIndices(lodIndices);
+            primObj.geometry = geometryPool.allocate(vertices.data(), vertices.size(), shortLodIndices.data(),
+                                                     indexBytes, indexSize);
+        } else {
+            primObj.geometry = geometryPool.allocate(vertices.data(), vertices.size(), lodIndices.data(),
+                                                     indexBytes, indexSize);
         }
+        primObj.indexCount = baseLevel.indexCount;
+        primObj.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        optimizationStats.primitives++;
+        optimizationStats.shortIndexPrimitives += shortIndices ? 1 : 0;
+        optimizationStats.bytesBefore += sourceVertexCount * sizeof(StaticVertex) + lodIndices.size() * sizeof(uint32_t);
+        optimizationStats.bytesAfter += vertices.size() * sizeof(StaticVertex) + indexBytes;
 
         GLuint textureID = 0;
         bool isTextureFromManager = false;
@@ -276,27 +376,55 @@ std::shared_ptr<StaticModel::ModelCache> StaticModel::loadModelToCache(const cha
         primObj.isTextureFromManager = isTextureFromManager;
 
         cache->primitiveObjects.push_back(primObj);
-        glBindVertexArray(0);
     }
 
-    restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                      prevDepthTest, prevCullFace, attribEnabled);
 
     if (cache->primitiveObjects.empty()) {
         return nullptr;
     }
 
+    // Primitives with fewer levels keep drawing their last one; submit and
+    // appendIndirectCommands clamp per primitive. Each level's indices are
+    // summed against LOD 0 of the same primitives for the model summary.
+    cache->lodCount = 1;
+    size_t lodIndices[MAX_LODS] = {};
+    size_t lodBaseIndices[MAX_LODS] = {};
+    float lodErrors[MAX_LODS] = {};
+    for (const auto& primitive : cache->primitiveObjects) {
+        cache->lodCount = std::max(cache->lodCount, static_cast<int>(primitive.lods.size()));
+        for (size_t level = 1; level < primitive.lods.size(); level++) {
+            lodIndices[level] += primitive.lods[level].indexCount;
+            lodBaseIndices[level] += primitive.lods[0].indexCount;
+            lodErrors[level] = std::max(lodErrors[level], primitive.lods[level].error);
+        }
+    }
+
     cache->referenceCount = 1;
     modelCache[filename] = cache;
 
     std::cout << "Model cached successfully: " << filename
               << " (primitives: " << cache->primitiveObjects.size()
               << ", textures loaded)" << std::endl;
+    packingStats.print();
+    optimizationStats.print();
+    if (cache->lodCount > 1) {
+        std::cout << "  LOD indices vs LOD 0:";
+        for (int level = 1; level < cache->lodCount; level++) {
+            std::cout << (level > 1 ? ", " : " ") << level << " " << std::fixed << std::setprecision(0)
+                      << 100.0 * lodIndices[level] / lodBaseIndices[level] << "% (error " << std::setprecision(3)
+                      << lodErrors[level] << ")";
+        }
+        std::cout << std::endl;
+    }
 
     return cache;
 }
 
 bool StaticModel::loadModel(const char* filename) {
+    if (cachedModel && modelFilename == filename) {
+        return true;
+    }
+
     cleanup();
 
     cachedModel = loadModelToCache(filename);
@@ -308,80 +436,198 @@ bool StaticModel::loadModel(const char* filename) {
     return true;
 }
 
-void StaticModel::saveOpenGLState(GLint& program, GLint& vao, GLint& arrayBuffer,
-                                 GLint& elementBuffer, GLboolean& depthTest,
-                                 GLboolean& cullFace, GLint attribEnabled[4]) {
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
-    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
-    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+int StaticModel::selectLod(float screenCoverage) const {
+    int lodCount = getLodCount();
+    int lod = 0;
+    while (lod < lodCount - 1 && screenCoverage < LOD_COVERAGE_THRESHOLDS[lod]) {
+        lod++;
+    }
+    return lod;
+}
 
-    depthTest = glIsEnabled(GL_DEPTH_TEST);
-    cullFace = glIsEnabled(GL_CULL_FACE);
+float StaticModel::getLodCoverageThreshold(int lod) {
+    return LOD_COVERAGE_THRESHOLDS[std::min(std::max(lod, 0), MAX_LOD_LEVELS - 2)];
+}
 
-    for (int i = 0; i < 4; i++) {
-        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attribEnabled[i]);
+void StaticModel::prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) {
+    // Camera, light and model matrix all come from the queue's uniform blocks.
+    const ModelCache* cache = static_cast<const ModelCache*>(packet.owner);
+    if (programChanged) {
+        glUniform1i(cache->textureSamplerID, 0);
     }
 }
 
-void StaticModel::restoreOpenGLState(GLint program, GLint vao, GLint arrayBuffer,
-                                    GLint elementBuffer, GLboolean depthTest,
-                                    GLboolean cullFace, GLint attribEnabled[4]) {
-    glUseProgram(program);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+void StaticModel::prepareInstancedDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) {
+    const ModelCache* cache = static_cast<const ModelCache*>(packet.owner);
+    if (programChanged) {
+        glUniform1i(cache->instancedTextureSamplerID, 0);
+    }
 
-    if (depthTest) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
-    if (cullFace) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
+    // Without indirect draws there is no base instance, so each LOD bucket
+    // re-points the matrix attributes.
+    GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, cache->instanceBufferID);
+    pointInstanceMatrices(queue.getInstanceByteOffset(packet, sizeof(glm::mat4)));
+}
 
-    for (int i = 0; i < 4; i++) {
-        if (attribEnabled[i]) {
-            glEnableVertexAttribArray(i);
-        } else {
-            glDisableVertexAttribArray(i);
-        }
+void StaticModel::prepareGpuCulledDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) {
+    const ModelCache* cache = static_cast<const ModelCache*>(packet.owner);
+    if (programChanged) {
+        glUniform1i(cache->instancedTextureSamplerID, 0);
     }
+
+    // The commands' base instances select the region of each LOD.
+    GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, cache->culledInstanceBufferID);
+    pointInstanceMatrices(0);
 }
 
-void StaticModel::render(const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                        const glm::vec3& lightIntensity, const glm::vec3& viewPosition) {
+void StaticModel::submit(RenderQueue& queue, const glm::mat4& modelMatrix, int lod) {
     if (!cachedModel || cachedModel->programID == 0 || cachedModel->primitiveObjects.empty()) {
         return;
     }
 
-    GLint prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer;
-    GLboolean prevDepthTest, prevCullFace;
-    GLint attribEnabled[4];
-    saveOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                   prevDepthTest, prevCullFace, attribEnabled);
+    int objectIndex = queue.pushObject(modelMatrix);
 
-    glUseProgram(cachedModel->programID);
+    for (const auto& primitive : cachedModel->primitiveObjects) {
+        if (primitive.lods.empty()) {
+            continue;
+        }
+        const LodLevel& level = primitive.lods[std::min<size_t>(lod, primitive.lods.size() - 1)];
+
+        DrawPacket packet;
+        packet.sortKey = RenderQueue::makeSortKey(RenderLayer::Opaque, cachedModel->programID, primitive.textureID,
+                                                  cachedModel->vertexArrayID);
+        packet.program = cachedModel->programID;
+        packet.vertexArray = cachedModel->vertexArrayID;
+        packet.texture = primitive.textureID;
+        packet.mode = primitive.mode;
+        packet.indexType = primitive.indexType;
+        packet.indexCount = level.indexCount;
+        packet.indexOffset = primitive.geometry.indexOffset + level.indexOffset;
+        packet.baseVertex = static_cast<GLint>(primitive.geometry.baseVertex);
+        packet.prepare = &StaticModel::prepareDraw;
+        packet.owner = cachedModel.get();
+        packet.objectIndex = objectIndex;
+        queue.submit(packet);
+    }
+}
 
-    glm::mat4 mvp = viewProjectionMatrix * modelMatrix;
-    glUniformMatrix4fv(cachedModel->mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-    glUniformMatrix4fv(cachedModel->modelMatrixID, 1, GL_FALSE, &modelMatrix[0][0]);
-    glUniform3fv(cachedModel->lightPositionID, 1, &lightPosition[0]);
-    glUniform3fv(cachedModel->lightIntensityID, 1, &lightIntensity[0]);
-    glUniform3fv(cachedModel->viewPositionID, 1, &viewPosition[0]);
+void StaticModel::submitInstanced(RenderQueue& queue, const StaticInstanceList& instances) {
+    if (!cachedModel || cachedModel->instancedProgramID == 0 || cachedModel->primitiveObjects.empty() ||
+        instances.empty()) {
+        return;
+    }
 
-    glActiveTexture(GL_TEXTURE0);
-    glUniform1i(cachedModel->textureSamplerID, 0);
+    // All LOD buckets go back to back into the orphaned instance buffer; it only grows.
+    size_t instanceBytes = instances.size() * sizeof(glm::mat4);
+    GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, cachedModel->instanceBufferID);
+    if (instanceBytes > cachedModel->instanceBufferCapacity) {
+        cachedModel->instanceBufferCapacity = instanceBytes * 2;
+    }
+    glBufferData(GL_ARRAY_BUFFER, cachedModel->instanceBufferCapacity, nullptr, GL_STREAM_DRAW);
+
+    GLuint lodStart[MAX_LODS];
+    GLuint start = 0;
+    for (int lod = 0; lod < MAX_LODS; lod++) {
+        lodStart[lod] = start;
+        size_t bytes = instances.lods[lod].size() * sizeof(glm::mat4);
+        if (bytes > 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, start * sizeof(glm::mat4), bytes, instances.lods[lod].data());
+        }
+        start += static_cast<GLuint>(instances.lods[lod].size());
+    }
+
+    for (const auto& primitive : cachedModel->primitiveObjects) {
+        if (primitive.lods.empty()) {
+            continue;
+        }
+        for (int lod = 0; lod < MAX_LODS; lod++) {
+            GLsizei count = static_cast<GLsizei>(instances.lods[lod].size());
+            if (count == 0) {
+                continue;
+            }
+            const LodLevel& level = primitive.lods[std::min<size_t>(lod, primitive.lods.size() - 1)];
+
+            DrawPacket packet;
+            packet.sortKey = RenderQueue::makeSortKey(RenderLayer::Opaque, cachedModel->instancedProgramID,
+                                                      primitive.textureID, cachedModel->vertexArrayID);
+            packet.program = cachedModel->instancedProgramID;
+            packet.vertexArray = cachedModel->vertexArrayID;
+            packet.texture = primitive.textureID;
+            packet.mode = primitive.mode;
+            packet.indexType = primitive.indexType;
+            packet.indexCount = level.indexCount;
+            packet.indexOffset = primitive.geometry.indexOffset + level.indexOffset;
+            packet.baseVertex = static_cast<GLint>(primitive.geometry.baseVertex);
+            packet.instanceCount = count;
+            packet.baseInstance = lodStart[lod];
+            packet.prepare = &StaticModel::prepareInstancedDraw;
+            packet.owner = cachedModel.get();
+            queue.submit(packet);
+        }
+    }
+}
+
+GLuint StaticModel::appendIndirectCommands(std::vector<DrawElementsIndirectCommand>& out,
+                                           const GLuint lodBaseInstance[MAX_LODS]) const {
+    if (!cachedModel || cachedModel->instancedProgramID == 0) {
+        return 0;
+    }
 
+    GLuint primitives = 0;
     for (const auto& primitive : cachedModel->primitiveObjects) {
-        glBindTexture(GL_TEXTURE_2D, primitive.textureID);
-        glBindVertexArray(primitive.vao);
+        if (primitive.lods.empty()) {
+            continue;
+        }
+        for (int lod = 0; lod < MAX_LODS; lod++) {
+            const LodLevel& level = primitive.lods[std::min<size_t>(lod, primitive.lods.size() - 1)];
+            DrawElementsIndirectCommand command;
+            command.count = static_cast<GLuint>(level.indexCount);
+            command.instanceCount = 0;
+            size_t indexSize = primitive.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            command.firstIndex = static_cast<GLuint>((primitive.geometry.indexOffset + level.indexOffset) /
+                                                     indexSize);
+            command.baseVertex = static_cast<GLint>(primitive.geometry.baseVertex);
+            command.baseInstance = lodBaseInstance[lod];
+            out.push_back(command);
+        }
+        primitives++;
+    }
+    return primitives;
+}
 
-        if (primitive.indexCount > 0) {
-            glDrawElements(primitive.mode, primitive.indexCount,
-                         primitive.indexType, nullptr);
+void StaticModel::submitGpuCulled(RenderQueue& queue, GLuint commandBuffer, size_t commandOffset,
+                                  GLuint instanceBuffer) {
+    if (!cachedModel || cachedModel->instancedProgramID == 0) {
+        return;
+    }
+    cachedModel->culledInstanceBufferID = instanceBuffer;
+
+    for (const auto& primitive : cachedModel->primitiveObjects) {
+        if (primitive.lods.empty()) {
+            continue;
         }
 
-        glBindVertexArray(0);
+        DrawPacket packet;
+        packet.sortKey = RenderQueue::makeSortKey(RenderLayer::Opaque, cachedModel->instancedProgramID,
+                                                  primitive.textureID, cachedModel->vertexArrayID);
+        packet.program = cachedModel->instancedProgramID;
+        packet.vertexArray = cachedModel->vertexArrayID;
+        packet.texture = primitive.textureID;
+        packet.mode = primitive.mode;
+        packet.indexType = primitive.indexType;
+        packet.indirectBuffer = commandBuffer;
+        packet.indirectOffset = commandOffset;
+        packet.indirectDrawCount = MAX_LODS;
+        packet.prepare = &StaticModel::prepareGpuCulledDraw;
+        packet.owner = cachedModel.get();
+        queue.submit(packet);
+        commandOffset += MAX_LODS * sizeof(DrawElementsIndirectCommand);
     }
+}
 
-    restoreOpenGLState(prevProgram, prevVAO, prevArrayBuffer, prevElementBuffer,
-                      prevDepthTest, prevCullFace, attribEnabled);
+const AABB& StaticModel::getBounds() const {
+    static const AABB emptyBounds;
+    return cachedModel ? cachedModel->bounds : emptyBounds;
 }
 
 void StaticModel::cleanup() {
@@ -5,30 +5,48 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include "../render/frustum.h"
+#include "../render/render_queue.h"
+#include "../render/geometry_pool.h"
+
+struct StaticInstanceList;
 
 class StaticModel {
+public:
+    static constexpr int MAX_LODS = 4;
+
 private:
+    struct LodLevel {
+        int indexCount = 0;
+        size_t indexOffset = 0;
+        float error = 0.0f;
+    };
+
+    // Vertices and all LOD index ranges live in the shared GeometryPool.
     struct PrimitiveObject {
-        GLuint vao = 0;
-        std::vector<GLuint> vbos;
+        GeometryAllocation geometry;
         GLenum mode = GL_TRIANGLES;
         int indexCount = 0;
         GLenum indexType = GL_UNSIGNED_INT;
         GLuint textureID = 0;
         bool isTextureFromManager = false;
+        std::vector<LodLevel> lods;
     };
 
     struct ModelCache {
         GLuint programID;
-        GLuint modelMatrixID;
-        GLuint viewProjectionMatrixID;
-        GLuint mvpMatrixID;
-        GLuint lightPositionID;
-        GLuint lightIntensityID;
-        GLuint ambientLightID;
-        GLuint viewPositionID;
         GLuint textureSamplerID;
+        GLuint instancedProgramID = 0;
+        GLuint instancedTextureSamplerID = 0;
+        GLuint instanceBufferID = 0;
+        size_t instanceBufferCapacity = 0;
+        // Matrices written by the GPU cull, drawn by submitGpuCulled.
+        GLuint culledInstanceBufferID = 0;
+        GLuint vertexArrayID = 0;
         std::vector<PrimitiveObject> primitiveObjects;
+        AABB bounds;
+        int lodCount = 1;
+        int impostorId = -1;
         int referenceCount = 0;
 
         ~ModelCache();
@@ -43,12 +61,9 @@ private:
     GLuint createDefaultTexture();
     std::shared_ptr<ModelCache> loadModelToCache(const char* filename);
 
-    void saveOpenGLState(GLint& program, GLint& vao, GLint& arrayBuffer,
-                        GLint& elementBuffer, GLboolean& depthTest,
-                        GLboolean& cullFace, GLint attribEnabled[4]);
-    void restoreOpenGLState(GLint program, GLint vao, GLint arrayBuffer,
-                           GLint elementBuffer, GLboolean depthTest,
-                           GLboolean cullFace, GLint attribEnabled[4]);
+    static void prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged);
+    static void prepareInstancedDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged);
+    static void prepareGpuCulledDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged);
 
 public:
     StaticModel();
@@ -61,9 +76,40 @@ public:
     StaticModel& operator=(StaticModel&& other) noexcept;
 
     bool loadModel(const char* filename);
-    void render(const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
-                        const glm::vec3& lightIntensity, const glm::vec3& viewPosition);
+    // Queues one draw per primitive using the queue's frame uniforms.
+    void submit(RenderQueue& queue, const glm::mat4& modelMatrix, int lod = 0);
+    // Uploads the instance matrices now and queues one instanced draw per
+    // primitive and non-empty LOD bucket. The instance buffer is shared by
+    // every StaticModel of the same file, so call it once per model per flush.
+    void submitInstanced(RenderQueue& queue, const StaticInstanceList& instances);
+    // Appends MAX_LODS commands per primitive, with no instances yet and the
+    // LOD's first instance from lodBaseInstance, for a compute pass to count
+    // into. Returns the number of primitives.
+    GLuint appendIndirectCommands(std::vector<DrawElementsIndirectCommand>& out,
+                                  const GLuint lodBaseInstance[MAX_LODS]) const;
+    // Queues one packet per primitive that draws the commands appended by
+    // appendIndirectCommands at commandOffset of commandBuffer, reading the
+    // instance matrices from instanceBuffer.
+    void submitGpuCulled(RenderQueue& queue, GLuint commandBuffer, size_t commandOffset, GLuint instanceBuffer);
     void cleanup();
+    const AABB& getBounds() const;
+    int getLodCount() const { return cachedModel ? cachedModel->lodCount : 0; }
+    int selectLod(float screenCoverage) const;
+    // Screen coverage below which LOD lod + 1 is used.
+    static float getLodCoverageThreshold(int lod);
+    int getImpostorId() const { return cachedModel ? cachedModel->impostorId : -1; }
+    void setImpostorId(int id) { if (cachedModel) cachedModel->impostorId = id; }
 
     static void cleanupAll();
-};
\ No newline at end of file
+};
+
+// Model matrices of one model's visible instances, bucketed by LOD. Filled
+// during a frame and consumed by StaticModel::submitInstanced.
+struct StaticInstanceList {
+    std::vector<glm::mat4> lods[StaticModel::MAX_LODS];
+
+    void add(const glm::mat4& modelMatrix, int lod) { lods[lod].push_back(modelMatrix); }
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    void clear();
+};
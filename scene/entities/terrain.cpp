@@ -0,0 +1,66 @@
+#include "terrain.h"
+#include "terrain_noise.h"
+#include <algorithm>
+
+namespace {
+    bool cpuHasAvx2() {
+#if defined(WONDERLAND_TERRAIN_AVX2)
+        // Runs before main, possibly ahead of the runtime's own CPU probe.
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+        return false;
+#endif
+    }
+
+    bool useAvx2 = cpuHasAvx2();
+}
+
+void generateHeightGrid(int chunkX, int chunkZ, float* heights) {
+#if defined(WONDERLAND_TERRAIN_AVX2)
+    if (useAvx2) {
+        generateHeightGridAvx2(chunkX, chunkZ, heights);
+        return;
+    }
+#endif
+    fillHeightGrid(chunkX, chunkZ, heights);
+}
+
+bool setTerrainAvx2(bool enabled) {
+    useAvx2 = enabled && cpuHasAvx2();
+    return useAvx2;
+}
+
+const char* getTerrainSimdPath() {
+    if (useAvx2) {
+        return "AVX2";
+    }
+#if defined(TERRAIN_USE_AVX2)
+    return "AVX2";
+#elif defined(TERRAIN_USE_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+float sampleHeightGrid(const float* heights, float localX, float localZ) {
+    float gx = std::min(std::max((localX + CHUNK_SIZE * 0.5f) / CELL_SIZE, 0.0f), static_cast<float>(TERRAIN_CELLS));
+    float gz = std::min(std::max((localZ + CHUNK_SIZE * 0.5f) / CELL_SIZE, 0.0f), static_cast<float>(TERRAIN_CELLS));
+    int i = std::min(static_cast<int>(gx), TERRAIN_CELLS - 1);
+    int j = std::min(static_cast<int>(gz), TERRAIN_CELLS - 1);
+    float fx = gx - i;
+    float fz = gz - j;
+
+    auto at = [heights](int x, int z) { return heights[(z + 1) * TERRAIN_SAMPLES + (x + 1)]; };
+    float h00 = at(i, j);
+    float h10 = at(i + 1, j);
+    float h01 = at(i, j + 1);
+    float h11 = at(i + 1, j + 1);
+
+    // Cells are split along the (i, j)-(i + 1, j + 1) diagonal.
+    if (fz >= fx) {
+        return h00 + fz * (h01 - h00) + fx * (h11 - h01);
+    }
+    return h00 + fx * (h10 - h00) + fz * (h11 - h10);
+}
@@ -0,0 +1,28 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+// Procedural heightfield shared by the chunk generator (CPU) and the ground
+// renderer (GPU). Each chunk stores a (TERRAIN_CELLS + 1)^2 vertex grid plus a
+// one-sample border so normals can be taken across chunk edges.
+static constexpr int TERRAIN_CELLS = 32;
+static constexpr int TERRAIN_SAMPLES = TERRAIN_CELLS + 3;
+static constexpr int TERRAIN_MAX_LOD = 3;
+static constexpr float TERRAIN_AMPLITUDE = 120.0f;
+
+// Fills heights[TERRAIN_SAMPLES * TERRAIN_SAMPLES], rows along z. Every sample
+// goes through the same SIMD path (SSE2 or scalar as compiled, or AVX2 when
+// built with WONDERLAND_TERRAIN_AVX2 and the CPU has it), so chunks that
+// share an edge produce bit-identical heights on it.
+void generateHeightGrid(int chunkX, int chunkZ, float* heights);
+// Turns the AVX2 path off or back on and returns whether it is in use. For
+// benchmarks only: chunks generated on different paths may not match along
+// their shared edges.
+bool setTerrainAvx2(bool enabled);
+// "AVX2", "SSE2" or "scalar": the path generateHeightGrid currently takes.
+const char* getTerrainSimdPath();
+
+// Height at a chunk-local position in [-SIZE/2, SIZE/2], interpolated over
+// the same triangle split the renderer uses at LOD 0.
+float sampleHeightGrid(const float* heights, float localX, float localZ);
+
+#endif
@@ -0,0 +1,12 @@
+// Compiled with -mavx2 -mfma when WONDERLAND_TERRAIN_AVX2 is on, so the
+// kernel takes its eight-lane path; terrain.cpp only calls it on CPUs that
+// have AVX2 and FMA.
+#include "terrain_noise.h"
+
+#if !defined(__AVX2__) || !defined(__FMA__)
+#error "terrain_avx2.cpp must be compiled with -mavx2 -mfma"
+#endif
+
+void generateHeightGridAvx2(int chunkX, int chunkZ, float* heights) {
+    fillHeightGrid(chunkX, chunkZ, heights);
+}
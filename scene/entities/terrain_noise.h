@@ -0,0 +1,208 @@
+#ifndef TERRAIN_NOISE_H
+#define TERRAIN_NOISE_H
+
+// The heightfield kernel behind generateHeightGrid, included by terrain.cpp
+// with the build's own flags and by terrain_avx2.cpp with -mavx2 -mfma; the
+// lane width is picked from what each includer is compiled for. Everything
+// here has internal linkage and calls no library templates, so no function
+// built for AVX2 can be merged into the baseline code by the linker.
+
+#include "terrain.h"
+#include "chunk_descriptor.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TERRAIN_USE_AVX2 1
+static constexpr int SIMD_WIDTH = 8;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TERRAIN_USE_SSE2 1
+static constexpr int SIMD_WIDTH = 4;
+#else
+static constexpr int SIMD_WIDTH = 1;
+#endif
+
+namespace {
+    constexpr int OCTAVES = 5;
+    constexpr float BASE_FREQUENCY = 1.0f / 2500.0f;
+    constexpr float OCTAVE_SHIFT = 17.13f;
+    constexpr uint32_t HASH_X = 0x27D4EB2Du;
+    constexpr uint32_t HASH_Z = 0x165667B1u;
+    constexpr uint32_t HASH_MIX = 0x2C1B3C6Du;
+    constexpr float CELL_SIZE = static_cast<float>(CHUNK_SIZE) / TERRAIN_CELLS;
+
+    // Padded so a whole row is a multiple of every SIMD width.
+    constexpr int ROW_PADDED = (TERRAIN_SAMPLES + 7) & ~7;
+
+#if defined(TERRAIN_USE_AVX2)
+    struct Lanes {
+        using F = __m256;
+        using I = __m256i;
+        static F set(float v) { return _mm256_set1_ps(v); }
+        static I seti(uint32_t v) { return _mm256_set1_epi32(static_cast<int>(v)); }
+        static F load(const float* p) { return _mm256_loadu_ps(p); }
+        static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+        static F add(F a, F b) { return _mm256_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static I floorToInt(F v) { return _mm256_cvtps_epi32(_mm256_floor_ps(v)); }
+        static F toFloat(I v) { return _mm256_cvtepi32_ps(v); }
+        static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+        static I mullo(I a, I b) { return _mm256_mullo_epi32(a, b); }
+        static I xori(I a, I b) { return _mm256_xor_si256(a, b); }
+        static I andi(I a, I b) { return _mm256_and_si256(a, b); }
+        static I srl(I a, int n) { return _mm256_srli_epi32(a, n); }
+        static I sll(I a, int n) { return _mm256_slli_epi32(a, n); }
+        static F flipSign(F v, I signBits) { return _mm256_castsi256_ps(_mm256_xor_si256(_mm256_castps_si256(v), signBits)); }
+    };
+#elif defined(TERRAIN_USE_SSE2)
+    struct Lanes {
+        using F = __m128;
+        using I = __m128i;
+        static F set(float v) { return _mm_set1_ps(v); }
+        static I seti(uint32_t v) { return _mm_set1_epi32(static_cast<int>(v)); }
+        static F load(const float* p) { return _mm_loadu_ps(p); }
+        static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+        static F add(F a, F b) { return _mm_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+        // SSE2 has no floor: truncate, then step down where truncation rounded up.
+        static I floorToInt(F v) {
+            I truncated = _mm_cvttps_epi32(v);
+            I roundedUp = _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), v));
+            return _mm_add_epi32(truncated, roundedUp);
+        }
+        static F toFloat(I v) { return _mm_cvtepi32_ps(v); }
+        static I addi(I a, I b) { return _mm_add_epi32(a, b); }
+        // SSE2 has no 32-bit mullo; multiply even and odd lanes separately.
+        static I mullo(I a, I b) {
+            I even = _mm_mul_epu32(a, b);
+            I odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+            return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                      _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+        static I xori(I a, I b) { return _mm_xor_si128(a, b); }
+        static I andi(I a, I b) { return _mm_and_si128(a, b); }
+        static I srl(I a, int n) { return _mm_srli_epi32(a, n); }
+        static I sll(I a, int n) { return _mm_slli_epi32(a, n); }
+        static F flipSign(F v, I signBits) { return _mm_castsi128_ps(_mm_xor_si128(_mm_castps_si128(v), signBits)); }
+    };
+#else
+    struct Lanes {
+        using F = float;
+        using I = uint32_t;
+        static F set(float v) { return v; }
+        static I seti(uint32_t v) { return v; }
+        static F load(const float* p) { return *p; }
+        static void store(float* p, F v) { *p = v; }
+        static F add(F a, F b) { return a + b; }
+        static F sub(F a, F b) { return a - b; }
+        static F mul(F a, F b) { return a * b; }
+        static I floorToInt(F v) { return static_cast<I>(static_cast<int32_t>(std::floor(v))); }
+        static F toFloat(I v) { return static_cast<float>(static_cast<int32_t>(v)); }
+        static I addi(I a, I b) { return a + b; }
+        static I mullo(I a, I b) { return a * b; }
+        static I xori(I a, I b) { return a ^ b; }
+        static I andi(I a, I b) { return a & b; }
+        static I srl(I a, int n) { return a >> n; }
+        static I sll(I a, int n) { return a << n; }
+        static F flipSign(F v, I signBits) {
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            bits ^= signBits;
+            std::memcpy(&v, &bits, sizeof(bits));
+            return v;
+        }
+    };
+#endif
+
+    using F = Lanes::F;
+    using I = Lanes::I;
+
+    I hashLattice(I ix, I iz) {
+        I h = Lanes::xori(Lanes::mullo(ix, Lanes::seti(HASH_X)), Lanes::mullo(iz, Lanes::seti(HASH_Z)));
+        h = Lanes::xori(h, Lanes::srl(h, 15));
+        h = Lanes::mullo(h, Lanes::seti(HASH_MIX));
+        return Lanes::xori(h, Lanes::srl(h, 12));
+    }
+
+    // Dot product with one of the four diagonal gradients picked by two hash bits.
+    F gradient(I hash, F dx, F dz) {
+        I signX = Lanes::sll(Lanes::andi(hash, Lanes::seti(1u << 8)), 23);
+        I signZ = Lanes::sll(Lanes::andi(hash, Lanes::seti(1u << 9)), 22);
+        return Lanes::add(Lanes::flipSign(dx, signX), Lanes::flipSign(dz, signZ));
+    }
+
+    F fade(F t) {
+        F inner = Lanes::add(Lanes::mul(t, Lanes::sub(Lanes::mul(t, Lanes::set(6.0f)), Lanes::set(15.0f))),
+                             Lanes::set(10.0f));
+        return Lanes::mul(Lanes::mul(Lanes::mul(t, t), t), inner);
+    }
+
+    F lerp(F a, F b, F t) {
+        return Lanes::add(a, Lanes::mul(Lanes::sub(b, a), t));
+    }
+
+    F gradientNoise(F x, F z) {
+        I ix = Lanes::floorToInt(x);
+        I iz = Lanes::floorToInt(z);
+        F fx = Lanes::sub(x, Lanes::toFloat(ix));
+        F fz = Lanes::sub(z, Lanes::toFloat(iz));
+        F fx1 = Lanes::sub(fx, Lanes::set(1.0f));
+        F fz1 = Lanes::sub(fz, Lanes::set(1.0f));
+        I ix1 = Lanes::addi(ix, Lanes::seti(1));
+        I iz1 = Lanes::addi(iz, Lanes::seti(1));
+
+        F n00 = gradient(hashLattice(ix, iz), fx, fz);
+        F n10 = gradient(hashLattice(ix1, iz), fx1, fz);
+        F n01 = gradient(hashLattice(ix, iz1), fx, fz1);
+        F n11 = gradient(hashLattice(ix1, iz1), fx1, fz1);
+
+        F u = fade(fx);
+        F v = fade(fz);
+        return lerp(lerp(n00, n10, u), lerp(n01, n11, u), v);
+    }
+
+    F fractalNoise(F x, F z) {
+        F sum = Lanes::set(0.0f);
+        float amplitude = 1.0f;
+        float frequency = BASE_FREQUENCY;
+        for (int octave = 0; octave < OCTAVES; octave++) {
+            F shift = Lanes::set(octave * OCTAVE_SHIFT);
+            F sx = Lanes::add(Lanes::mul(x, Lanes::set(frequency)), shift);
+            F sz = Lanes::add(Lanes::mul(z, Lanes::set(frequency)), shift);
+            sum = Lanes::add(sum, Lanes::mul(gradientNoise(sx, sz), Lanes::set(amplitude)));
+            amplitude *= 0.5f;
+            frequency *= 2.0f;
+        }
+        return Lanes::mul(sum, Lanes::set(TERRAIN_AMPLITUDE * 0.5f));
+    }
+
+    void fillHeightGrid(int chunkX, int chunkZ, float* heights) {
+        // Sample k sits at local (k - 1) * CELL_SIZE - SIZE/2; k = 0 and k = CELLS + 2 are the border.
+        const float originX = chunkX * static_cast<float>(CHUNK_SIZE) - CHUNK_SIZE * 0.5f - CELL_SIZE;
+        const float originZ = chunkZ * static_cast<float>(CHUNK_SIZE) - CHUNK_SIZE * 0.5f - CELL_SIZE;
+
+        alignas(32) float xs[ROW_PADDED];
+        alignas(32) float row[ROW_PADDED];
+        for (int k = 0; k < ROW_PADDED; k++) {
+            xs[k] = originX + k * CELL_SIZE;
+        }
+
+        for (int j = 0; j < TERRAIN_SAMPLES; j++) {
+            F z = Lanes::set(originZ + j * CELL_SIZE);
+            for (int k = 0; k < ROW_PADDED; k += SIMD_WIDTH) {
+                Lanes::store(row + k, fractalNoise(Lanes::load(xs + k), z));
+            }
+            std::memcpy(heights + j * TERRAIN_SAMPLES, row, TERRAIN_SAMPLES * sizeof(float));
+        }
+    }
+}
+
+// The AVX2 build of fillHeightGrid, from terrain_avx2.cpp.
+void generateHeightGridAvx2(int chunkX, int chunkZ, float* heights);
+
+#endif
@@ -3,14 +3,19 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "utils/world_manager.h"
-#include "render/shader.h"
+#include "render/shader_library.h"
+#include "render/gl_state_cache.h"
+#include "render/geometry_pool.h"
+#include "render/vertex_format.h"
 #include "utils/texture_manager.h"
+#include "utils/frame_budget_controller.h"
 #include <iostream>
 #include <iomanip>
 #include <vector>
 #include <random>
 #include <glfw-3.1.2/deps/GL/glext.h>
 #include <algorithm>
+#include <cstring>
 
 static GLFWwindow *window;
 static int windowWidth = 1920;
@@ -174,52 +179,53 @@ struct Skybox {
 		this->position = position;
 		this->scale = scale;
 
-		glGenVertexArrays(1, &vertexArrayID);
-		glBindVertexArray(vertexArrayID);
+		GLStateCache& glState = GLStateCache::getInstance();
+		vertexArrayID = glState.genVertexArray();
+		glState.bindVertexArray(vertexArrayID);
 
-		glGenBuffers(1, &vertexBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+		vertexBufferID = glState.genBuffer();
+		glState.bindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
 		for (int i = 0; i < 72; ++i) color_buffer_data[i] = 1.0f;
-		glGenBuffers(1, &colorBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
+		colorBufferID = glState.genBuffer();
+		glState.bindBuffer(GL_ARRAY_BUFFER, colorBufferID);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-		glGenBuffers(1, &uvBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
+		uvBufferID = glState.genBuffer();
+		glState.bindBuffer(GL_ARRAY_BUFFER, uvBufferID);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
-		glGenBuffers(1, &indexBufferID);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+		indexBufferID = glState.genBuffer();
+		glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+		glState.bindVertexArray(0);
 
-		programID = LoadShadersFromFile("../scene/shaders/skybox.vert", "../scene/shaders/skybox.frag");
+		ShaderLibrary& shaders = ShaderLibrary::getInstance();
+		programID = shaders.acquire("../scene/shaders/skybox.vert", "../scene/shaders/skybox.frag");
 		if (programID == 0)
 		{
 			std::cerr << "Failed to load shaders." << std::endl;
 		}
 
-		mvpMatrixID = glGetUniformLocation(programID, "MVP");
+		mvpMatrixID = shaders.getUniformLocation(programID, "MVP");
 
 		TextureManager& tm = TextureManager::getInstance();
 		textureID = tm.getTexture("../scene/textures/sky.png");
 
-		textureSamplerID = glGetUniformLocation(programID,"textureSampler");
+		textureSamplerID = shaders.getUniformLocation(programID, "textureSampler");
 	}
 
 	void render(glm::mat4 cameraMatrix) {
-		glUseProgram(programID);
-
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+		GLStateCache& glState = GLStateCache::getInstance();
+		glState.useProgram(programID);
+		glState.bindVertexArray(vertexArrayID);
 
         glm::mat4 modelMatrix = glm::mat4();
 		modelMatrix = glm::translate(modelMatrix, position);
@@ -228,11 +234,7 @@ struct Skybox {
 		glm::mat4 mvp = cameraMatrix * modelMatrix;
 		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
 
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureID);
+		glState.bindTextureUnit(0, GL_TEXTURE_2D, textureID);
 		glUniform1i(textureSamplerID, 0);
 
 		glDrawElements(
@@ -241,19 +243,17 @@ struct Skybox {
 			GL_UNSIGNED_INT,
 			(void*)0
 		);
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
 	}
 
 	void cleanup() {
-		glDeleteBuffers(1, &vertexBufferID);
-		glDeleteBuffers(1, &colorBufferID);
-		glDeleteBuffers(1, &indexBufferID);
-		glDeleteVertexArrays(1, &vertexArrayID);
-		glDeleteBuffers(1, &uvBufferID);
-		glDeleteTextures(1, &textureID);
-		glDeleteProgram(programID);
+		GLStateCache& glState = GLStateCache::getInstance();
+		glState.deleteBuffer(vertexBufferID);
+		glState.deleteBuffer(colorBufferID);
+		glState.deleteBuffer(indexBufferID);
+		glState.deleteVertexArray(vertexArrayID);
+		glState.deleteBuffer(uvBufferID);
+		glState.deleteTexture(textureID);
+		ShaderLibrary::getInstance().release(programID);
 	}
 };
 
@@ -292,26 +292,28 @@ public:
             p.size = distSize(rng);
         }
 
-    	programID = LoadShadersFromFile("../scene/shaders/particle.vert", "../scene/shaders/particle.frag");
+    	ShaderLibrary& shaders = ShaderLibrary::getInstance();
+    	programID = shaders.acquire("../scene/shaders/particle.vert", "../scene/shaders/particle.frag");
     	if (programID == 0)
     	{
     		std::cerr << "Failed to load shaders." << std::endl;
     	}
 
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
+        mvpMatrixID = shaders.getUniformLocation(programID, "MVP");
 
-        glGenVertexArrays(1, &vertexArrayID);
-        glBindVertexArray(vertexArrayID);
+        GLStateCache& glState = GLStateCache::getInstance();
+        vertexArrayID = glState.genVertexArray();
+        glState.bindVertexArray(vertexArrayID);
 
-        glGenBuffers(1, &vertexBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+        vertexBufferID = glState.genBuffer();
+        glState.bindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
         glBufferData(GL_ARRAY_BUFFER, worldPositions.size() * sizeof(glm::vec3),
                      nullptr, GL_DYNAMIC_DRAW);
 
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-        glBindVertexArray(0);
+        glState.bindVertexArray(0);
     }
 
     void update(float deltaTime, const glm::vec3& cameraPos) {
@@ -336,36 +338,57 @@ public:
             }
         }
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+        GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
         glBufferSubData(GL_ARRAY_BUFFER, 0,
                        worldPositions.size() * sizeof(glm::vec3),
                        worldPositions.data());
     }
 
     void render(const glm::mat4& vp) {
-        glUseProgram(programID);
-        glBindVertexArray(vertexArrayID);
+        GLStateCache& glState = GLStateCache::getInstance();
+        glState.useProgram(programID);
+        glState.bindVertexArray(vertexArrayID);
 
-        glEnable(GL_BLEND);
+        glState.enable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &vp[0][0]);
 
         glDrawArrays(GL_POINTS, 0, particles.size());
 
-        glDisable(GL_BLEND);
-        glBindVertexArray(0);
+        glState.disable(GL_BLEND);
     }
 
     void cleanup() {
-        if (vertexBufferID) glDeleteBuffers(1, &vertexBufferID);
-        if (vertexArrayID) glDeleteVertexArrays(1, &vertexArrayID);
-        if (programID) glDeleteProgram(programID);
+        GLStateCache& glState = GLStateCache::getInstance();
+        glState.deleteBuffer(vertexBufferID);
+        glState.deleteVertexArray(vertexArrayID);
+        ShaderLibrary::getInstance().release(programID);
     }
 };
 
-int main(void)
+int main(int argc, char** argv)
 {
+    // --bake-impostors renders the impostor atlases offscreen and exits
+    // --no-indirect-draws keeps the GL 3.3 draw loop on GL 4.3 contexts
+    // --no-gpu-culling culls every prop on the CPU
+    // --verify-gpu-culling checks each GPU cull against the CPU reference
+    bool bakeImpostors = false;
+    bool indirectDraws = true;
+    bool gpuCulling = true;
+    bool verifyGpuCulling = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--bake-impostors") == 0) {
+            bakeImpostors = true;
+        } else if (std::strcmp(argv[i], "--no-indirect-draws") == 0) {
+            indirectDraws = false;
+        } else if (std::strcmp(argv[i], "--no-gpu-culling") == 0) {
+            gpuCulling = false;
+        } else if (std::strcmp(argv[i], "--verify-gpu-culling") == 0) {
+            verifyGpuCulling = true;
+        }
+    }
+
     // Initialise GLFW
     if (!glfwInit())
     {
@@ -377,6 +400,7 @@ int main(void)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, bakeImpostors ? GL_FALSE : GL_TRUE);
 
     window = glfwCreateWindow(windowWidth, windowHeight, "Wonderland Project", NULL, NULL);
     if (window == NULL)
@@ -397,10 +421,13 @@ int main(void)
         return -1;
     }
 
+    ShaderLibrary::getInstance().initialize(glfwGetProcAddress, "shader_cache");
+
     // Setup
-    glClearColor(0.2f, 0.25f, 0.5f, 1.0f);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.clearColor(0.2f, 0.25f, 0.5f, 1.0f);
+    glState.enable(GL_DEPTH_TEST);
+    glState.enable(GL_CULL_FACE);
 
 	// FPS tracking
 	double lastTime = glfwGetTime();
@@ -411,17 +438,58 @@ int main(void)
     glm::mat4 projectionMatrix = glm::perspective(glm::radians(FoV), (float)windowWidth / windowHeight, zNear, zFar);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	double startupStart = glfwGetTime();
+	ShaderLibrary::getInstance().precompile({
+		{ "../scene/shaders/static.vert", "../scene/shaders/static.frag" },
+		{ "../scene/shaders/static_instanced.vert", "../scene/shaders/static.frag" },
+		{ "../scene/shaders/animated.vert", "../scene/shaders/animated.frag" },
+		{ "../scene/shaders/ground.vert", "../scene/shaders/ground.frag" },
+		{ "../scene/shaders/impostor.vert", "../scene/shaders/impostor.frag" },
+		{ "../scene/shaders/skybox.vert", "../scene/shaders/skybox.frag" },
+		{ "../scene/shaders/particle.vert", "../scene/shaders/particle.frag" },
+	});
 	WorldManager worldManager;
+	worldManager.setFieldOfView(glm::radians(FoV));
+	worldManager.initializeImpostors(lightPosition, lightIntensity, bakeImpostors);
+	if (bakeImpostors) {
+		glfwTerminate();
+		return 0;
+	}
+	bool indirectSupported = worldManager.initializeIndirectDraws(glfwGetProcAddress);
+	worldManager.setIndirectDraws(indirectDraws);
+	gpuCulling = gpuCulling && worldManager.initializeGpuCulling(glfwGetProcAddress);
+	worldManager.setGpuCullingVerification(verifyGpuCulling);
+	std::cout << "[render] " << glGetString(GL_RENDERER) << ", GL " << glGetString(GL_VERSION) << ", "
+			  << (worldManager.usesIndirectDraws() ? "multi-draw indirect"
+				  : indirectSupported ? "draw loop (indirect draws disabled)" : "draw loop (no GL 4.3)")
+			  << ", " << (gpuCulling ? "GPU" : "CPU") << " prop culling" << std::endl;
+
+	FrameBudgetController budgetController;
+	budgetController.initialize(WorldManager::DEFAULT_CHUNK_RADIUS, WorldManager::MIN_CHUNK_RADIUS,
+								WorldManager::MAX_CHUNK_RADIUS);
+	budgetController.setDecisionCallback([](const FrameBudgetController::Decision& decision) {
+		std::cout << std::fixed << std::setprecision(2) << "[budget] t=" << decision.time
+				  << "s radius " << decision.previousRadius << " -> " << decision.radius
+				  << " (" << decision.reason << ", cpu " << decision.cpuMs << " ms, gpu " << decision.gpuMs
+				  << " ms, detail " << decision.detailScale << ")" << std::endl;
+	});
 
 	SimpleSnowSystem snowSystem;
 	snowSystem.initialize(5000);
 
 	Skybox skybox;
 	skybox.initialize(glm::vec3(0, 2000, 0), glm::vec3(7500, 7500, 7500));
+	const ShaderLibrary::Stats& shaderStats = ShaderLibrary::getInstance().getStats();
+	std::cout << std::fixed << std::setprecision(1) << "[startup] " << (glfwGetTime() - startupStart) * 1000.0
+			  << " ms, " << (shaderStats.programsCompiled == 0 && shaderStats.binariesLoaded > 0 ? "warm" : "cold")
+			  << " shader cache" << std::endl;
+	ShaderLibrary::getInstance().printReport();
+	GeometryPool::forLayout<StaticVertexLayout>().printReport("static meshes");
 
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
+        budgetController.beginFrame();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Camera/view matrix
@@ -439,13 +507,35 @@ int main(void)
     		double fps = frameCount / (currentTime - lastTime);
 
     		// Create window title with FPS
+    		const StreamingStats& streamingStats = worldManager.getStreamingStats();
     		std::stringstream ss;
-    		ss << "Wonderland Project | FPS: " << std::fixed << std::setprecision(1) << fps;
+    		ss << "Wonderland Project | FPS: " << std::fixed << std::setprecision(1) << fps
+    		   << " | Chunk churn/s: " << worldManager.getChunkChurnPerSecond()
+    		   << " | Chunk allocs: " << worldManager.getChunkPoolStats().allocations
+    		   << " | Streaming heap allocs/s: "
+    		   << (streamingStats.heapCounted ? std::to_string(streamingStats.recentHeapAllocations) : "unavailable")
+    		   << " GL objects/s: " << streamingStats.recentGlObjectCalls
+    		   << " | Visible chunks: " << worldManager.getCullingStats().chunksVisible
+    		   << " | Visible props: " << worldManager.getCullingStats().instancesVisible
+    		   << " GPU-culled: " << worldManager.getCullingStats().instancesGpuCulled
+    		   << " | Impostors: " << worldManager.getImpostorCount()
+    		   << " | Draws: " << worldManager.getRenderStats().draws
+    		   << " batches: " << worldManager.getRenderStats().batches
+    		   << " programs: " << worldManager.getRenderStats().programSwitches
+    		   << " textures: " << worldManager.getRenderStats().textureBinds
+    		   << " | GL calls avoided: " << glState.getStats().avoided
+    		   << "/" << glState.getStats().avoided + glState.getStats().issued
+    		   << " | Prefetch hit: " << std::setprecision(0) << worldManager.getPrefetchStats().getHitRate() * 100.0f << "%"
+    		   << " wasted: " << worldManager.getPrefetchStats().wasted
+    		   << " | Radius: " << worldManager.getChunkRadius()
+    		   << " | CPU/GPU ms: " << std::setprecision(1) << budgetController.getCpuMs()
+    		   << "/" << budgetController.getGpuMs();
     		glfwSetWindowTitle(window, ss.str().c_str());
 
     		// Reset counters
     		frameCount = 0;
     		lastTime = currentTime;
+    		glState.resetStats();
     	}
 
     	snowSystem.update(deltaTime, eye_center);
@@ -460,12 +550,22 @@ int main(void)
     	// UNCOMMENT THIS LINE
     	// snowSystem.render(vp);
 
+    	budgetController.endFrame(deltaTime);
+    	worldManager.setChunkRadius(budgetController.getRadius());
+    	worldManager.setPropDetailScale(budgetController.getDetailScale());
+
         // Swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+	if (gpuCulling && verifyGpuCulling) {
+		const GpuCuller::VerifyStats& verifyStats = worldManager.getGpuCullingVerifyStats();
+		std::cout << "[gpu cull] " << verifyStats.frames << " frames checked, " << verifyStats.mismatches
+				  << " differed from the CPU reference" << std::endl;
+	}
 	snowSystem.cleanup();
 	skybox.cleanup();
+	budgetController.cleanup();
     glfwTerminate();
     return 0;
 }
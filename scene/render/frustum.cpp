@@ -0,0 +1,136 @@
+#include "frustum.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FRUSTUM_USE_NEON 1
+#endif
+
+void AABB::expand(const AABB& other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+AABB AABB::transformed(const glm::mat4& matrix) const {
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+    glm::vec3 extents = getExtents();
+
+    glm::vec3 newExtents(0.0f);
+    for (int column = 0; column < 3; column++) {
+        newExtents += glm::abs(glm::vec3(matrix[column])) * extents[column];
+    }
+
+    return AABB(center - newExtents, center + newExtents);
+}
+
+Frustum::Frustum() {
+    for (int i = 0; i < 8; i++) {
+        planeX[i] = 0.0f;
+        planeY[i] = 0.0f;
+        planeZ[i] = 0.0f;
+        planeW[i] = 1.0f;
+    }
+}
+
+Frustum::Frustum(const glm::mat4& viewProjectionMatrix) : Frustum() {
+    update(viewProjectionMatrix);
+}
+
+void Frustum::update(const glm::mat4& viewProjectionMatrix) {
+    glm::mat4 m = glm::transpose(viewProjectionMatrix);
+    glm::vec4 planes[6] = {
+        m[3] + m[0],
+        m[3] - m[0],
+        m[3] + m[1],
+        m[3] - m[1],
+        m[3] + m[2],
+        m[3] - m[2],
+    };
+
+    for (int i = 0; i < 6; i++) {
+        glm::vec4 plane = planes[i] / glm::length(glm::vec3(planes[i]));
+        planeX[i] = plane.x;
+        planeY[i] = plane.y;
+        planeZ[i] = plane.z;
+        planeW[i] = plane.w;
+    }
+}
+
+bool Frustum::intersects(const AABB& box) const {
+#if defined(FRUSTUM_USE_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minX = _mm_set1_ps(box.min.x), maxX = _mm_set1_ps(box.max.x);
+    const __m128 minY = _mm_set1_ps(box.min.y), maxY = _mm_set1_ps(box.max.y);
+    const __m128 minZ = _mm_set1_ps(box.min.z), maxZ = _mm_set1_ps(box.max.z);
+
+    for (int i = 0; i < 8; i += 4) {
+        __m128 nx = _mm_load_ps(planeX + i);
+        __m128 ny = _mm_load_ps(planeY + i);
+        __m128 nz = _mm_load_ps(planeZ + i);
+        __m128 w = _mm_load_ps(planeW + i);
+
+        // Pick the box corner furthest along each plane normal.
+        __m128 maskX = _mm_cmpgt_ps(nx, zero);
+        __m128 maskY = _mm_cmpgt_ps(ny, zero);
+        __m128 maskZ = _mm_cmpgt_ps(nz, zero);
+        __m128 px = _mm_or_ps(_mm_and_ps(maskX, maxX), _mm_andnot_ps(maskX, minX));
+        __m128 py = _mm_or_ps(_mm_and_ps(maskY, maxY), _mm_andnot_ps(maskY, minY));
+        __m128 pz = _mm_or_ps(_mm_and_ps(maskZ, maxZ), _mm_andnot_ps(maskZ, minZ));
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)),
+                                     _mm_add_ps(_mm_mul_ps(nz, pz), w));
+        if (_mm_movemask_ps(_mm_cmplt_ps(distance, zero)) != 0) {
+            return false;
+        }
+    }
+    return true;
+#elif defined(FRUSTUM_USE_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t minX = vdupq_n_f32(box.min.x), maxX = vdupq_n_f32(box.max.x);
+    const float32x4_t minY = vdupq_n_f32(box.min.y), maxY = vdupq_n_f32(box.max.y);
+    const float32x4_t minZ = vdupq_n_f32(box.min.z), maxZ = vdupq_n_f32(box.max.z);
+
+    for (int i = 0; i < 8; i += 4) {
+        float32x4_t nx = vld1q_f32(planeX + i);
+        float32x4_t ny = vld1q_f32(planeY + i);
+        float32x4_t nz = vld1q_f32(planeZ + i);
+        float32x4_t w = vld1q_f32(planeW + i);
+
+        float32x4_t px = vbslq_f32(vcgtq_f32(nx, zero), maxX, minX);
+        float32x4_t py = vbslq_f32(vcgtq_f32(ny, zero), maxY, minY);
+        float32x4_t pz = vbslq_f32(vcgtq_f32(nz, zero), maxZ, minZ);
+
+        float32x4_t distance = vmlaq_f32(vmlaq_f32(vmlaq_f32(w, nx, px), ny, py), nz, pz);
+        if (vmaxvq_u32(vcltq_f32(distance, zero)) != 0) {
+            return false;
+        }
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; i++) {
+        float px = planeX[i] > 0.0f ? box.max.x : box.min.x;
+        float py = planeY[i] > 0.0f ? box.max.y : box.min.y;
+        float pz = planeZ[i] > 0.0f ? box.max.z : box.min.z;
+        if (planeX[i] * px + planeY[i] * py + planeZ[i] * pz + planeW[i] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+bool Frustum::contains(const AABB& box) const {
+    for (int i = 0; i < 6; i++) {
+        // The box corner least far along the plane normal.
+        float nx = planeX[i] > 0.0f ? box.min.x : box.max.x;
+        float ny = planeY[i] > 0.0f ? box.min.y : box.max.y;
+        float nz = planeZ[i] > 0.0f ? box.min.z : box.max.z;
+        if (planeX[i] * nx + planeY[i] * ny + planeZ[i] * nz + planeW[i] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB() : min(1e30f), max(-1e30f) {}
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+    void expand(const AABB& other);
+    AABB transformed(const glm::mat4& matrix) const;
+};
+
+struct CullingStats {
+    int chunksVisible = 0;
+    int chunksCulled = 0;
+    int instancesVisible = 0;
+    int instancesCulled = 0;
+    // Instances handed to the GPU cull; it decides which of them are visible.
+    int instancesGpuCulled = 0;
+};
+
+// View frustum extracted from a view-projection matrix. The six planes are
+// kept in structure-of-arrays form so four of them can be tested against a
+// box at once with SSE or NEON; other targets use the scalar path.
+class Frustum {
+public:
+    Frustum();
+    explicit Frustum(const glm::mat4& viewProjectionMatrix);
+
+    void update(const glm::mat4& viewProjectionMatrix);
+    bool intersects(const AABB& box) const;
+    // True when the whole box is inside, so everything in it can be accepted
+    // without testing; scalar, as it is meant for a few large boxes.
+    bool contains(const AABB& box) const;
+    // Normalized plane i (0-5) as (normal, distance); inside is >= 0.
+    glm::vec4 getPlane(int i) const { return glm::vec4(planeX[i], planeY[i], planeZ[i], planeW[i]); }
+
+private:
+    alignas(16) float planeX[8];
+    alignas(16) float planeY[8];
+    alignas(16) float planeZ[8];
+    alignas(16) float planeW[8];
+};
+
+#endif
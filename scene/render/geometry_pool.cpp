@@ -0,0 +1,132 @@
+#include "geometry_pool.h"
+#include "gl_state_cache.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+GeometryPool::GeometryPool(size_t vertexStride, void (*applyLayout)(size_t baseOffset))
+    : vertexStride(vertexStride), applyLayout(applyLayout) {
+}
+
+void GeometryPool::createBuffers() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    vertexArrayID = glState.genVertexArray();
+
+    vertexBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferID);
+    glBufferData(GL_COPY_WRITE_BUFFER, INITIAL_VERTICES * vertexStride, nullptr, GL_STATIC_DRAW);
+    vertexAllocator.grow(INITIAL_VERTICES);
+
+    indexBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, indexBufferID);
+    glBufferData(GL_COPY_WRITE_BUFFER, INITIAL_INDEX_BYTES, nullptr, GL_STATIC_DRAW);
+    indexAllocator.grow(INITIAL_INDEX_BYTES);
+
+    attachBuffers();
+}
+
+GLuint GeometryPool::resizeBuffer(GLuint buffer, size_t usedBytes, size_t newBytes) {
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint resized = glState.genBuffer();
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, resized);
+    glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+    glState.bindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+    return resized;
+}
+
+void GeometryPool::attachBuffers() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.bindVertexArray(vertexArrayID);
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+    applyLayout(0);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+}
+
+size_t GeometryPool::allocateOrGrow(FreeListAllocator& allocator, size_t size, size_t alignment, bool vertices) {
+    size_t offset = allocator.allocate(size, alignment);
+    if (offset != FreeListAllocator::INVALID_OFFSET) {
+        return offset;
+    }
+
+    size_t oldCapacity = allocator.getCapacity();
+    size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + size + alignment);
+    GLuint& buffer = vertices ? vertexBufferID : indexBufferID;
+    size_t unitBytes = vertices ? vertexStride : 1;
+    GLuint previous = buffer;
+    buffer = resizeBuffer(previous, oldCapacity * unitBytes, newCapacity * unitBytes);
+    attachBuffers();
+    GLStateCache::getInstance().deleteBuffer(previous);
+    allocator.grow(newCapacity);
+    grows++;
+
+    return allocator.allocate(size, alignment);
+}
+
+GeometryAllocation GeometryPool::allocate(const void* vertices, size_t vertexCount, const void* indices,
+                                          size_t indexBytes, size_t indexSize) {
+    GeometryAllocation allocation;
+    if (vertexCount == 0 || indexBytes == 0) {
+        return allocation;
+    }
+    if (vertexArrayID == 0) {
+        createBuffers();
+    }
+
+    // Uploads go through the copy-write target so the element binding of
+    // whatever VAO is bound stays untouched.
+    GLStateCache& glState = GLStateCache::getInstance();
+    allocation.baseVertex = allocateOrGrow(vertexAllocator, vertexCount, 1, true);
+    allocation.vertexCount = vertexCount;
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferID);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.baseVertex * vertexStride, vertexCount * vertexStride, vertices);
+
+    allocation.indexOffset = allocateOrGrow(indexAllocator, indexBytes, indexSize, false);
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, indexBufferID);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexBytes, indices);
+    return allocation;
+}
+
+void GeometryPool::free(GeometryAllocation& allocation) {
+    if (!allocation.isValid()) {
+        return;
+    }
+    vertexAllocator.free(allocation.baseVertex);
+    indexAllocator.free(allocation.indexOffset);
+    allocation = GeometryAllocation();
+}
+
+GLuint GeometryPool::getVertexArray() {
+    if (vertexArrayID == 0) {
+        createBuffers();
+    }
+    return vertexArrayID;
+}
+
+GeometryPool::Stats GeometryPool::getStats() const {
+    Stats stats;
+    stats.vertexCapacity = vertexAllocator.getCapacity();
+    stats.verticesUsed = vertexAllocator.getUsed();
+    stats.vertexFreeBlocks = vertexAllocator.getFreeBlockCount();
+    stats.vertexFragmentation = vertexAllocator.getFragmentation();
+    stats.indexCapacityBytes = indexAllocator.getCapacity();
+    stats.indexBytesUsed = indexAllocator.getUsed();
+    stats.indexFreeBlocks = indexAllocator.getFreeBlockCount();
+    stats.indexFragmentation = indexAllocator.getFragmentation();
+    stats.allocations = vertexAllocator.getAllocationCount();
+    stats.grows = grows;
+    return stats;
+}
+
+void GeometryPool::printReport(const char* name) const {
+    Stats stats = getStats();
+    auto percent = [](size_t part, size_t whole) { return whole > 0 ? 100.0 * part / whole : 0.0; };
+    std::cout << std::fixed << std::setprecision(1) << "[geometry] " << name << ": " << stats.allocations
+              << " meshes, vertices " << stats.verticesUsed << "/" << stats.vertexCapacity << " ("
+              << percent(stats.verticesUsed, stats.vertexCapacity) << "% used, " << stats.vertexFreeBlocks
+              << " free blocks, " << stats.vertexFragmentation * 100.0f << "% fragmented), indices "
+              << stats.indexBytesUsed / 1024 << "/" << stats.indexCapacityBytes / 1024 << " KB ("
+              << percent(stats.indexBytesUsed, stats.indexCapacityBytes) << "% used, " << stats.indexFreeBlocks
+              << " free blocks, " << stats.indexFragmentation * 100.0f << "% fragmented), " << stats.grows
+              << " grows" << std::endl;
+}
@@ -0,0 +1,86 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/gl.h>
+#include "../utils/free_list_allocator.h"
+#include <cstddef>
+
+// Where a mesh lives inside a GeometryPool. baseVertex is in vertices and
+// goes to glDrawElementsBaseVertex; indexOffset is in bytes, so the mesh's
+// own index offsets are added to it.
+struct GeometryAllocation {
+    size_t baseVertex = FreeListAllocator::INVALID_OFFSET;
+    size_t vertexCount = 0;
+    size_t indexOffset = FreeListAllocator::INVALID_OFFSET;
+
+    bool isValid() const { return baseVertex != FreeListAllocator::INVALID_OFFSET; }
+};
+
+// One large vertex buffer and one large index buffer per vertex format,
+// suballocated with free lists and drawn through a single shared VAO. Meshes
+// keep their indices relative to their first vertex and draw with a base
+// vertex, so switching meshes needs no buffer or VAO change. When a buffer
+// runs out it is replaced by one twice the size and the old contents are
+// copied on the GPU; allocations keep their offsets.
+class GeometryPool {
+public:
+    struct Stats {
+        size_t vertexCapacity = 0;
+        size_t verticesUsed = 0;
+        size_t vertexFreeBlocks = 0;
+        float vertexFragmentation = 0.0f;
+        size_t indexCapacityBytes = 0;
+        size_t indexBytesUsed = 0;
+        size_t indexFreeBlocks = 0;
+        float indexFragmentation = 0.0f;
+        size_t allocations = 0;
+        int grows = 0;
+    };
+
+    // The pool for a VertexLayout from vertex_format.h, created on first use.
+    template <typename Layout>
+    static GeometryPool& forLayout() {
+        static GeometryPool pool(Layout::stride, &Layout::apply);
+        return pool;
+    }
+
+    // indexSize is the size of one index (2 or 4); it is also the alignment
+    // of the index range. Returns an invalid allocation only for empty data.
+    GeometryAllocation allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexBytes,
+                                size_t indexSize);
+    void free(GeometryAllocation& allocation);
+
+    // Also holds the element buffer binding. Users may set up further
+    // attributes (e.g. per-instance ones) on it as long as they leave the
+    // layout's own locations alone.
+    GLuint getVertexArray();
+
+    Stats getStats() const;
+    void printReport(const char* name) const;
+
+private:
+    static constexpr size_t INITIAL_VERTICES = 1 << 16;
+    static constexpr size_t INITIAL_INDEX_BYTES = 1 << 20;
+
+    size_t vertexStride;
+    void (*applyLayout)(size_t baseOffset);
+
+    GLuint vertexArrayID = 0;
+    GLuint vertexBufferID = 0;
+    GLuint indexBufferID = 0;
+    FreeListAllocator vertexAllocator;
+    FreeListAllocator indexAllocator;
+    int grows = 0;
+
+    GeometryPool(size_t vertexStride, void (*applyLayout)(size_t baseOffset));
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    void createBuffers();
+    // Returns the new buffer with the first usedBytes of buffer copied in.
+    GLuint resizeBuffer(GLuint buffer, size_t usedBytes, size_t newBytes);
+    void attachBuffers();
+    size_t allocateOrGrow(FreeListAllocator& allocator, size_t size, size_t alignment, bool vertices);
+};
+
+#endif
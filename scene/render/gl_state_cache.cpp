@@ -0,0 +1,319 @@
+#include "gl_state_cache.h"
+#include <algorithm>
+
+GLStateCache& GLStateCache::getInstance() {
+    static GLStateCache instance;
+    return instance;
+}
+
+GLStateCache::GLStateCache() {
+    invalidate();
+}
+
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    arrayBuffer = UNKNOWN;
+    elementBuffer = UNKNOWN;
+    uniformBuffer = UNKNOWN;
+    framebuffer = UNKNOWN;
+    textureUnit = UNKNOWN;
+    std::fill(textures2D, textures2D + MAX_TEXTURE_UNITS, UNKNOWN);
+    std::fill(texturesCube, texturesCube + MAX_TEXTURE_UNITS, UNKNOWN);
+    std::fill(uniformBindings, uniformBindings + MAX_UNIFORM_BINDINGS, UniformBinding{ UNKNOWN, 0, 0 });
+    std::fill(capabilities, capabilities + CAP_COUNT, -1);
+    viewportKnown = false;
+    clearColorKnown = false;
+}
+
+bool GLStateCache::update(GLuint& shadow, GLuint value) {
+    if (shadow == value) {
+        stats.avoided++;
+        return false;
+    }
+    shadow = value;
+    stats.issued++;
+    return true;
+}
+
+void GLStateCache::useProgram(GLuint newProgram) {
+    if (update(program, newProgram)) {
+        glUseProgram(newProgram);
+    }
+}
+
+void GLStateCache::bindVertexArray(GLuint newVertexArray) {
+    if (update(vertexArray, newVertexArray)) {
+        glBindVertexArray(newVertexArray);
+        elementBuffer = UNKNOWN;
+    }
+}
+
+GLuint* GLStateCache::bufferSlot(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER: return &arrayBuffer;
+        case GL_ELEMENT_ARRAY_BUFFER: return &elementBuffer;
+        case GL_UNIFORM_BUFFER: return &uniformBuffer;
+        default: return nullptr;
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    GLuint* slot = bufferSlot(target);
+    if (!slot) {
+        stats.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (update(*slot, buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+// A size of 0 stands for the whole buffer, as bound by glBindBufferBase.
+void GLStateCache::bindUniformBufferBase(GLuint index, GLuint buffer) {
+    if (index < static_cast<GLuint>(MAX_UNIFORM_BINDINGS)) {
+        UniformBinding& binding = uniformBindings[index];
+        if (binding.buffer == buffer && binding.size == 0) {
+            stats.avoided++;
+            return;
+        }
+        binding = { buffer, 0, 0 };
+    }
+    stats.issued++;
+    glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+    uniformBuffer = buffer;
+}
+
+void GLStateCache::bindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (index < static_cast<GLuint>(MAX_UNIFORM_BINDINGS)) {
+        UniformBinding& binding = uniformBindings[index];
+        if (binding.buffer == buffer && binding.offset == offset && binding.size == size) {
+            stats.avoided++;
+            return;
+        }
+        binding = { buffer, offset, size };
+    }
+    stats.issued++;
+    glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+    uniformBuffer = buffer;
+}
+
+void GLStateCache::activeTexture(GLenum unit) {
+    if (update(textureUnit, unit - GL_TEXTURE0)) {
+        glActiveTexture(unit);
+    }
+}
+
+GLuint* GLStateCache::textureSlot(GLenum target) {
+    if (textureUnit >= static_cast<GLuint>(MAX_TEXTURE_UNITS)) {
+        return nullptr;
+    }
+    switch (target) {
+        case GL_TEXTURE_2D: return &textures2D[textureUnit];
+        case GL_TEXTURE_CUBE_MAP: return &texturesCube[textureUnit];
+        default: return nullptr;
+    }
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+    GLuint* slot = textureSlot(target);
+    if (!slot) {
+        stats.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (update(*slot, texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLStateCache::bindTextureUnit(GLuint unit, GLenum target, GLuint texture) {
+    activeTexture(GL_TEXTURE0 + unit);
+    bindTexture(target, texture);
+}
+
+void GLStateCache::bindFramebuffer(GLuint newFramebuffer) {
+    if (update(framebuffer, newFramebuffer)) {
+        glBindFramebuffer(GL_FRAMEBUFFER, newFramebuffer);
+    }
+}
+
+int GLStateCache::capabilityIndex(GLenum capability) {
+    switch (capability) {
+        case GL_DEPTH_TEST: return CAP_DEPTH_TEST;
+        case GL_CULL_FACE: return CAP_CULL_FACE;
+        case GL_BLEND: return CAP_BLEND;
+        default: return -1;
+    }
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled) {
+    int index = capabilityIndex(capability);
+    if (index >= 0 && capabilities[index] == static_cast<int>(enabled)) {
+        stats.avoided++;
+        return;
+    }
+    if (index >= 0) {
+        capabilities[index] = enabled ? 1 : 0;
+    }
+    stats.issued++;
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (viewportKnown && viewportBox[0] == x && viewportBox[1] == y &&
+        viewportBox[2] == width && viewportBox[3] == height) {
+        stats.avoided++;
+        return;
+    }
+    viewportBox[0] = x;
+    viewportBox[1] = y;
+    viewportBox[2] = width;
+    viewportBox[3] = height;
+    viewportKnown = true;
+    stats.issued++;
+    glViewport(x, y, width, height);
+}
+
+void GLStateCache::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    if (clearColorKnown && clearRGBA[0] == r && clearRGBA[1] == g && clearRGBA[2] == b && clearRGBA[3] == a) {
+        stats.avoided++;
+        return;
+    }
+    clearRGBA[0] = r;
+    clearRGBA[1] = g;
+    clearRGBA[2] = b;
+    clearRGBA[3] = a;
+    clearColorKnown = true;
+    stats.issued++;
+    glClearColor(r, g, b, a);
+}
+
+GLuint GLStateCache::getFramebuffer() {
+    if (framebuffer == UNKNOWN) {
+        GLint current;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &current);
+        framebuffer = static_cast<GLuint>(current);
+    }
+    return framebuffer;
+}
+
+void GLStateCache::getViewport(GLint out[4]) {
+    if (!viewportKnown) {
+        glGetIntegerv(GL_VIEWPORT, viewportBox);
+        viewportKnown = true;
+    }
+    std::copy(viewportBox, viewportBox + 4, out);
+}
+
+void GLStateCache::getClearColor(GLfloat out[4]) {
+    if (!clearColorKnown) {
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearRGBA);
+        clearColorKnown = true;
+    }
+    std::copy(clearRGBA, clearRGBA + 4, out);
+}
+
+GLuint GLStateCache::genBuffer() {
+    GLuint generated;
+    glGenBuffers(1, &generated);
+    stats.objectsCreated++;
+    return generated;
+}
+
+GLuint GLStateCache::genVertexArray() {
+    GLuint generated;
+    glGenVertexArrays(1, &generated);
+    stats.objectsCreated++;
+    return generated;
+}
+
+GLuint GLStateCache::genTexture() {
+    GLuint generated;
+    glGenTextures(1, &generated);
+    stats.objectsCreated++;
+    return generated;
+}
+
+GLuint GLStateCache::genFramebuffer() {
+    GLuint generated;
+    glGenFramebuffers(1, &generated);
+    stats.objectsCreated++;
+    return generated;
+}
+
+void GLStateCache::deleteProgram(GLuint deleted) {
+    if (deleted == 0) {
+        return;
+    }
+    // A program in use stays alive until it is replaced, so unbind it first.
+    if (program == deleted) {
+        useProgram(0);
+    }
+    glDeleteProgram(deleted);
+}
+
+void GLStateCache::deleteVertexArray(GLuint deleted) {
+    if (deleted == 0) {
+        return;
+    }
+    glDeleteVertexArrays(1, &deleted);
+    stats.objectsDeleted++;
+    if (vertexArray == deleted) {
+        vertexArray = 0;
+        elementBuffer = UNKNOWN;
+    }
+}
+
+void GLStateCache::deleteBuffer(GLuint deleted) {
+    if (deleted == 0) {
+        return;
+    }
+    glDeleteBuffers(1, &deleted);
+    stats.objectsDeleted++;
+    for (GLuint* slot : { &arrayBuffer, &elementBuffer, &uniformBuffer }) {
+        if (*slot == deleted) {
+            *slot = 0;
+        }
+    }
+    for (UniformBinding& binding : uniformBindings) {
+        // Whether indexed bindings are reset varies between GL versions, and
+        // drivers that reset one (Mesa) set the generic binding along with it.
+        if (binding.buffer == deleted) {
+            binding = { UNKNOWN, 0, 0 };
+            uniformBuffer = UNKNOWN;
+        }
+    }
+}
+
+void GLStateCache::deleteTexture(GLuint deleted) {
+    if (deleted == 0) {
+        return;
+    }
+    glDeleteTextures(1, &deleted);
+    stats.objectsDeleted++;
+    for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        if (textures2D[unit] == deleted) {
+            textures2D[unit] = 0;
+        }
+        if (texturesCube[unit] == deleted) {
+            texturesCube[unit] = 0;
+        }
+    }
+}
+
+void GLStateCache::deleteFramebuffer(GLuint deleted) {
+    if (deleted == 0) {
+        return;
+    }
+    glDeleteFramebuffers(1, &deleted);
+    stats.objectsDeleted++;
+    if (framebuffer == deleted) {
+        framebuffer = 0;
+    }
+}
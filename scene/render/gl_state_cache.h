@@ -0,0 +1,116 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/gl.h>
+#include <cstdint>
+
+// CPU-side shadow of the GL binding state. Every bind in the scene goes
+// through here, so a call that would not change anything is skipped and no
+// code needs to query the driver to save and restore state around its work.
+// Code that changes state behind the cache's back must call invalidate().
+class GLStateCache {
+public:
+    static constexpr int MAX_TEXTURE_UNITS = 8;
+    static constexpr int MAX_UNIFORM_BINDINGS = 4;
+
+    struct Stats {
+        uint64_t issued = 0;
+        uint64_t avoided = 0;
+        // Buffers, vertex arrays, textures and framebuffers made by the gen
+        // calls below and removed by the matching delete calls.
+        uint64_t objectsCreated = 0;
+        uint64_t objectsDeleted = 0;
+    };
+
+    static GLStateCache& getInstance();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // The element array binding belongs to the bound VAO, so it is forgotten
+    // whenever the VAO changes.
+    void bindBuffer(GLenum target, GLuint buffer);
+    // Indexed uniform buffer bindings; like GL, these also set the generic
+    // GL_UNIFORM_BUFFER binding, but only when the call is issued. Bind the
+    // generic target explicitly before writing through it.
+    void bindUniformBufferBase(GLuint index, GLuint buffer);
+    void bindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, GLuint texture);
+    void bindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+    void bindFramebuffer(GLuint framebuffer);
+    void setEnabled(GLenum capability, bool enabled);
+    void enable(GLenum capability) { setEnabled(capability, true); }
+    void disable(GLenum capability) { setEnabled(capability, false); }
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+    // These query the driver only while the value is still unknown.
+    GLuint getFramebuffer();
+    void getViewport(GLint out[4]);
+    void getClearColor(GLfloat out[4]);
+
+    // Object names are generated here too, so the stats show whether a code
+    // path creates or deletes GL objects.
+    GLuint genBuffer();
+    GLuint genVertexArray();
+    GLuint genTexture();
+    GLuint genFramebuffer();
+
+    // Deleting a bound object resets its binding in GL; these keep the
+    // shadow in step so a recycled name is not mistaken for a bound one.
+    void deleteProgram(GLuint program);
+    void deleteVertexArray(GLuint vertexArray);
+    void deleteBuffer(GLuint buffer);
+    void deleteTexture(GLuint texture);
+    void deleteFramebuffer(GLuint framebuffer);
+
+    // Marks everything unknown so the next call of each kind is issued.
+    void invalidate();
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    static constexpr GLuint UNKNOWN = ~0u;
+
+    struct UniformBinding {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    enum Capability {
+        CAP_DEPTH_TEST,
+        CAP_CULL_FACE,
+        CAP_BLEND,
+        CAP_COUNT
+    };
+
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    GLuint arrayBuffer = UNKNOWN;
+    GLuint elementBuffer = UNKNOWN;
+    GLuint uniformBuffer = UNKNOWN;
+    GLuint framebuffer = UNKNOWN;
+    GLuint textureUnit = UNKNOWN;
+    GLuint textures2D[MAX_TEXTURE_UNITS];
+    GLuint texturesCube[MAX_TEXTURE_UNITS];
+    UniformBinding uniformBindings[MAX_UNIFORM_BINDINGS];
+    int capabilities[CAP_COUNT];
+    GLint viewportBox[4];
+    GLfloat clearRGBA[4];
+    bool viewportKnown = false;
+    bool clearColorKnown = false;
+    Stats stats;
+
+    GLStateCache();
+
+    GLuint* bufferSlot(GLenum target);
+    GLuint* textureSlot(GLenum target);
+    static int capabilityIndex(GLenum capability);
+
+    // Returns true, and counts the call, when value differs from the shadow.
+    bool update(GLuint& shadow, GLuint value);
+};
+
+#endif
@@ -0,0 +1,416 @@
+#include "gpu_culler.h"
+#include "gl_state_cache.h"
+#include "../entities/static_model.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    // GL 4.3 enums the 3.3 loader does not define.
+    constexpr GLenum COMPUTE_SHADER = 0x91B9;
+    constexpr GLenum SHADER_STORAGE_BUFFER = 0x90D2;
+    constexpr GLbitfield VERTEX_ATTRIB_ARRAY_BARRIER_BIT = 0x00000001;
+    constexpr GLbitfield COMMAND_BARRIER_BIT = 0x00000040;
+    constexpr GLbitfield BUFFER_UPDATE_BARRIER_BIT = 0x00000200;
+
+    constexpr const char* CULL_SHADER_PATH = "../scene/shaders/instance_cull.comp";
+    constexpr GLuint WORKGROUP_SIZE = 64;
+
+    const GpuCuller::CullInstance UNUSED_INSTANCE = { glm::mat4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+
+    GLuint buildComputeProgram(const char* path) {
+        std::ifstream stream(path, std::ios::in);
+        if (!stream.is_open()) {
+            std::cerr << "Compute shader not found " << path << std::endl;
+            return 0;
+        }
+        std::stringstream source;
+        source << stream.rdbuf();
+        std::string code = source.str();
+        const char* codePointer = code.c_str();
+
+        GLuint shader = glCreateShader(COMPUTE_SHADER);
+        glShaderSource(shader, 1, &codePointer, nullptr);
+        glCompileShader(shader);
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (!status) {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            std::vector<char> log(std::max(length, 1));
+            glGetShaderInfoLog(shader, length, nullptr, log.data());
+            std::cerr << "Error compiling compute shader " << path << ": " << log.data() << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (!status) {
+            std::cerr << "Error linking compute shader " << path << std::endl;
+            GLStateCache::getInstance().deleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+}
+
+void GpuCuller::Result::clear() {
+    for (auto& kind : ids) {
+        for (auto& lod : kind) {
+            lod.clear();
+        }
+    }
+}
+
+void GpuCuller::Result::sort() {
+    for (auto& kind : ids) {
+        for (auto& lod : kind) {
+            std::sort(lod.begin(), lod.end());
+        }
+    }
+}
+
+bool GpuCuller::Result::operator==(const Result& other) const {
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        for (int lod = 0; lod < MAX_LODS; lod++) {
+            if (ids[kind][lod] != other.ids[kind][lod]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+size_t GpuCuller::Result::size() const {
+    size_t count = 0;
+    for (const auto& kind : ids) {
+        for (const auto& lod : kind) {
+            count += lod.size();
+        }
+    }
+    return count;
+}
+
+GLuint GpuCuller::getRegionBaseInstance(int kind, int lod) {
+    return static_cast<GLuint>((kind * MAX_LODS + lod) * REGION_CAPACITY);
+}
+
+GpuCuller::~GpuCuller() {
+    cleanup();
+}
+
+bool GpuCuller::initialize(GLADloadfunc load) {
+    cleanup();
+
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major < 4 || (major == 4 && minor < 3)) {
+        return false;
+    }
+    dispatchCompute = reinterpret_cast<DispatchComputeProc>(load("glDispatchCompute"));
+    memoryBarrier = reinterpret_cast<MemoryBarrierProc>(load("glMemoryBarrier"));
+    if (!dispatchCompute || !memoryBarrier) {
+        return false;
+    }
+
+    programID = buildComputeProgram(CULL_SHADER_PATH);
+    if (programID == 0) {
+        return false;
+    }
+    frustumPlanesID = glGetUniformLocation(programID, "frustumPlanes");
+    viewPositionID = glGetUniformLocation(programID, "viewPosition");
+    visibleSlotCountID = glGetUniformLocation(programID, "visibleSlotCount");
+    instancesPerSlotID = glGetUniformLocation(programID, "instancesPerSlot");
+    regionCapacityID = glGetUniformLocation(programID, "regionCapacity");
+    lodThresholdsID = glGetUniformLocation(programID, "lodThresholdsSq");
+    lodCountsID = glGetUniformLocation(programID, "lodCounts");
+    commandBaseID = glGetUniformLocation(programID, "commandBase");
+    primitiveCountsID = glGetUniformLocation(programID, "primitiveCounts");
+
+    // Unlike the height atlas there is no reserved slot 0; every slot
+    // starts free and unused.
+    instances.assign(SLOT_COUNT * INSTANCES_PER_SLOT, UNUSED_INSTANCE);
+    slotCounts.assign(SLOT_COUNT, 0);
+    freeSlots.clear();
+    for (int slot = SLOT_COUNT - 1; slot >= 0; slot--) {
+        freeSlots.push_back(slot);
+    }
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    instanceBufferID = glState.genBuffer();
+    visibleSlotBufferID = glState.genBuffer();
+    commandBufferID = glState.genBuffer();
+    outputMatrixBufferID = glState.genBuffer();
+    outputIdBufferID = glState.genBuffer();
+
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, instanceBufferID);
+    glBufferData(SHADER_STORAGE_BUFFER, instances.size() * sizeof(CullInstance), instances.data(), GL_DYNAMIC_DRAW);
+    size_t outputs = static_cast<size_t>(KIND_COUNT) * MAX_LODS * REGION_CAPACITY;
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, outputMatrixBufferID);
+    glBufferData(SHADER_STORAGE_BUFFER, outputs * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, outputIdBufferID);
+    glBufferData(SHADER_STORAGE_BUFFER, outputs * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+    return true;
+}
+
+void GpuCuller::cleanup() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.deleteBuffer(instanceBufferID);
+    glState.deleteBuffer(visibleSlotBufferID);
+    glState.deleteBuffer(commandBufferID);
+    glState.deleteBuffer(outputMatrixBufferID);
+    glState.deleteBuffer(outputIdBufferID);
+    instanceBufferID = 0;
+    visibleSlotBufferID = 0;
+    commandBufferID = 0;
+    outputMatrixBufferID = 0;
+    outputIdBufferID = 0;
+    visibleSlotCapacity = 0;
+    commandBufferCapacity = 0;
+    glState.deleteProgram(programID);
+    programID = 0;
+    instances.clear();
+    slotCounts.clear();
+    freeSlots.clear();
+    visibleSlots.clear();
+    candidateCount = 0;
+}
+
+GpuCuller::CullInstance GpuCuller::makeInstance(CullKind kind, const glm::mat4& modelMatrix, const AABB& bounds) {
+    CullInstance instance;
+    instance.modelMatrix = modelMatrix;
+    instance.boundsMin = glm::vec4(bounds.min, static_cast<float>(static_cast<uint32_t>(kind) + 1));
+    instance.boundsMax = glm::vec4(bounds.max, 0.0f);
+    return instance;
+}
+
+int GpuCuller::allocateSlot(const CullInstance* slotInstances, int count) {
+    if (!isAvailable() || freeSlots.empty() || count <= 0 || count > INSTANCES_PER_SLOT) {
+        return -1;
+    }
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    CullInstance* entries = instances.data() + slot * INSTANCES_PER_SLOT;
+    for (int i = 0; i < INSTANCES_PER_SLOT; i++) {
+        entries[i] = i < count ? slotInstances[i] : UNUSED_INSTANCE;
+    }
+    slotCounts[slot] = count;
+    GLStateCache::getInstance().bindBuffer(SHADER_STORAGE_BUFFER, instanceBufferID);
+    glBufferSubData(SHADER_STORAGE_BUFFER, slot * INSTANCES_PER_SLOT * sizeof(CullInstance),
+                    INSTANCES_PER_SLOT * sizeof(CullInstance), entries);
+    return slot;
+}
+
+// The GPU copy is left as is; a slot is only read while it is listed visible.
+void GpuCuller::releaseSlot(int slot) {
+    if (slot >= 0 && isAvailable()) {
+        freeSlots.push_back(slot);
+    }
+}
+
+void GpuCuller::beginFrame() {
+    visibleSlots.clear();
+    candidateCount = 0;
+}
+
+void GpuCuller::addVisibleSlot(int slot) {
+    visibleSlots.push_back(static_cast<GLuint>(slot));
+    candidateCount += slotCounts[slot];
+}
+
+void GpuCuller::buildFrame(const Frustum& frustum, const glm::vec3& viewPosition, float projectionScale,
+                           StaticModel* const models[KIND_COUNT], Frame& frame) {
+    for (int i = 0; i < 6; i++) {
+        frame.planes[i] = frustum.getPlane(i);
+    }
+    frame.viewPosition = viewPosition;
+    for (int lod = 0; lod < MAX_LODS - 1; lod++) {
+        float threshold = StaticModel::getLodCoverageThreshold(lod) / projectionScale;
+        frame.lodThresholdsSq[lod] = threshold * threshold;
+    }
+
+    // Rebuilt with zero instances every frame; the shader counts into them.
+    commands.clear();
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        GLuint lodBaseInstance[MAX_LODS];
+        for (int lod = 0; lod < MAX_LODS; lod++) {
+            lodBaseInstance[lod] = getRegionBaseInstance(kind, lod);
+        }
+        commandBase[kind] = static_cast<GLuint>(commands.size());
+        frame.lodCounts[kind] = models[kind]->getLodCount();
+        frame.primitiveCounts[kind] = models[kind]->appendIndirectCommands(commands, lodBaseInstance);
+    }
+}
+
+void GpuCuller::setCommands(const std::vector<DrawElementsIndirectCommand>& frameCommands,
+                            const GLuint base[KIND_COUNT]) {
+    commands = frameCommands;
+    std::copy(base, base + KIND_COUNT, commandBase);
+}
+
+void GpuCuller::cullAndSubmit(const Frame& frame, StaticModel* const models[KIND_COUNT], RenderQueue& queue) {
+    if (!dispatch(frame)) {
+        return;
+    }
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        if (frame.primitiveCounts[kind] > 0) {
+            models[kind]->submitGpuCulled(queue, commandBufferID, commandBase[kind] * sizeof(DrawElementsIndirectCommand),
+                                          outputMatrixBufferID);
+        }
+    }
+}
+
+bool GpuCuller::dispatch(const Frame& frame) {
+    if (!isAvailable() || visibleSlots.empty() || commands.empty()) {
+        return false;
+    }
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, commandBufferID);
+    if (commandBytes > commandBufferCapacity) {
+        commandBufferCapacity = commandBytes * 2;
+    }
+    glBufferData(SHADER_STORAGE_BUFFER, commandBufferCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(SHADER_STORAGE_BUFFER, 0, commandBytes, commands.data());
+
+    size_t slotBytes = visibleSlots.size() * sizeof(GLuint);
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, visibleSlotBufferID);
+    if (slotBytes > visibleSlotCapacity) {
+        visibleSlotCapacity = slotBytes * 2;
+    }
+    glBufferData(SHADER_STORAGE_BUFFER, visibleSlotCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(SHADER_STORAGE_BUFFER, 0, slotBytes, visibleSlots.data());
+
+    glBindBufferBase(SHADER_STORAGE_BUFFER, 0, instanceBufferID);
+    glBindBufferBase(SHADER_STORAGE_BUFFER, 1, visibleSlotBufferID);
+    glBindBufferBase(SHADER_STORAGE_BUFFER, 2, commandBufferID);
+    glBindBufferBase(SHADER_STORAGE_BUFFER, 3, outputMatrixBufferID);
+    glBindBufferBase(SHADER_STORAGE_BUFFER, 4, outputIdBufferID);
+
+    GLuint visibleSlotCount = static_cast<GLuint>(visibleSlots.size());
+    glState.useProgram(programID);
+    glUniform4fv(frustumPlanesID, 6, &frame.planes[0][0]);
+    glUniform3fv(viewPositionID, 1, &frame.viewPosition[0]);
+    glUniform1ui(visibleSlotCountID, visibleSlotCount);
+    glUniform1ui(instancesPerSlotID, INSTANCES_PER_SLOT);
+    glUniform1ui(regionCapacityID, REGION_CAPACITY);
+    glUniform1fv(lodThresholdsID, MAX_LODS - 1, frame.lodThresholdsSq);
+    glUniform1iv(lodCountsID, KIND_COUNT, frame.lodCounts);
+    glUniform1uiv(commandBaseID, KIND_COUNT, commandBase);
+    glUniform1uiv(primitiveCountsID, KIND_COUNT, frame.primitiveCounts);
+
+    GLuint invocations = visibleSlotCount * INSTANCES_PER_SLOT;
+    dispatchCompute((invocations + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    memoryBarrier(COMMAND_BARRIER_BIT | VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    return true;
+}
+
+void GpuCuller::cullReference(const Frame& frame, Result& out) const {
+    cullReference(frame, instances.data(), visibleSlots, out);
+}
+
+// Same arithmetic as instance_cull.comp, written out so the compiler has no
+// reordering to do. CMakeLists.txt builds this file with -ffp-contract=off so
+// no FMA is fused in either.
+void GpuCuller::cullReference(const Frame& frame, const CullInstance* instances,
+                              const std::vector<GLuint>& visibleSlots, Result& out) {
+    out.clear();
+    for (GLuint slot : visibleSlots) {
+        for (int entry = 0; entry < INSTANCES_PER_SLOT; entry++) {
+            uint32_t instanceId = slot * INSTANCES_PER_SLOT + entry;
+            const CullInstance& instance = instances[instanceId];
+            int kind = static_cast<int>(instance.boundsMin.w) - 1;
+            if (kind < 0 || frame.primitiveCounts[kind] == 0 || frame.lodCounts[kind] <= 0) {
+                continue;
+            }
+
+            bool inside = true;
+            for (int i = 0; i < 6 && inside; i++) {
+                const glm::vec4& plane = frame.planes[i];
+                float px = plane.x > 0.0f ? instance.boundsMax.x : instance.boundsMin.x;
+                float py = plane.y > 0.0f ? instance.boundsMax.y : instance.boundsMin.y;
+                float pz = plane.z > 0.0f ? instance.boundsMax.z : instance.boundsMin.z;
+                float xy = plane.x * px + plane.y * py;
+                float zw = plane.z * pz + plane.w;
+                inside = xy + zw >= 0.0f;
+            }
+            if (!inside) {
+                continue;
+            }
+
+            glm::vec3 center = (glm::vec3(instance.boundsMin) + glm::vec3(instance.boundsMax)) * 0.5f;
+            glm::vec3 extents = (glm::vec3(instance.boundsMax) - glm::vec3(instance.boundsMin)) * 0.5f;
+            glm::vec3 toCenter = center - frame.viewPosition;
+            float radiusSq = (extents.x * extents.x + extents.y * extents.y) + extents.z * extents.z;
+            float distanceSq = std::max((toCenter.x * toCenter.x + toCenter.y * toCenter.y) + toCenter.z * toCenter.z,
+                                        1.0f);
+            int lod = 0;
+            while (lod < frame.lodCounts[kind] - 1 && radiusSq < frame.lodThresholdsSq[lod] * distanceSq) {
+                lod++;
+            }
+            out.ids[kind][lod].push_back(instanceId);
+        }
+    }
+}
+
+bool GpuCuller::verify(const Frame& frame) {
+    if (!isAvailable() || visibleSlots.empty() || commands.empty()) {
+        return true;
+    }
+    memoryBarrier(BUFFER_UPDATE_BARRIER_BIT);
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    std::vector<DrawElementsIndirectCommand> counted(commands.size());
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, commandBufferID);
+    glGetBufferSubData(SHADER_STORAGE_BUFFER, 0, counted.size() * sizeof(DrawElementsIndirectCommand), counted.data());
+
+    // The first primitive's command of each LOD holds the region's count.
+    Result gpu;
+    glState.bindBuffer(SHADER_STORAGE_BUFFER, outputIdBufferID);
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        if (frame.primitiveCounts[kind] == 0) {
+            continue;
+        }
+        for (int lod = 0; lod < MAX_LODS; lod++) {
+            GLuint count = counted[commandBase[kind] + lod].instanceCount;
+            std::vector<uint32_t>& ids = gpu.ids[kind][lod];
+            ids.resize(count);
+            if (count > 0) {
+                glGetBufferSubData(SHADER_STORAGE_BUFFER, getRegionBaseInstance(kind, lod) * sizeof(uint32_t),
+                                   count * sizeof(uint32_t), ids.data());
+            }
+        }
+    }
+
+    Result reference;
+    cullReference(frame, reference);
+    gpu.sort();
+    reference.sort();
+
+    verifyStats.frames++;
+    if (gpu == reference) {
+        return true;
+    }
+    verifyStats.mismatches++;
+    std::cout << "[gpu cull] frame " << verifyStats.frames << " differs from the CPU reference: " << gpu.size()
+              << " visible on the GPU, " << reference.size() << " on the CPU" << std::endl;
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        for (int lod = 0; lod < MAX_LODS; lod++) {
+            if (gpu.ids[kind][lod] != reference.ids[kind][lod]) {
+                std::cout << "  kind " << kind << " lod " << lod << ": " << gpu.ids[kind][lod].size() << " vs "
+                          << reference.ids[kind][lod].size() << std::endl;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,153 @@
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "frustum.h"
+#include "render_queue.h"
+#include <cstdint>
+#include <vector>
+
+class StaticModel;
+
+enum class CullKind : uint32_t {
+    Tree = 0,
+    Cane = 1,
+    Snowman = 2
+};
+
+// Frustum culling and LOD selection of static props in a compute shader
+// (GL 4.3). Each chunk's instances live in a fixed slot of a persistent
+// buffer, written once when the chunk is uploaded, so a frame only uploads
+// the list of visible slots. The shader appends the surviving model matrices
+// to one region per kind and LOD and counts them straight into the indirect
+// commands, which RenderQueue then draws without reading anything back.
+class GpuCuller {
+public:
+    static constexpr int KIND_COUNT = 3;
+    static constexpr int MAX_LODS = 4;
+    static constexpr int SLOT_COUNT = 1024;
+    static constexpr int INSTANCES_PER_SLOT = 9;
+    static constexpr int REGION_CAPACITY = SLOT_COUNT * INSTANCES_PER_SLOT;
+
+    // Layout shared with instance_cull.comp (std430).
+    struct CullInstance {
+        glm::mat4 modelMatrix;
+        // w is the CullKind + 1; 0 marks an unused entry.
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+    };
+
+    // Everything one cull depends on, so the GPU pass and cullReference can
+    // be fed the exact same values.
+    struct Frame {
+        glm::vec4 planes[6];
+        glm::vec3 viewPosition;
+        // (LOD coverage threshold / projection scale)^2.
+        float lodThresholdsSq[MAX_LODS - 1];
+        int lodCounts[KIND_COUNT];
+        GLuint primitiveCounts[KIND_COUNT];
+    };
+
+    // Instance ids (slot * INSTANCES_PER_SLOT + entry) per kind and LOD.
+    struct Result {
+        std::vector<uint32_t> ids[KIND_COUNT][MAX_LODS];
+
+        void clear();
+        void sort();
+        bool operator==(const Result& other) const;
+        size_t size() const;
+    };
+
+    struct VerifyStats {
+        int frames = 0;
+        int mismatches = 0;
+    };
+
+    GpuCuller() = default;
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    // Resolves the compute entry points and builds the shader. Returns false
+    // below GL 4.3, and every call below is then a no-op.
+    bool initialize(GLADloadfunc load);
+    bool isAvailable() const { return programID != 0; }
+    void cleanup();
+
+    static CullInstance makeInstance(CullKind kind, const glm::mat4& modelMatrix, const AABB& bounds);
+    // Returns -1 when no slot is free or the culler is unavailable; the chunk
+    // then stays on the CPU path.
+    int allocateSlot(const CullInstance* slotInstances, int count);
+    void releaseSlot(int slot);
+
+    void beginFrame();
+    void addVisibleSlot(int slot);
+    // Instances in this frame's visible slots, before the GPU culls them.
+    int getCandidateCount() const { return candidateCount; }
+
+    // First instance of the output region of a kind and LOD.
+    static GLuint getRegionBaseInstance(int kind, int lod);
+
+    // Fills the frame from the camera and rebuilds this frame's indirect
+    // commands from the models, which are indexed by CullKind.
+    void buildFrame(const Frustum& frustum, const glm::vec3& viewPosition, float projectionScale,
+                    StaticModel* const models[KIND_COUNT], Frame& frame);
+    // Replaces the commands buildFrame would build: from base[kind], one
+    // command per LOD for each of the kind's primitives in turn.
+    void setCommands(const std::vector<DrawElementsIndirectCommand>& frameCommands, const GLuint base[KIND_COUNT]);
+    // Uploads the commands and visible slots and runs the cull. Returns false
+    // when there was nothing to cull.
+    bool dispatch(const Frame& frame);
+    // dispatch, then queues one indirect packet per primitive of every model.
+    void cullAndSubmit(const Frame& frame, StaticModel* const models[KIND_COUNT], RenderQueue& queue);
+    // The same cull on the CPU over this frame's visible slots.
+    void cullReference(const Frame& frame, Result& out) const;
+    // The CPU cull over any slot contents, laid out INSTANCES_PER_SLOT to a
+    // slot as in the GPU buffer.
+    static void cullReference(const Frame& frame, const CullInstance* instances,
+                              const std::vector<GLuint>& visibleSlots, Result& out);
+    // Reads the last cull back and compares it with cullReference. Stalls the
+    // pipeline, so only for checking a driver.
+    bool verify(const Frame& frame);
+    const VerifyStats& getVerifyStats() const { return verifyStats; }
+
+private:
+    typedef void (GLAD_API_PTR *DispatchComputeProc)(GLuint x, GLuint y, GLuint z);
+    typedef void (GLAD_API_PTR *MemoryBarrierProc)(GLbitfield barriers);
+
+    DispatchComputeProc dispatchCompute = nullptr;
+    MemoryBarrierProc memoryBarrier = nullptr;
+
+    GLuint programID = 0;
+    GLint frustumPlanesID = -1;
+    GLint viewPositionID = -1;
+    GLint visibleSlotCountID = -1;
+    GLint instancesPerSlotID = -1;
+    GLint regionCapacityID = -1;
+    GLint lodThresholdsID = -1;
+    GLint lodCountsID = -1;
+    GLint commandBaseID = -1;
+    GLint primitiveCountsID = -1;
+
+    GLuint instanceBufferID = 0;
+    GLuint visibleSlotBufferID = 0;
+    size_t visibleSlotCapacity = 0;
+    GLuint commandBufferID = 0;
+    size_t commandBufferCapacity = 0;
+    GLuint outputMatrixBufferID = 0;
+    GLuint outputIdBufferID = 0;
+
+    // CPU copy of the slot contents for cullReference.
+    std::vector<CullInstance> instances;
+    std::vector<int> slotCounts;
+    std::vector<int> freeSlots;
+    std::vector<GLuint> visibleSlots;
+    int candidateCount = 0;
+    std::vector<DrawElementsIndirectCommand> commands;
+    GLuint commandBase[KIND_COUNT] = {};
+    VerifyStats verifyStats;
+};
+
+#endif
@@ -0,0 +1,324 @@
+#include "impostor.h"
+#include "shader_library.h"
+#include "gl_state_cache.h"
+#include "../entities/static_model.h"
+#include "../utils/texture_manager.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <tinygltf-2.9.3/stb_image_write.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+namespace {
+    glm::vec2 signNotZero(const glm::vec2& v) {
+        return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    // Must match octahedralDecode in impostor.vert.
+    glm::vec3 octahedralDecode(const glm::vec2& e) {
+        glm::vec3 n(e.x, 1.0f - std::fabs(e.x) - std::fabs(e.y), e.y);
+        if (n.y < 0.0f) {
+            glm::vec2 folded = (glm::vec2(1.0f) - glm::abs(glm::vec2(n.z, n.x))) * signNotZero(glm::vec2(n.x, n.z));
+            n.x = folded.x;
+            n.z = folded.y;
+        }
+        return glm::normalize(n);
+    }
+
+    int mipLevelsForFrame(int frameSize) {
+        // Stop before neighbouring frames bleed into each other.
+        int levels = 0;
+        while ((frameSize >> (levels + 1)) >= 8) {
+            levels++;
+        }
+        return levels;
+    }
+}
+
+bool bakeImpostorAtlas(StaticModel& model, int framesPerSide, int frameSize,
+                       const glm::vec3& lightPosition, const glm::vec3& lightIntensity, ImpostorAtlas& atlas) {
+    const AABB& bounds = model.getBounds();
+    if (!bounds.isValid() || framesPerSide <= 0 || frameSize <= 0) {
+        return false;
+    }
+
+    atlas.framesPerSide = framesPerSide;
+    atlas.frameSize = frameSize;
+    atlas.center = bounds.getCenter();
+    atlas.radius = glm::length(bounds.getExtents());
+    int atlasSize = framesPerSide * frameSize;
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint prevFramebuffer = glState.getFramebuffer();
+    GLint prevViewport[4];
+    GLfloat prevClearColor[4];
+    glState.getViewport(prevViewport);
+    glState.getClearColor(prevClearColor);
+
+    atlas.textureID = glState.genTexture();
+    glState.activeTexture(GL_TEXTURE0);
+    glState.bindTexture(GL_TEXTURE_2D, atlas.textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevelsForFrame(frameSize));
+
+    GLuint depthBufferID, framebufferID;
+    glGenRenderbuffers(1, &depthBufferID);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBufferID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+
+    framebufferID = glState.genFramebuffer();
+    glState.bindFramebuffer(framebufferID);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas.textureID, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBufferID);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        glState.clearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glm::mat4 projection = glm::ortho(-atlas.radius, atlas.radius, -atlas.radius, atlas.radius,
+                                          atlas.radius * 0.5f, atlas.radius * 3.5f);
+
+        RenderQueue queue;
+        FrameUniforms frameUniforms;
+        frameUniforms.lightPosition = lightPosition;
+        frameUniforms.lightIntensity = lightIntensity;
+
+        for (int row = 0; row < framesPerSide; row++) {
+            for (int column = 0; column < framesPerSide; column++) {
+                glState.viewport(column * frameSize, row * frameSize, frameSize, frameSize);
+
+                glm::vec2 cell((column + 0.5f) / framesPerSide, (row + 0.5f) / framesPerSide);
+                glm::vec3 direction = octahedralDecode(cell * 2.0f - 1.0f);
+                glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                glm::vec3 eye = atlas.center + direction * atlas.radius * 2.0f;
+                glm::mat4 view = glm::lookAt(eye, atlas.center, up);
+
+                frameUniforms.viewProjectionMatrix = projection * view;
+                frameUniforms.viewPosition = eye;
+                queue.begin(frameUniforms);
+                model.submit(queue, glm::mat4(1.0f));
+                queue.flush();
+            }
+        }
+
+        glState.activeTexture(GL_TEXTURE0);
+        glState.bindTexture(GL_TEXTURE_2D, atlas.textureID);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    else {
+        std::cerr << "Impostor framebuffer incomplete" << std::endl;
+        glState.deleteTexture(atlas.textureID);
+        atlas.textureID = 0;
+    }
+
+    glState.bindFramebuffer(prevFramebuffer);
+    glState.viewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    glState.clearColor(prevClearColor[0], prevClearColor[1], prevClearColor[2], prevClearColor[3]);
+    glState.deleteFramebuffer(framebufferID);
+    glDeleteRenderbuffers(1, &depthBufferID);
+
+    return complete;
+}
+
+bool saveImpostorAtlas(const ImpostorAtlas& atlas, const std::string& path) {
+    if (atlas.textureID == 0) {
+        return false;
+    }
+
+    int atlasSize = atlas.framesPerSide * atlas.frameSize;
+    std::vector<unsigned char> pixels(static_cast<size_t>(atlasSize) * atlasSize * 4);
+    GLStateCache::getInstance().bindTextureUnit(0, GL_TEXTURE_2D, atlas.textureID);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    stbi_flip_vertically_on_write(1);
+    bool written = stbi_write_png(path.c_str(), atlasSize, atlasSize, 4, pixels.data(), atlasSize * 4) != 0;
+    stbi_flip_vertically_on_write(0);
+
+    if (!written) {
+        std::cerr << "Failed to write impostor atlas " << path << std::endl;
+    }
+    return written;
+}
+
+bool loadImpostorAtlas(const std::string& path, const AABB& modelBounds, int framesPerSide, ImpostorAtlas& atlas) {
+    if (!modelBounds.isValid() || !std::ifstream(path).good()) {
+        return false;
+    }
+
+    atlas.textureID = TextureManager::getInstance().getTexture(path);
+    if (atlas.textureID == 0) {
+        return false;
+    }
+
+    GLint width = 0;
+    GLStateCache::getInstance().bindTextureUnit(0, GL_TEXTURE_2D, atlas.textureID);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+
+    atlas.framesPerSide = framesPerSide;
+    atlas.frameSize = width / framesPerSide;
+    atlas.center = modelBounds.getCenter();
+    atlas.radius = glm::length(modelBounds.getExtents());
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevelsForFrame(atlas.frameSize));
+    return atlas.frameSize > 0;
+}
+
+ImpostorRenderer::ImpostorRenderer() {
+}
+
+ImpostorRenderer::~ImpostorRenderer() {
+    cleanup();
+}
+
+bool ImpostorRenderer::initialize() {
+    ShaderLibrary& shaders = ShaderLibrary::getInstance();
+    programID = shaders.acquire("../scene/shaders/impostor.vert", "../scene/shaders/impostor.frag");
+    if (programID == 0) {
+        std::cerr << "Failed to load impostor shaders" << std::endl;
+        return false;
+    }
+
+    viewProjectionMatrixID = shaders.getUniformLocation(programID, "viewProjectionMatrix");
+    viewPositionID = shaders.getUniformLocation(programID, "viewPosition");
+    boundsCenterID = shaders.getUniformLocation(programID, "boundsCenter");
+    boundsRadiusID = shaders.getUniformLocation(programID, "boundsRadius");
+    framesPerSideID = shaders.getUniformLocation(programID, "framesPerSide");
+    textureSamplerID = shaders.getUniformLocation(programID, "textureSampler");
+
+    GLfloat corner_buffer_data[8] = {
+        -1.0f, -1.0f,
+        1.0f, -1.0f,
+        -1.0f, 1.0f,
+        1.0f, 1.0f,
+    };
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    vertexArrayID = glState.genVertexArray();
+    glState.bindVertexArray(vertexArrayID);
+
+    cornerBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_ARRAY_BUFFER, cornerBufferID);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corner_buffer_data), corner_buffer_data, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+    instanceBufferID = glState.genBuffer();
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+    for (int i = 1; i <= 5; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    glState.bindVertexArray(0);
+    return true;
+}
+
+int ImpostorRenderer::addAtlas(const ImpostorAtlas& atlas) {
+    Batch batch;
+    batch.atlas = atlas;
+    batches.push_back(batch);
+    return static_cast<int>(batches.size()) - 1;
+}
+
+void ImpostorRenderer::cleanup() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.deleteBuffer(instanceBufferID);
+    glState.deleteBuffer(cornerBufferID);
+    glState.deleteVertexArray(vertexArrayID);
+    ShaderLibrary::getInstance().release(programID);
+    instanceBufferID = 0;
+    cornerBufferID = 0;
+    vertexArrayID = 0;
+    programID = 0;
+    batches.clear();
+}
+
+void ImpostorRenderer::setSwitchDistance(float distance, float band) {
+    switchDistance = distance;
+    fadeBand = std::max(band, 1.0f);
+}
+
+float ImpostorRenderer::fadeForDistance(float distance) const {
+    return glm::clamp((distance - getFadeStartDistance()) / fadeBand, 0.0f, 1.0f);
+}
+
+void ImpostorRenderer::beginFrame() {
+    for (auto& batch : batches) {
+        batch.instances.clear();
+    }
+    submittedCount = 0;
+}
+
+void ImpostorRenderer::submit(int atlasId, const glm::mat4& modelMatrix, float fade) {
+    if (atlasId < 0 || atlasId >= static_cast<int>(batches.size())) {
+        return;
+    }
+    batches[atlasId].instances.push_back({ modelMatrix, fade });
+    submittedCount++;
+}
+
+void ImpostorRenderer::render(const glm::mat4& viewProjectionMatrix, const glm::vec3& viewPosition) {
+    if (submittedCount == 0 || programID == 0) {
+        return;
+    }
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    size_t requiredBytes = submittedCount * sizeof(InstanceData);
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+    if (requiredBytes > instanceBufferCapacity) {
+        instanceBufferCapacity = requiredBytes * 2;
+    }
+    glBufferData(GL_ARRAY_BUFFER, instanceBufferCapacity, nullptr, GL_STREAM_DRAW);
+
+    size_t offset = 0;
+    for (const auto& batch : batches) {
+        size_t bytes = batch.instances.size() * sizeof(InstanceData);
+        if (bytes > 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, batch.instances.data());
+        }
+        offset += bytes;
+    }
+
+    glState.useProgram(programID);
+    glUniformMatrix4fv(viewProjectionMatrixID, 1, GL_FALSE, &viewProjectionMatrix[0][0]);
+    glUniform3fv(viewPositionID, 1, &viewPosition[0]);
+    glState.activeTexture(GL_TEXTURE0);
+    glUniform1i(textureSamplerID, 0);
+    glState.bindVertexArray(vertexArrayID);
+
+    offset = 0;
+    for (const auto& batch : batches) {
+        GLsizei count = static_cast<GLsizei>(batch.instances.size());
+        if (count == 0 || batch.atlas.textureID == 0) {
+            offset += count * sizeof(InstanceData);
+            continue;
+        }
+
+        // GL 3.3 has no base instance, so each batch re-points the instance attributes.
+        for (int column = 0; column < 4; column++) {
+            glVertexAttribPointer(1 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  BUFFER_OFFSET(offset + column * sizeof(glm::vec4)));
+        }
+        glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              BUFFER_OFFSET(offset + offsetof(InstanceData, fade)));
+
+        glUniform3fv(boundsCenterID, 1, &batch.atlas.center[0]);
+        glUniform1f(boundsRadiusID, batch.atlas.radius);
+        glUniform1f(framesPerSideID, static_cast<float>(batch.atlas.framesPerSide));
+        glState.bindTexture(GL_TEXTURE_2D, batch.atlas.textureID);
+
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+        offset += count * sizeof(InstanceData);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "frustum.h"
+
+class StaticModel;
+
+// A model rendered from framesPerSide x framesPerSide directions laid out on
+// an octahedral map, one frame per atlas cell. Frames are framed around the
+// model-space bounding sphere described by center/radius.
+struct ImpostorAtlas {
+    GLuint textureID = 0;
+    int framesPerSide = 0;
+    int frameSize = 0;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+bool bakeImpostorAtlas(StaticModel& model, int framesPerSide, int frameSize,
+                       const glm::vec3& lightPosition, const glm::vec3& lightIntensity, ImpostorAtlas& atlas);
+bool saveImpostorAtlas(const ImpostorAtlas& atlas, const std::string& path);
+bool loadImpostorAtlas(const std::string& path, const AABB& modelBounds, int framesPerSide, ImpostorAtlas& atlas);
+
+// Batches camera-facing impostor quads per atlas and draws each batch with a
+// single instanced call. Instances between the fade start and the switch
+// distance are dithered in so the swap with the full mesh is not visible.
+class ImpostorRenderer {
+public:
+    ImpostorRenderer();
+    ~ImpostorRenderer();
+
+    bool initialize();
+    int addAtlas(const ImpostorAtlas& atlas);
+    void cleanup();
+
+    void setSwitchDistance(float distance, float fadeBand);
+    float getSwitchDistance() const { return switchDistance; }
+    float getFadeStartDistance() const { return switchDistance - fadeBand; }
+    float fadeForDistance(float distance) const;
+
+    void beginFrame();
+    void submit(int atlasId, const glm::mat4& modelMatrix, float fade);
+    void render(const glm::mat4& viewProjectionMatrix, const glm::vec3& viewPosition);
+
+    int getSubmittedCount() const { return submittedCount; }
+
+private:
+    struct InstanceData {
+        glm::mat4 modelMatrix;
+        float fade;
+    };
+
+    struct Batch {
+        ImpostorAtlas atlas;
+        std::vector<InstanceData> instances;
+    };
+
+    std::vector<Batch> batches;
+    float switchDistance = 4000.0f;
+    float fadeBand = 600.0f;
+    int submittedCount = 0;
+
+    GLuint programID = 0;
+    GLuint viewProjectionMatrixID = 0;
+    GLuint viewPositionID = 0;
+    GLuint boundsCenterID = 0;
+    GLuint boundsRadiusID = 0;
+    GLuint framesPerSideID = 0;
+    GLuint textureSamplerID = 0;
+
+    GLuint vertexArrayID = 0;
+    GLuint cornerBufferID = 0;
+    GLuint instanceBufferID = 0;
+    size_t instanceBufferCapacity = 0;
+};
+
+#endif
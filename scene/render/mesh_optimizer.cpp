@@ -0,0 +1,302 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+    // Triangles around each vertex in compressed rows: the triangles of
+    // vertex v are triangles[offsets[v]] up to triangles[offsets[v + 1]].
+    struct Adjacency {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        Adjacency(const std::vector<uint32_t>& indices, size_t vertexCount) : offsets(vertexCount + 1, 0) {
+            for (uint32_t index : indices) {
+                offsets[index + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                offsets[v + 1] += offsets[v];
+            }
+            triangles.resize(indices.size());
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++) {
+                triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        uint32_t count(uint32_t v) const { return offsets[v + 1] - offsets[v]; }
+    };
+
+    // FIFO cache as timestamps: a vertex is cached while fewer than
+    // cacheSize misses happened since it was loaded.
+    struct CacheSimulator {
+        std::vector<uint32_t> loadedAt;
+        uint32_t time;
+        int cacheSize;
+
+        CacheSimulator(size_t vertexCount, int cacheSize)
+            : loadedAt(vertexCount, 0), time(static_cast<uint32_t>(cacheSize) + 1), cacheSize(cacheSize) {}
+
+        bool isCached(uint32_t v) const { return time - loadedAt[v] <= static_cast<uint32_t>(cacheSize); }
+        // Returns true on a miss.
+        bool access(uint32_t v) {
+            if (isCached(v)) {
+                return false;
+            }
+            loadedAt[v] = time++;
+            return true;
+        }
+        // Ages everything out without touching the timestamps.
+        void flush() { time += static_cast<uint32_t>(cacheSize) + 1; }
+    };
+    // Orders runs of triangles (each given by its first triangle) so the ones
+    // facing out from the mesh centroid come first.
+    std::vector<uint32_t> sortClusters(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                       const std::vector<uint32_t>& starts) {
+        size_t triangleCount = indices.size() / 3;
+        glm::dvec3 meshCentroid(0.0);
+        double meshArea = 0.0;
+        struct Cluster {
+            uint32_t begin;
+            uint32_t end;
+            double sortKey;
+        };
+        std::vector<Cluster> sorted;
+        std::vector<glm::dvec3> centroids;
+        std::vector<glm::dvec3> normals;
+        for (size_t c = 0; c < starts.size(); c++) {
+            uint32_t begin = starts[c];
+            uint32_t end = c + 1 < starts.size() ? starts[c + 1] : static_cast<uint32_t>(triangleCount);
+            glm::dvec3 centroid(0.0);
+            glm::dvec3 normal(0.0);
+            double area = 0.0;
+            for (uint32_t t = begin; t < end; t++) {
+                glm::dvec3 a(positions[indices[t * 3]]);
+                glm::dvec3 b(positions[indices[t * 3 + 1]]);
+                glm::dvec3 d(positions[indices[t * 3 + 2]]);
+                glm::dvec3 cross = glm::cross(b - a, d - a);
+                double triangleArea = glm::length(cross) * 0.5;
+                centroid += (a + b + d) / 3.0 * triangleArea;
+                normal += cross;
+                area += triangleArea;
+            }
+            meshCentroid += centroid;
+            meshArea += area;
+            centroids.push_back(area > 0.0 ? centroid / area : glm::dvec3(0.0));
+            normals.push_back(glm::length(normal) > 0.0 ? glm::normalize(normal) : glm::dvec3(0.0));
+            sorted.push_back({ begin, end, 0.0 });
+        }
+        if (meshArea > 0.0) {
+            meshCentroid /= meshArea;
+        }
+        for (size_t c = 0; c < sorted.size(); c++) {
+            sorted[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c]);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (const Cluster& cluster : sorted) {
+            result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+        }
+        return result;
+    }
+}
+
+float computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+    CacheSimulator cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (uint32_t index : indices) {
+        misses += cache.access(index) ? 1 : 0;
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize,
+                                          std::vector<uint32_t>* clusters) {
+    size_t triangleCount = indices.size() / 3;
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    if (clusters) {
+        clusters->clear();
+    }
+    if (triangleCount == 0) {
+        return result;
+    }
+
+    Adjacency adjacency(indices, vertexCount);
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        liveTriangles[v] = adjacency.count(static_cast<uint32_t>(v));
+    }
+    std::vector<bool> emitted(triangleCount, false);
+    CacheSimulator cache(vertexCount, cacheSize);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    uint32_t cursor = 0;
+
+    // Next vertex with triangles left: the most recent dead end first, then
+    // the lowest unprocessed index.
+    auto skipDeadEnd = [&]() -> int64_t {
+        while (!deadEnd.empty()) {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0) {
+                return v;
+            }
+        }
+        while (cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0) {
+                return cursor;
+            }
+            cursor++;
+        }
+        return -1;
+    };
+
+    int64_t fan = skipDeadEnd();
+    bool coldStart = true;
+    while (fan >= 0) {
+        if (coldStart && clusters) {
+            clusters->push_back(static_cast<uint32_t>(result.size() / 3));
+        }
+
+        candidates.clear();
+        uint32_t f = static_cast<uint32_t>(fan);
+        for (uint32_t k = adjacency.offsets[f]; k < adjacency.offsets[f + 1]; k++) {
+            uint32_t triangle = adjacency.triangles[k];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t v = indices[triangle * 3 + corner];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                cache.access(v);
+            }
+        }
+
+        // Prefer the candidate that stays in the cache longest while its
+        // remaining fan is emitted; one that would fall out scores 0.
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            int64_t age = static_cast<int64_t>(cache.time) - cache.loadedAt[v];
+            if (age + 2 * static_cast<int64_t>(liveTriangles[v]) <= cacheSize) {
+                priority = age;
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+
+        coldStart = best < 0;
+        fan = best >= 0 ? best : skipDeadEnd();
+        if (coldStart && fan >= 0 && cache.isCached(static_cast<uint32_t>(fan))) {
+            coldStart = false;
+        }
+    }
+    return result;
+}
+
+std::vector<uint32_t> optimizeOverdraw(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                       const std::vector<uint32_t>& clusters, float threshold, int cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty()) {
+        return indices;
+    }
+
+    // Cut inside a cluster wherever the run so far already beats the
+    // target; the cold cache the next run starts with is then affordable.
+    float target = computeAcmr(indices, positions.size(), cacheSize) * threshold;
+    std::vector<uint32_t> starts;
+    CacheSimulator cache(positions.size(), cacheSize);
+    for (size_t c = 0; c < clusters.size(); c++) {
+        uint32_t begin = clusters[c];
+        uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+        starts.push_back(begin);
+        cache.flush();
+        size_t misses = 0;
+        uint32_t runStart = begin;
+        for (uint32_t t = begin; t < end; t++) {
+            for (int corner = 0; corner < 3; corner++) {
+                misses += cache.access(indices[t * 3 + corner]) ? 1 : 0;
+            }
+            uint32_t runLength = t + 1 - runStart;
+            if (t + 1 < end && static_cast<float>(misses) / runLength <= target) {
+                starts.push_back(t + 1);
+                runStart = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+
+    // Each cut was only scored from a cold cache; the uncut rest of every
+    // cluster was not, so with many small clusters the sorted order can still
+    // cost more than allowed. Fall back to sorting only the clusters Tipsify
+    // already started cold, and to the cache order if even that is over.
+    std::vector<uint32_t> result = sortClusters(positions, indices, starts);
+    if (computeAcmr(result, positions.size(), cacheSize) <= target) {
+        return result;
+    }
+    result = sortClusters(positions, indices, clusters);
+    if (computeAcmr(result, positions.size(), cacheSize) <= target) {
+        return result;
+    }
+    return indices;
+}
+
+size_t buildVertexFetchRemap(const std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& remap) {
+    remap.assign(vertexCount, UNUSED_VERTEX);
+    uint32_t next = 0;
+    for (uint32_t index : indices) {
+        if (remap[index] == UNUSED_VERTEX) {
+            remap[index] = next++;
+        }
+    }
+    return next;
+}
+
+void remapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap) {
+    for (uint32_t& index : indices) {
+        index = remap[index];
+    }
+}
+
+bool fitsShortIndices(size_t vertexCount) {
+    return vertexCount <= 65536;
+}
+
+std::vector<uint16_t> narrowIndices(const std::vector<uint32_t>& indices) {
+    return std::vector<uint16_t>(indices.begin(), indices.end());
+}
+
+void MeshOptimizationStats::addAcmr(size_t triangleCount, float acmrBefore, float acmrAfter) {
+    triangles += triangleCount;
+    missesBefore += static_cast<double>(acmrBefore) * triangleCount;
+    missesAfter += static_cast<double>(acmrAfter) * triangleCount;
+}
+
+void MeshOptimizationStats::print() const {
+    if (triangles == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(2) << "  Index order: ACMR " << missesBefore / triangles << " -> "
+              << missesAfter / triangles << " over " << triangles << " triangles, geometry " << bytesBefore / 1024
+              << " KB -> " << bytesAfter / 1024 << " KB (" << shortIndexPrimitives << "/" << primitives
+              << " primitives with 16-bit indices)" << std::endl;
+}
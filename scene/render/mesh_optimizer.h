@@ -0,0 +1,79 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Import-time reordering of indexed triangle lists, after Sander, Nehab and
+// Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw" (Tipsify), followed by a vertex remap for fetch locality. None
+// of it changes what is drawn, only the order.
+
+// Entries of the simulated post-transform cache; small enough that every
+// GPU generation does at least this well.
+constexpr int VERTEX_CACHE_SIZE = 16;
+constexpr uint32_t UNUSED_VERTEX = ~0u;
+
+// Average cache miss ratio: transformed vertices per triangle with a FIFO
+// cache of cacheSize entries. 3 is the worst case, around 0.6 the best a
+// regular grid reaches.
+float computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+// Tipsify: fans around recently used vertices so they are still cached.
+// clusters, if given, receives the first triangle of every run that starts
+// with a cold cache; optimizeOverdraw reorders those runs.
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+                                          int cacheSize = VERTEX_CACHE_SIZE,
+                                          std::vector<uint32_t>* clusters = nullptr);
+
+// Splits the clusters further wherever a cut costs little (the run so far
+// stays within threshold times the input's ACMR), then sorts them so the ones
+// facing out from the mesh centroid come first and occlude the rest. Never
+// ends up above that bound: it sorts only the given clusters, or returns the
+// input unchanged, when the finer order would.
+std::vector<uint32_t> optimizeOverdraw(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                       const std::vector<uint32_t>& clusters, float threshold = 1.05f,
+                                       int cacheSize = VERTEX_CACHE_SIZE);
+
+// Numbers vertices in order of first use, so vertex fetch walks the buffer
+// forwards. Vertices no index uses map to UNUSED_VERTEX and are dropped.
+// Returns the number of vertices kept.
+size_t buildVertexFetchRemap(const std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& remap);
+
+void remapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap);
+
+template <typename Vertex>
+void remapVertices(std::vector<Vertex>& vertices, const std::vector<uint32_t>& remap, size_t keptCount) {
+    std::vector<Vertex> remapped(keptCount);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        if (remap[i] != UNUSED_VERTEX) {
+            remapped[remap[i]] = vertices[i];
+        }
+    }
+    vertices.swap(remapped);
+}
+
+// 16-bit indices wherever every vertex fits.
+bool fitsShortIndices(size_t vertexCount);
+std::vector<uint16_t> narrowIndices(const std::vector<uint32_t>& indices);
+
+// Index order and geometry memory of one model before and after
+// optimization. ACMR is for the full-detail level, weighted by triangles;
+// bytes cover vertices and every LOD's indices, the "before" side as the
+// glTF order with 32-bit indices was uploaded.
+struct MeshOptimizationStats {
+    size_t triangles = 0;
+    double missesBefore = 0.0;
+    double missesAfter = 0.0;
+    size_t bytesBefore = 0;
+    size_t bytesAfter = 0;
+    int shortIndexPrimitives = 0;
+    int primitives = 0;
+
+    void addAcmr(size_t triangleCount, float acmrBefore, float acmrAfter);
+    void print() const;
+};
+
+#endif
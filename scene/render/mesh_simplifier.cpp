@@ -0,0 +1,315 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+
+namespace {
+    // Symmetric 4x4 error quadric stored as its upper triangle, plus the
+    // total weight of its planes so it evaluates to a mean squared distance
+    // (a length squared, comparable with the error limit) rather than one
+    // scaled by the area of the triangles it was built from.
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0;
+        double a33 = 0;
+        double weight = 0;
+
+        void addPlane(const glm::dvec3& normal, double d, double weight) {
+            a00 += weight * normal.x * normal.x;
+            a01 += weight * normal.x * normal.y;
+            a02 += weight * normal.x * normal.z;
+            a03 += weight * normal.x * d;
+            a11 += weight * normal.y * normal.y;
+            a12 += weight * normal.y * normal.z;
+            a13 += weight * normal.y * d;
+            a22 += weight * normal.z * normal.z;
+            a23 += weight * normal.z * d;
+            a33 += weight * d * d;
+            this->weight += weight;
+        }
+
+        void add(const Quadric& other) {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+            a11 += other.a11; a12 += other.a12; a13 += other.a13;
+            a22 += other.a22; a23 += other.a23;
+            a33 += other.a33;
+            weight += other.weight;
+        }
+
+        double evaluate(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+                          + a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+                          + a22 * z * z + 2.0 * a23 * z
+                          + a33;
+            return weight > 0.0 ? std::max(result, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+    };
+
+    struct PositionKey {
+        uint32_t bits[3];
+
+        bool operator==(const PositionKey& other) const {
+            return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+        }
+    };
+
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey& key) const {
+            uint64_t h = key.bits[0] * 0x9E3779B97F4A7C15ull;
+            h ^= key.bits[1] + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+            h ^= key.bits[2] + 0x94D049BB133111EBull + (h << 6) + (h >> 2);
+            return static_cast<size_t>(h);
+        }
+    };
+
+    glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        return glm::cross(b - a, c - a);
+    }
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3>& positions,
+                                   const std::vector<uint32_t>& indices,
+                                   size_t targetIndexCount,
+                                   float maxError,
+                                   float* resultError) {
+    if (resultError) {
+        *resultError = 0.0f;
+    }
+    if (indices.size() <= targetIndexCount || positions.empty()) {
+        return indices;
+    }
+
+    // Weld vertices that share a position (UV and normal seams) so the
+    // collapses see one connected surface.
+    const size_t vertexCount = positions.size();
+    std::vector<uint32_t> canonical(vertexCount);
+    {
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> welded;
+        welded.reserve(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            PositionKey key;
+            std::memcpy(key.bits, &positions[i], sizeof(key.bits));
+            auto result = welded.emplace(key, static_cast<uint32_t>(i));
+            canonical[i] = result.first->second;
+        }
+    }
+
+    std::vector<uint32_t> triangles(indices.size());
+    std::vector<uint32_t> corners(indices);
+    for (size_t i = 0; i < indices.size(); i++) {
+        triangles[i] = canonical[indices[i]];
+    }
+
+    glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+    for (const auto& p : positions) {
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+    double extent = glm::length(boundsMax - boundsMin);
+    double errorLimit = (maxError * extent) * (maxError * extent);
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+        const glm::vec3& a = positions[triangles[t]];
+        const glm::vec3& b = positions[triangles[t + 1]];
+        const glm::vec3& c = positions[triangles[t + 2]];
+        glm::dvec3 normal = glm::dvec3(triangleNormal(a, b, c));
+        double length = glm::length(normal);
+        if (length <= 0.0) {
+            continue;
+        }
+        normal /= length;
+        double d = -glm::dot(normal, glm::dvec3(a));
+        double area = length * 0.5;
+        for (int k = 0; k < 3; k++) {
+            quadrics[triangles[t + k]].addPlane(normal, d, area);
+        }
+    }
+
+    // Open edges (foliage cards, mesh borders) get a perpendicular plane so
+    // the silhouette is not eaten away first.
+    {
+        std::unordered_map<uint64_t, int> edgeUse;
+        edgeUse.reserve(triangles.size());
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v0 = triangles[t + k], v1 = triangles[t + (k + 1) % 3];
+                uint64_t key = (static_cast<uint64_t>(std::min(v0, v1)) << 32) | std::max(v0, v1);
+                edgeUse[key]++;
+            }
+        }
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+            const glm::vec3& a = positions[triangles[t]];
+            const glm::vec3& b = positions[triangles[t + 1]];
+            const glm::vec3& c = positions[triangles[t + 2]];
+            glm::dvec3 faceNormal = glm::dvec3(triangleNormal(a, b, c));
+            for (int k = 0; k < 3; k++) {
+                uint32_t v0 = triangles[t + k], v1 = triangles[t + (k + 1) % 3];
+                uint64_t key = (static_cast<uint64_t>(std::min(v0, v1)) << 32) | std::max(v0, v1);
+                if (edgeUse[key] != 1) {
+                    continue;
+                }
+                glm::dvec3 edge = glm::dvec3(positions[v1] - positions[v0]);
+                glm::dvec3 normal = glm::cross(edge, faceNormal);
+                double length = glm::length(normal);
+                if (length <= 0.0) {
+                    continue;
+                }
+                normal /= length;
+                double d = -glm::dot(normal, glm::dvec3(positions[v0]));
+                double weight = glm::dot(edge, edge) * 10.0;
+                quadrics[v0].addPlane(normal, d, weight);
+                quadrics[v1].addPlane(normal, d, weight);
+            }
+        }
+    }
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint8_t> locked(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> collapses;
+    double worstCost = 0.0;
+
+    for (int pass = 0; pass < 32 && triangles.size() > targetIndexCount; pass++) {
+        const size_t triangleCount = triangles.size() / 3;
+
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (uint32_t v : triangles) {
+            adjacencyOffsets[v + 1]++;
+        }
+        for (size_t i = 0; i < vertexCount; i++) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        adjacency.resize(triangles.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    adjacency[fill[triangles[t * 3 + k]]++] = static_cast<uint32_t>(t);
+                }
+            }
+        }
+
+        edges.clear();
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v0 = triangles[t * 3 + k], v1 = triangles[t * 3 + (k + 1) % 3];
+                edges.push_back((static_cast<uint64_t>(std::min(v0, v1)) << 32) | std::max(v0, v1));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.clear();
+        for (uint64_t edge : edges) {
+            uint32_t v0 = static_cast<uint32_t>(edge >> 32);
+            uint32_t v1 = static_cast<uint32_t>(edge & 0xFFFFFFFFu);
+            Quadric combined = quadrics[v0];
+            combined.add(quadrics[v1]);
+            double costTo1 = combined.evaluate(positions[v1]);
+            double costTo0 = combined.evaluate(positions[v0]);
+            if (costTo1 <= costTo0) {
+                collapses.push_back({ costTo1, v0, v1 });
+            }
+            else {
+                collapses.push_back({ costTo0, v1, v0 });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        for (size_t i = 0; i < vertexCount; i++) {
+            remap[i] = static_cast<uint32_t>(i);
+        }
+        std::fill(locked.begin(), locked.end(), 0);
+
+        size_t removedIndices = 0;
+        size_t indicesToRemove = triangles.size() - targetIndexCount;
+        size_t applied = 0;
+
+        for (const Collapse& collapse : collapses) {
+            if (collapse.cost > errorLimit || removedIndices >= indicesToRemove) {
+                break;
+            }
+            if (locked[collapse.from] || locked[collapse.to]) {
+                continue;
+            }
+
+            bool flips = false;
+            size_t sharedTriangles = 0;
+            const glm::vec3& target = positions[collapse.to];
+            for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+                const uint32_t* tri = &triangles[adjacency[a] * 3];
+                if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+                    sharedTriangles++;
+                    continue;
+                }
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = positions[tri[k]];
+                    q[k] = tri[k] == collapse.from ? target : p[k];
+                }
+                glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+                glm::vec3 after = triangleNormal(q[0], q[1], q[2]);
+                if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+                const uint32_t* tri = &triangles[adjacency[a] * 3];
+                locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = 1;
+            }
+            locked[collapse.to] = 1;
+
+            removedIndices += sharedTriangles * 3;
+            worstCost = std::max(worstCost, collapse.cost);
+            applied++;
+        }
+
+        if (applied == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            uint32_t a = remap[triangles[t * 3]];
+            uint32_t b = remap[triangles[t * 3 + 1]];
+            uint32_t c = remap[triangles[t * 3 + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            uint32_t mapped[3] = { a, b, c };
+            for (int k = 0; k < 3; k++) {
+                uint32_t original = triangles[t * 3 + k];
+                triangles[write * 3 + k] = mapped[k];
+                corners[write * 3 + k] = mapped[k] == original ? corners[t * 3 + k] : mapped[k];
+            }
+            write++;
+        }
+        triangles.resize(write * 3);
+        corners.resize(write * 3);
+    }
+
+    if (resultError && extent > 0.0) {
+        *resultError = static_cast<float>(std::sqrt(worstCost) / extent);
+    }
+    return corners;
+}
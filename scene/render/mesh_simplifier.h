@@ -0,0 +1,20 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+// Reduces a triangle list with quadric-error edge collapses. The result only
+// references existing vertices, so a simplified LOD can share the vertex
+// buffers of the full mesh and just use a different index range.
+//
+// targetIndexCount is a goal, not a guarantee: collapses that would exceed
+// maxError (relative to the mesh extent) or flip a triangle are rejected.
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3>& positions,
+                                   const std::vector<uint32_t>& indices,
+                                   size_t targetIndexCount,
+                                   float maxError,
+                                   float* resultError = nullptr);
+
+#endif
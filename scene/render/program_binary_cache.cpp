@@ -0,0 +1,154 @@
+#include "program_binary_cache.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+namespace {
+    constexpr GLenum PROGRAM_BINARY_LENGTH = 0x8741;
+    constexpr GLenum NUM_PROGRAM_BINARY_FORMATS = 0x87FE;
+
+    constexpr uint32_t BINARY_MAGIC = 0x42505357; // "WSPB"
+    constexpr uint32_t BINARY_VERSION = 1;
+
+    struct BinaryHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t driverHash;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    uint64_t hashString(uint64_t hash, const char* text) {
+        for (const char* c = text; c && *c; c++) {
+            hash ^= static_cast<unsigned char>(*c);
+            hash *= 1099511628211ull;
+        }
+        // Separator so "ab"+"c" and "a"+"bc" differ.
+        hash ^= 0xFF;
+        hash *= 1099511628211ull;
+        return hash;
+    }
+}
+
+bool ProgramBinaryCache::initialize(const std::string& cacheDirectory, GLADloadfunc load) {
+    enabled = false;
+    getProgramBinary = reinterpret_cast<GetProgramBinaryProc>(load("glGetProgramBinary"));
+    programBinary = reinterpret_cast<ProgramBinaryProc>(load("glProgramBinary"));
+    if (!getProgramBinary || !programBinary) {
+        return false;
+    }
+
+    // Unknown to drivers without the extension, which then leave formats at 0.
+    GLint formats = 0;
+    glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    if (formats <= 0) {
+        std::cout << "[shaders] driver has no program binary formats, binary cache disabled" << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (error) {
+        std::cerr << "Failed to create shader cache directory " << cacheDirectory << std::endl;
+        return false;
+    }
+
+    directory = cacheDirectory;
+    driverHash = 14695981039346656037ull;
+    driverHash = hashString(driverHash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    driverHash = hashString(driverHash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    driverHash = hashString(driverHash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    enabled = true;
+    return true;
+}
+
+std::string ProgramBinaryCache::pathFor(uint64_t sourceHash) const {
+    char name[48];
+    std::snprintf(name, sizeof(name), "%016llx_%016llx.bin", static_cast<unsigned long long>(sourceHash),
+                  static_cast<unsigned long long>(driverHash));
+    return directory + "/" + name;
+}
+
+GLuint ProgramBinaryCache::load(uint64_t sourceHash) {
+    if (!enabled) {
+        return 0;
+    }
+
+    std::string path = pathFor(sourceHash);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    BinaryHeader header;
+    std::vector<char> binary;
+    bool valid = file.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == BINARY_MAGIC &&
+                 header.version == BINARY_VERSION && header.sourceHash == sourceHash &&
+                 header.driverHash == driverHash && header.length > 0;
+    if (valid) {
+        binary.resize(header.length);
+        valid = static_cast<bool>(file.read(binary.data(), header.length));
+    }
+    file.close();
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        programBinary(program, header.format, binary.data(), static_cast<GLsizei>(header.length));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    if (program == 0) {
+        std::cout << "[shaders] discarding stale program binary " << path << std::endl;
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    return program;
+}
+
+void ProgramBinaryCache::store(uint64_t sourceHash, GLuint program) {
+    if (!enabled || program == 0) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    getProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return;
+    }
+
+    BinaryHeader header = { BINARY_MAGIC, BINARY_VERSION, sourceHash, driverHash, format,
+                            static_cast<uint32_t>(written) };
+
+    // Written under a temporary name so a crash never leaves a truncated binary.
+    std::string path = pathFor(sourceHash);
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+            !file.write(binary.data(), written)) {
+            std::cerr << "Failed to write program binary " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+}
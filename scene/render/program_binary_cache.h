@@ -0,0 +1,39 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <glad/gl.h>
+#include <cstdint>
+#include <string>
+
+// Stores linked programs on disk with glGetProgramBinary and recreates them
+// with glProgramBinary. The loader is generated for GL 3.3, so the entry
+// points (GL 4.1 / ARB_get_program_binary) are fetched by hand. Binaries are
+// only valid for the driver that produced them, so files are keyed by the
+// source hash and a hash of GL_VENDOR, GL_RENDERER and GL_VERSION.
+class ProgramBinaryCache {
+public:
+    // Stays disabled if the driver offers no binary formats.
+    bool initialize(const std::string& directory, GLADloadfunc load);
+    bool isEnabled() const { return enabled; }
+
+    // Returns 0 on a miss or when the stored binary no longer links; a
+    // rejected file is removed so the next store replaces it.
+    GLuint load(uint64_t sourceHash);
+    void store(uint64_t sourceHash, GLuint program);
+
+private:
+    typedef void (GLAD_API_PTR *GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length,
+                                                      GLenum* binaryFormat, void* binary);
+    typedef void (GLAD_API_PTR *ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary,
+                                                   GLsizei length);
+
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    std::string directory;
+    uint64_t driverHash = 0;
+    bool enabled = false;
+
+    std::string pathFor(uint64_t sourceHash) const;
+};
+
+#endif
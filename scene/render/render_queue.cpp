@@ -0,0 +1,318 @@
+#include "render_queue.h"
+#include "gl_state_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+namespace {
+    // GL 4.3 enums the 3.3 loader does not define.
+    constexpr GLenum DRAW_INDIRECT_BUFFER = 0x8F3F;
+
+    constexpr int LAYER_BITS = 4;
+    constexpr int PROGRAM_BITS = 12;
+    constexpr int TEXTURE_BITS = 14;
+    constexpr int VAO_BITS = 14;
+    constexpr int DEPTH_BITS = 20;
+    static_assert(LAYER_BITS + PROGRAM_BITS + TEXTURE_BITS + VAO_BITS + DEPTH_BITS == 64, "sort key must fill 64 bits");
+
+    uint64_t field(uint64_t value, int bits) {
+        return value & ((uint64_t(1) << bits) - 1);
+    }
+
+    GLuint indexSize(GLenum indexType) {
+        switch (indexType) {
+            case GL_UNSIGNED_BYTE: return 1;
+            case GL_UNSIGNED_SHORT: return 2;
+            default: return 4;
+        }
+    }
+
+    // Everything but the index range and the instances, i.e. what one
+    // multi-draw cannot vary.
+    bool sameBatch(const DrawPacket& a, const DrawPacket& b) {
+        return a.indirectBuffer == 0 && b.indirectBuffer == 0 && a.program == b.program && a.vertexArray == b.vertexArray && a.texture == b.texture &&
+               a.mode == b.mode && a.indexType == b.indexType && a.objectIndex == b.objectIndex &&
+               a.prepare == b.prepare && a.owner == b.owner && a.userOffset == b.userOffset;
+    }
+}
+
+uint64_t RenderQueue::makeSortKey(RenderLayer layer, GLuint program, GLuint texture, GLuint vertexArray,
+                                  float depth) {
+    float normalized = std::min(std::max(depth / MAX_SORT_DEPTH, 0.0f), 1.0f);
+    uint64_t quantizedDepth = static_cast<uint64_t>(normalized * ((1u << DEPTH_BITS) - 1));
+
+    uint64_t key = field(static_cast<uint64_t>(layer), LAYER_BITS);
+    key = (key << PROGRAM_BITS) | field(program, PROGRAM_BITS);
+    key = (key << TEXTURE_BITS) | field(texture, TEXTURE_BITS);
+    key = (key << VAO_BITS) | field(vertexArray, VAO_BITS);
+    key = (key << DEPTH_BITS) | quantizedDepth;
+    return key;
+}
+
+RenderQueue::~RenderQueue() {
+    cleanup();
+}
+
+void RenderQueue::cleanup() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    glState.deleteBuffer(frameBlockBufferID);
+    glState.deleteBuffer(objectBlockBufferID);
+    glState.deleteBuffer(indirectBufferID);
+    frameBlockBufferID = 0;
+    objectBlockBufferID = 0;
+    indirectBufferID = 0;
+    objectBlockCapacity = 0;
+    indirectBufferCapacity = 0;
+}
+
+bool RenderQueue::initializeIndirectDraws(GLADloadfunc load) {
+    // Drivers may hand out the entry point on contexts that cannot use it,
+    // so the context version decides.
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    multiDrawElementsIndirect = nullptr;
+    if (major > 4 || (major == 4 && minor >= 3)) {
+        multiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirectProc>(
+            load("glMultiDrawElementsIndirect"));
+    }
+    setIndirectDraws(true);
+    return indirectDraws;
+}
+
+void RenderQueue::begin(const FrameUniforms& uniforms) {
+    frameUniforms = uniforms;
+    packets.clear();
+    frameData.clear();
+    objects.clear();
+}
+
+void RenderQueue::submit(const DrawPacket& packet) {
+    packets.push_back(packet);
+}
+
+size_t RenderQueue::pushData(const float* data, size_t count) {
+    size_t offset = frameData.size();
+    frameData.insert(frameData.end(), data, data + count);
+    return offset;
+}
+
+int RenderQueue::pushObject(const glm::mat4& modelMatrix) {
+    objects.push_back({ modelMatrix });
+    return static_cast<int>(objects.size()) - 1;
+}
+
+void RenderQueue::uploadUniformBlocks() {
+    GLStateCache& glState = GLStateCache::getInstance();
+    if (frameBlockBufferID == 0) {
+        frameBlockBufferID = glState.genBuffer();
+        objectBlockBufferID = glState.genBuffer();
+        GLint alignment = 1;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+        objectStride = (sizeof(ObjectBlock) + alignment - 1) / alignment * alignment;
+    }
+
+    FrameBlock frame = {};
+    frame.viewProjectionMatrix = frameUniforms.viewProjectionMatrix;
+    frame.lightPosition = frameUniforms.lightPosition;
+    frame.lightIntensity = frameUniforms.lightIntensity;
+    frame.viewPosition = frameUniforms.viewPosition;
+    glState.bindBuffer(GL_UNIFORM_BUFFER, frameBlockBufferID);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), &frame, GL_STREAM_DRAW);
+    glState.bindUniformBufferBase(FRAME_BLOCK_BINDING, frameBlockBufferID);
+
+    if (objects.empty()) {
+        return;
+    }
+
+    // Every object goes into one buffer at an aligned stride, orphaned each
+    // flush; it only grows.
+    size_t bytes = objects.size() * objectStride;
+    objectStaging.resize(bytes);
+    for (size_t i = 0; i < objects.size(); i++) {
+        std::memcpy(objectStaging.data() + i * objectStride, &objects[i], sizeof(ObjectBlock));
+    }
+    glState.bindBuffer(GL_UNIFORM_BUFFER, objectBlockBufferID);
+    if (bytes > objectBlockCapacity) {
+        objectBlockCapacity = bytes * 2;
+    }
+    glBufferData(GL_UNIFORM_BUFFER, objectBlockCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, bytes, objectStaging.data());
+}
+
+// LSD radix sort over 8-bit digits of (key, index) pairs. Digits on which
+// every key agrees are skipped, which in practice drops most of the passes
+// since layer and program take few distinct values.
+void RenderQueue::sortPackets() {
+    size_t count = packets.size();
+    keys.resize(count);
+    keysScratch.resize(count);
+    order.resize(count);
+    orderScratch.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = packets[i].sortKey;
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; i++) {
+            histogram[(keys[i] >> shift) & 0xFF]++;
+        }
+        if (histogram[(keys[0] >> shift) & 0xFF] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            size_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t destination = histogram[(keys[i] >> shift) & 0xFF]++;
+            keysScratch[destination] = keys[i];
+            orderScratch[destination] = order[i];
+        }
+        keys.swap(keysScratch);
+        order.swap(orderScratch);
+    }
+}
+
+void RenderQueue::buildCommands() {
+    commands.clear();
+    batches.clear();
+    const DrawPacket* previous = nullptr;
+    for (uint32_t index : order) {
+        const DrawPacket& packet = packets[index];
+        DrawElementsIndirectCommand command;
+        command.count = static_cast<GLuint>(packet.indexCount);
+        command.instanceCount = static_cast<GLuint>(std::max<GLsizei>(packet.instanceCount, 1));
+        command.firstIndex = static_cast<GLuint>(packet.indexOffset / indexSize(packet.indexType));
+        command.baseVertex = packet.baseVertex;
+        command.baseInstance = packet.baseInstance;
+
+        if (previous && sameBatch(*previous, packet)) {
+            batches.back().count++;
+        } else {
+            batches.push_back({ static_cast<uint32_t>(commands.size()), 1 });
+        }
+        commands.push_back(command);
+        previous = &packet;
+    }
+}
+
+void RenderQueue::flush() {
+    stats = RenderQueueStats();
+    stats.packets = static_cast<int>(packets.size());
+    if (packets.empty()) {
+        return;
+    }
+
+    uploadUniformBlocks();
+    sortPackets();
+    buildCommands();
+    stats.batches = static_cast<int>(batches.size());
+
+    GLStateCache& glState = GLStateCache::getInstance();
+    if (indirectDraws) {
+        // Orphaned each flush like the object block; it only grows.
+        if (indirectBufferID == 0) {
+            indirectBufferID = glState.genBuffer();
+        }
+        size_t bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        glState.bindBuffer(DRAW_INDIRECT_BUFFER, indirectBufferID);
+        if (bytes > indirectBufferCapacity) {
+            indirectBufferCapacity = bytes * 2;
+        }
+        glBufferData(DRAW_INDIRECT_BUFFER, indirectBufferCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+    }
+
+    GLuint currentProgram = 0;
+    GLuint currentVertexArray = 0;
+    GLuint currentTexture = 0;
+    int currentObject = -1;
+    bool first = true;
+
+    glState.activeTexture(GL_TEXTURE0);
+    for (const Batch& batch : batches) {
+        const DrawPacket& packet = packets[order[batch.first]];
+
+        bool programChanged = first || packet.program != currentProgram;
+        if (programChanged) {
+            glState.useProgram(packet.program);
+            currentProgram = packet.program;
+            stats.programSwitches++;
+        }
+        if (first || packet.vertexArray != currentVertexArray) {
+            glState.bindVertexArray(packet.vertexArray);
+            currentVertexArray = packet.vertexArray;
+            stats.vertexArrayBinds++;
+        }
+        if (first || packet.texture != currentTexture) {
+            glState.bindTexture(GL_TEXTURE_2D, packet.texture);
+            currentTexture = packet.texture;
+            stats.textureBinds++;
+        }
+        first = false;
+
+        if (packet.objectIndex >= 0 && packet.objectIndex != currentObject) {
+            glState.bindUniformBufferRange(OBJECT_BLOCK_BINDING, objectBlockBufferID,
+                                           packet.objectIndex * objectStride, sizeof(ObjectBlock));
+            currentObject = packet.objectIndex;
+            stats.objectBinds++;
+        }
+
+        if (packet.indirectBuffer != 0) {
+            if (!indirectDraws) {
+                continue;
+            }
+            if (packet.prepare) {
+                packet.prepare(*this, packet, programChanged);
+            }
+            glState.bindBuffer(DRAW_INDIRECT_BUFFER, packet.indirectBuffer);
+            multiDrawElementsIndirect(packet.mode, packet.indexType, BUFFER_OFFSET(packet.indirectOffset),
+                                      packet.indirectDrawCount, 0);
+            glState.bindBuffer(DRAW_INDIRECT_BUFFER, indirectBufferID);
+            stats.draws++;
+            continue;
+        }
+
+        if (indirectDraws) {
+            if (packet.prepare) {
+                packet.prepare(*this, packet, programChanged);
+            }
+            multiDrawElementsIndirect(packet.mode, packet.indexType,
+                                      BUFFER_OFFSET(batch.first * sizeof(DrawElementsIndirectCommand)),
+                                      static_cast<GLsizei>(batch.count), 0);
+            stats.draws++;
+            continue;
+        }
+
+        for (uint32_t i = batch.first; i < batch.first + batch.count; i++) {
+            const DrawPacket& member = packets[order[i]];
+            const DrawElementsIndirectCommand& command = commands[i];
+            if (member.prepare) {
+                member.prepare(*this, member, programChanged && i == batch.first);
+            }
+            if (member.instanceCount > 0) {
+                glDrawElementsInstancedBaseVertex(member.mode, command.count, member.indexType,
+                                                  BUFFER_OFFSET(member.indexOffset), command.instanceCount,
+                                                  command.baseVertex);
+            } else {
+                glDrawElementsBaseVertex(member.mode, command.count, member.indexType,
+                                         BUFFER_OFFSET(member.indexOffset), command.baseVertex);
+            }
+            stats.draws++;
+        }
+    }
+
+    packets.clear();
+    frameData.clear();
+    objects.clear();
+}
@@ -0,0 +1,187 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "uniform_blocks.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class RenderQueue;
+
+// Uniforms that are the same for every packet of a frame. The queue writes
+// them into the FrameBlock once per flush.
+struct FrameUniforms {
+    glm::mat4 viewProjectionMatrix = glm::mat4(1.0f);
+    glm::vec3 lightPosition = glm::vec3(0.0f);
+    glm::vec3 lightIntensity = glm::vec3(0.0f);
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+};
+
+enum class RenderLayer : uint8_t {
+    Opaque = 0,
+    Ground = 1
+};
+
+// One indexed draw. The queue binds program, VAO, texture unit 0 and the
+// packet's ObjectBlock itself; everything else a draw needs (samplers,
+// attribute offsets, extra texture units) is set by prepare, which runs right
+// before the draw with programChanged telling it whether per-program uniforms
+// must be re-sent.
+// prepare binds through GLStateCache and must leave texture unit 0 active
+// with its binding untouched.
+struct DrawPacket {
+    uint64_t sortKey = 0;
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    GLuint texture = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+    size_t indexOffset = 0;
+    // Added to every index, for meshes suballocated from a GeometryPool.
+    GLint baseVertex = 0;
+    // 0 draws a single instance, anything else an instanced draw.
+    GLsizei instanceCount = 0;
+    // First instance in the submitter's instance buffer. prepare turns it
+    // into an attribute offset with RenderQueue::getInstanceByteOffset.
+    GLuint baseInstance = 0;
+    // From RenderQueue::pushObject, or -1 for draws without an ObjectBlock.
+    int objectIndex = -1;
+    // Non-zero for draws whose commands someone else wrote (a compute
+    // pass): indirectDrawCount commands at byte indirectOffset of this
+    // buffer replace the index range and instances above. Only valid with
+    // indirect draws enabled.
+    GLuint indirectBuffer = 0;
+    size_t indirectOffset = 0;
+    GLsizei indirectDrawCount = 0;
+
+    void (*prepare)(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) = nullptr;
+    const void* owner = nullptr;
+    // Free for the submitter: a byte offset into its own buffers or an offset
+    // returned by RenderQueue::pushData.
+    size_t userOffset = 0;
+};
+
+// Layout fixed by GL for glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct RenderQueueStats {
+    int packets = 0;
+    // Packets that differ only in their index range and instances.
+    int batches = 0;
+    // GL draw calls; one per batch with indirect draws.
+    int draws = 0;
+    int programSwitches = 0;
+    int vertexArrayBinds = 0;
+    int textureBinds = 0;
+    int objectBinds = 0;
+};
+
+// Collects draw packets for a frame, sorts them by a 64-bit state key with a
+// radix sort and issues them through GLStateCache, so no glGet* query is
+// needed to save or restore anything.
+//
+// Every packet becomes a DrawElementsIndirectCommand, and runs of packets
+// that share all state but the index range and instances form a batch. With
+// indirect draws enabled (GL 4.3) each batch is one glMultiDrawElementsIndirect
+// from a per-flush command buffer; otherwise the same commands are drawn one
+// by one, calling prepare before each so it can re-point instance attributes.
+class RenderQueue {
+public:
+    // Depths beyond this share the last key value.
+    static constexpr float MAX_SORT_DEPTH = 20000.0f;
+
+    // Key layout, high to low: layer (4 bits), program (12), texture (14),
+    // VAO (14), depth (20). Ids are truncated to their field; that only costs
+    // sort quality since the flush compares the real names.
+    static uint64_t makeSortKey(RenderLayer layer, GLuint program, GLuint texture, GLuint vertexArray,
+                                float depth = 0.0f);
+
+    RenderQueue() = default;
+    ~RenderQueue();
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Resolves glMultiDrawElementsIndirect (GL 4.3, not in the 3.3 loader)
+    // and turns indirect draws on. Returns false on older contexts, which
+    // keep drawing the command list in a loop.
+    bool initializeIndirectDraws(GLADloadfunc load);
+    void setIndirectDraws(bool enabled) { indirectDraws = enabled && multiDrawElementsIndirect; }
+    bool usesIndirectDraws() const { return indirectDraws; }
+    // Where prepare should point per-instance attributes of stride bytes:
+    // the start of the buffer when the command's base instance does the
+    // offsetting, the packet's first instance otherwise.
+    size_t getInstanceByteOffset(const DrawPacket& packet, size_t stride) const {
+        return indirectDraws ? 0 : packet.baseInstance * stride;
+    }
+
+    void begin(const FrameUniforms& uniforms);
+    void submit(const DrawPacket& packet);
+    // Copies per-draw data (matrices, joint palettes) into frame storage and
+    // returns its offset for DrawPacket::userOffset.
+    size_t pushData(const float* data, size_t count);
+    // Adds an ObjectBlock for DrawPacket::objectIndex; draws of the same
+    // object can share it.
+    int pushObject(const glm::mat4& modelMatrix);
+    const float* getData(size_t offset) const { return frameData.data() + offset; }
+    const FrameUniforms& getFrameUniforms() const { return frameUniforms; }
+
+    // Uploads the frame and object blocks, then sorts and draws everything
+    // submitted since begin(). Leaves texture unit 0 active and the
+    // FrameBlock bound for later passes.
+    void flush();
+    void cleanup();
+
+    size_t getPacketCount() const { return packets.size(); }
+    const RenderQueueStats& getStats() const { return stats; }
+
+private:
+    typedef void (GLAD_API_PTR *MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect,
+                                                               GLsizei drawCount, GLsizei stride);
+
+    struct Batch {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    FrameUniforms frameUniforms;
+    std::vector<DrawPacket> packets;
+    std::vector<float> frameData;
+    std::vector<ObjectBlock> objects;
+    RenderQueueStats stats;
+
+    GLuint frameBlockBufferID = 0;
+    GLuint objectBlockBufferID = 0;
+    size_t objectBlockCapacity = 0;
+    // sizeof(ObjectBlock) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+    size_t objectStride = 0;
+    std::vector<unsigned char> objectStaging;
+
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> keysScratch;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> orderScratch;
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<Batch> batches;
+    MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+    bool indirectDraws = false;
+    GLuint indirectBufferID = 0;
+    size_t indirectBufferCapacity = 0;
+
+    void sortPackets();
+    // Fills commands and batches in sorted order.
+    void buildCommands();
+    void uploadUniformBlocks();
+};
+
+#endif
@@ -0,0 +1,393 @@
+#include "shader_library.h"
+#include "shader.h"
+#include "gl_state_cache.h"
+#include "uniform_blocks.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <cstring>
+
+namespace {
+    constexpr GLenum COMPLETION_STATUS_KHR = 0x91B1;
+    constexpr GLuint ALL_COMPILER_THREADS = 0xFFFFFFFF;
+
+    bool readFile(const char* path, std::string& out) {
+        std::ifstream stream(path, std::ios::in);
+        if (!stream.is_open()) {
+            return false;
+        }
+        std::stringstream sstr;
+        sstr << stream.rdbuf();
+        out = sstr.str();
+        return true;
+    }
+
+    bool hasExtension(const char* name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    GLuint compileShader(GLenum type, const std::string& code) {
+        GLuint shader = glCreateShader(type);
+        const char* pointer = code.c_str();
+        glShaderSource(shader, 1, &pointer, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    void printInfoLog(GLuint object, bool isProgram) {
+        GLint length = 0;
+        if (isProgram) {
+            glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+        } else {
+            glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+        }
+        if (length <= 0) {
+            return;
+        }
+        std::vector<char> log(length + 1, '\0');
+        if (isProgram) {
+            glGetProgramInfoLog(object, length, NULL, log.data());
+        } else {
+            glGetShaderInfoLog(object, length, NULL, log.data());
+        }
+        std::cerr << log.data() << std::endl;
+    }
+
+    void bindUniformBlock(GLuint program, const char* name, GLuint binding) {
+        GLuint index = glGetUniformBlockIndex(program, name);
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, index, binding);
+        }
+    }
+}
+
+ShaderLibrary& ShaderLibrary::getInstance() {
+    static ShaderLibrary instance;
+    return instance;
+}
+
+// Drops comments, blank lines and indentation and collapses runs of spaces,
+// keeping line breaks since preprocessor directives depend on them.
+std::string ShaderLibrary::preprocess(const std::string& code) {
+    std::string out;
+    out.reserve(code.size());
+    bool pendingSpace = false;
+    size_t i = 0;
+    while (i < code.size()) {
+        char c = code[i];
+        if (c == '/' && i + 1 < code.size() && code[i + 1] == '/') {
+            while (i < code.size() && code[i] != '\n') {
+                i++;
+            }
+            continue;
+        }
+        if (c == '/' && i + 1 < code.size() && code[i + 1] == '*') {
+            size_t end = code.find("*/", i + 2);
+            i = end == std::string::npos ? code.size() : end + 2;
+            pendingSpace = true;
+            continue;
+        }
+        if (c == '\n' || c == '\r') {
+            if (!out.empty() && out.back() != '\n') {
+                out.push_back('\n');
+            }
+            pendingSpace = false;
+        } else if (c == ' ' || c == '\t') {
+            pendingSpace = true;
+        } else {
+            if (pendingSpace && !out.empty() && out.back() != '\n') {
+                out.push_back(' ');
+            }
+            pendingSpace = false;
+            out.push_back(c);
+        }
+        i++;
+    }
+    return out;
+}
+
+std::string ShaderLibrary::combinedSource(const std::string& vertexCode, const std::string& fragmentCode) {
+    std::string source = preprocess(vertexCode);
+    source.push_back('\0');
+    source += preprocess(fragmentCode);
+    return source;
+}
+
+// 64-bit FNV-1a.
+uint64_t ShaderLibrary::hashSource(const std::string& source) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void ShaderLibrary::initialize(GLADloadfunc load, const std::string& binaryCacheDirectory) {
+    binaryCache.initialize(binaryCacheDirectory, load);
+
+    auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+        load("glMaxShaderCompilerThreadsKHR"));
+    parallelCompile = maxShaderCompilerThreads && hasExtension("GL_KHR_parallel_shader_compile");
+    if (parallelCompile) {
+        maxShaderCompilerThreads(ALL_COMPILER_THREADS);
+    }
+}
+
+ShaderLibrary::Program* ShaderLibrary::find(const std::string& source, uint64_t& key) {
+    // Probe past the rare hash collision.
+    key = hashSource(source);
+    auto it = programs.find(key);
+    while (it != programs.end() && it->second.source != source) {
+        it = programs.find(++key);
+    }
+    return it != programs.end() ? &it->second : nullptr;
+}
+
+void ShaderLibrary::insert(uint64_t key, GLuint id, int references, double compileMs, std::string source) {
+    Program& program = programs[key];
+    program.id = id;
+    program.references = references;
+    program.compileMs = compileMs;
+    program.source = std::move(source);
+    programKeys[id] = key;
+
+    // GLSL 3.30 can't declare block bindings, so they are assigned here.
+    bindUniformBlock(id, "FrameBlock", FRAME_BLOCK_BINDING);
+    bindUniformBlock(id, "ObjectBlock", OBJECT_BLOCK_BINDING);
+}
+
+GLuint ShaderLibrary::acquire(const char* vertexPath, const char* fragmentPath) {
+    std::string vertexCode, fragmentCode;
+    if (!readFile(vertexPath, vertexCode)) {
+        std::cerr << "Vertex shader not found " << vertexPath << std::endl;
+        return 0;
+    }
+    if (!readFile(fragmentPath, fragmentCode)) {
+        std::cerr << "Fragment shader not found " << fragmentPath << std::endl;
+        return 0;
+    }
+
+    GLuint program = acquireFromString(vertexCode, fragmentCode);
+    if (program == 0) {
+        std::cerr << "Failed to build " << vertexPath << " + " << fragmentPath << std::endl;
+    }
+    return program;
+}
+
+GLuint ShaderLibrary::acquireFromString(const std::string& vertexCode, const std::string& fragmentCode) {
+    std::string source = combinedSource(vertexCode, fragmentCode);
+    uint64_t key;
+    if (Program* program = find(source, key)) {
+        program->references++;
+        stats.requestsReused++;
+        stats.savedMs += program->compileMs;
+        return program->id;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    GLuint id = binaryCache.load(key);
+    bool fromBinary = id != 0;
+    if (!fromBinary) {
+        id = LoadShadersFromString(vertexCode, fragmentCode);
+    }
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (id == 0) {
+        return 0;
+    }
+
+    if (fromBinary) {
+        stats.binariesLoaded++;
+        stats.binaryLoadMs += elapsedMs;
+    } else {
+        binaryCache.store(key, id);
+        stats.programsCompiled++;
+        stats.compileMs += elapsedMs;
+    }
+
+    insert(key, id, 1, elapsedMs, std::move(source));
+    return id;
+}
+
+int ShaderLibrary::precompile(const std::vector<ProgramFiles>& files) {
+    struct Pending {
+        const ProgramFiles* files;
+        uint64_t key;
+        std::string source;
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        GLuint program;
+        bool done;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Pending> pending;
+    int available = 0;
+    double loadMs = 0.0;
+
+    // Submit every compile without reading any status back.
+    for (const ProgramFiles& entry : files) {
+        std::string vertexCode, fragmentCode;
+        if (!readFile(entry.vertexPath, vertexCode) || !readFile(entry.fragmentPath, fragmentCode)) {
+            std::cerr << "Shader not found " << entry.vertexPath << " + " << entry.fragmentPath << std::endl;
+            continue;
+        }
+
+        std::string source = combinedSource(vertexCode, fragmentCode);
+        uint64_t key;
+        if (find(source, key)) {
+            available++;
+            continue;
+        }
+        bool queued = false;
+        for (const Pending& other : pending) {
+            queued = queued || other.source == source;
+            if (other.key == key && other.source != source) {
+                key++;
+            }
+        }
+        if (queued) {
+            continue;
+        }
+
+        auto loadStart = std::chrono::steady_clock::now();
+        if (GLuint id = binaryCache.load(key)) {
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+            insert(key, id, 0, elapsedMs, std::move(source));
+            stats.binariesLoaded++;
+            stats.binaryLoadMs += elapsedMs;
+            loadMs += elapsedMs;
+            available++;
+            continue;
+        }
+
+        Pending job = { &entry, key, std::move(source), compileShader(GL_VERTEX_SHADER, vertexCode),
+                        compileShader(GL_FRAGMENT_SHADER, fragmentCode), 0, false };
+        pending.push_back(std::move(job));
+    }
+
+    for (Pending& job : pending) {
+        job.program = glCreateProgram();
+        glAttachShader(job.program, job.vertexShader);
+        glAttachShader(job.program, job.fragmentShader);
+        glLinkProgram(job.program);
+    }
+
+    // Collect results in completion order when the driver can tell us, in
+    // submission order otherwise.
+    size_t remaining = pending.size();
+    int compiled = 0;
+    while (remaining > 0) {
+        for (Pending& job : pending) {
+            if (job.done) {
+                continue;
+            }
+            if (parallelCompile) {
+                GLint complete = GL_FALSE;
+                glGetProgramiv(job.program, COMPLETION_STATUS_KHR, &complete);
+                if (!complete) {
+                    continue;
+                }
+            }
+            job.done = true;
+            remaining--;
+
+            GLint linked = GL_FALSE;
+            glGetProgramiv(job.program, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                std::cerr << "Failed to build " << job.files->vertexPath << " + " << job.files->fragmentPath
+                          << std::endl;
+                printInfoLog(job.vertexShader, false);
+                printInfoLog(job.fragmentShader, false);
+                printInfoLog(job.program, true);
+                glDeleteProgram(job.program);
+            } else {
+                glDetachShader(job.program, job.vertexShader);
+                glDetachShader(job.program, job.fragmentShader);
+                binaryCache.store(job.key, job.program);
+                insert(job.key, job.program, 0, 0.0, std::move(job.source));
+                compiled++;
+                available++;
+            }
+            glDeleteShader(job.vertexShader);
+            glDeleteShader(job.fragmentShader);
+        }
+        if (remaining > 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    elapsedMs = compiled > 0 ? elapsedMs - loadMs : 0.0;
+    stats.programsCompiled += compiled;
+    stats.compileMs += elapsedMs;
+    // Reuses are credited with an even share of the batch.
+    for (Pending& job : pending) {
+        auto it = programs.find(job.key);
+        if (it != programs.end() && it->second.id == job.program) {
+            it->second.compileMs = elapsedMs / std::max(compiled, 1);
+        }
+    }
+
+    if (!pending.empty()) {
+        std::cout << std::fixed << std::setprecision(1) << "[shaders] batch compiled " << compiled << " of "
+                  << pending.size() << " programs in " << elapsedMs << " ms ("
+                  << (parallelCompile ? "parallel" : "serial") << " compile)" << std::endl;
+    }
+    return available;
+}
+
+void ShaderLibrary::release(GLuint id) {
+    auto keyIt = programKeys.find(id);
+    if (keyIt == programKeys.end()) {
+        return;
+    }
+    auto it = programs.find(keyIt->second);
+    if (--it->second.references > 0) {
+        return;
+    }
+    GLStateCache::getInstance().deleteProgram(id);
+    programs.erase(it);
+    programKeys.erase(keyIt);
+}
+
+GLint ShaderLibrary::getUniformLocation(GLuint id, const char* name) {
+    auto keyIt = programKeys.find(id);
+    if (keyIt == programKeys.end()) {
+        return glGetUniformLocation(id, name);
+    }
+
+    auto nameIt = uniformNameIds.find(name);
+    if (nameIt == uniformNameIds.end()) {
+        nameIt = uniformNameIds.emplace(name, static_cast<int>(uniformNameIds.size())).first;
+    }
+    int nameId = nameIt->second;
+
+    std::vector<GLint>& locations = programs[keyIt->second].uniformLocations;
+    if (nameId >= static_cast<int>(locations.size())) {
+        locations.resize(uniformNameIds.size(), LOCATION_UNKNOWN);
+    }
+    if (locations[nameId] == LOCATION_UNKNOWN) {
+        locations[nameId] = glGetUniformLocation(id, name);
+    }
+    return locations[nameId];
+}
+
+void ShaderLibrary::printReport() const {
+    std::cout << std::fixed << std::setprecision(1) << "[shaders] " << stats.programsCompiled
+              << " programs compiled in " << stats.compileMs << " ms, " << stats.binariesLoaded
+              << " loaded from binaries in " << stats.binaryLoadMs << " ms, " << stats.requestsReused
+              << " requests reused, " << stats.savedMs << " ms of compiling saved" << std::endl;
+}
@@ -0,0 +1,92 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/gl.h>
+#include "program_binary_cache.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Owns every linked program in the scene. Programs are keyed by a hash of
+// their preprocessed source (comments stripped, whitespace collapsed), so two
+// requests for the same shaders share one program no matter which files or
+// formatting they came from. Programs are reference counted and deleted when
+// the last user releases them. With the binary cache enabled, programs
+// built in an earlier run are loaded from disk instead of compiled. Every
+// program gets its FrameBlock and ObjectBlock bound to the shared binding
+// points from uniform_blocks.h.
+class ShaderLibrary {
+public:
+    struct ProgramFiles {
+        const char* vertexPath;
+        const char* fragmentPath;
+    };
+
+    struct Stats {
+        int programsCompiled = 0;
+        int requestsReused = 0;
+        int binariesLoaded = 0;
+        double compileMs = 0.0;
+        double binaryLoadMs = 0.0;
+        // Sum of the original compile time of every reused program.
+        double savedMs = 0.0;
+    };
+
+    static ShaderLibrary& getInstance();
+
+    // Call once after the GL loader; load resolves the entry points glad
+    // does not cover (program binaries, parallel compile).
+    void initialize(GLADloadfunc load, const std::string& binaryCacheDirectory);
+
+    // Builds a set of programs in one pass: every shader is compiled and
+    // every program linked before any status is read, so the driver can
+    // overlap the work (on its own threads with GL_KHR_parallel_shader_compile).
+    // The programs stay resident with no references, so the acquire() calls
+    // that follow are hits. Returns how many programs are now available.
+    int precompile(const std::vector<ProgramFiles>& files);
+
+    // Returns 0 if the files can't be read or the program fails to build.
+    GLuint acquire(const char* vertexPath, const char* fragmentPath);
+    GLuint acquireFromString(const std::string& vertexCode, const std::string& fragmentCode);
+    void release(GLuint program);
+
+    // Looked up once per program and name, then served from a flat table.
+    GLint getUniformLocation(GLuint program, const char* name);
+
+    const Stats& getStats() const { return stats; }
+    void printReport() const;
+
+private:
+    static constexpr GLint LOCATION_UNKNOWN = -2;
+
+    typedef void (GLAD_API_PTR *MaxShaderCompilerThreadsProc)(GLuint count);
+
+    struct Program {
+        GLuint id = 0;
+        int references = 0;
+        double compileMs = 0.0;
+        std::string source;
+        // Indexed by uniform name id.
+        std::vector<GLint> uniformLocations;
+    };
+
+    std::unordered_map<uint64_t, Program> programs;
+    std::unordered_map<GLuint, uint64_t> programKeys;
+    std::unordered_map<std::string, int> uniformNameIds;
+    ProgramBinaryCache binaryCache;
+    bool parallelCompile = false;
+    Stats stats;
+
+    ShaderLibrary() = default;
+
+    static std::string preprocess(const std::string& code);
+    static std::string combinedSource(const std::string& vertexCode, const std::string& fragmentCode);
+    static uint64_t hashSource(const std::string& source);
+
+    // Finds the program built from source, or sets key to the free slot for it.
+    Program* find(const std::string& source, uint64_t& key);
+    void insert(uint64_t key, GLuint id, int references, double compileMs, std::string source);
+};
+
+#endif
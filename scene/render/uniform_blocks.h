@@ -0,0 +1,32 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// CPU mirrors of the std140 uniform blocks declared in the shaders. Every
+// program gets its blocks bound to these points when ShaderLibrary builds it.
+static constexpr GLuint FRAME_BLOCK_BINDING = 0;
+static constexpr GLuint OBJECT_BLOCK_BINDING = 1;
+
+// Written once per RenderQueue flush. In std140 a vec3 takes 16 bytes.
+struct FrameBlock {
+    glm::mat4 viewProjectionMatrix;
+    glm::vec3 lightPosition;
+    float padding0;
+    glm::vec3 lightIntensity;
+    float padding1;
+    glm::vec3 viewPosition;
+    float padding2;
+};
+
+// One per non-instanced draw, all packed into a single buffer and selected
+// with glBindBufferRange.
+struct ObjectBlock {
+    glm::mat4 modelMatrix;
+};
+
+static_assert(sizeof(FrameBlock) == 112, "FrameBlock must match the std140 layout");
+static_assert(sizeof(ObjectBlock) == 64, "ObjectBlock must match the std140 layout");
+
+#endif
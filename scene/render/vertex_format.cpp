@@ -0,0 +1,248 @@
+#include "vertex_format.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    size_t componentSize(int componentType) {
+        switch (componentType) {
+            case TINYGLTF_COMPONENT_TYPE_BYTE:
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return 1;
+            case TINYGLTF_COMPONENT_TYPE_SHORT:
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return 2;
+            case TINYGLTF_COMPONENT_TYPE_INT:
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            case TINYGLTF_COMPONENT_TYPE_FLOAT: return 4;
+            default: return 0;
+        }
+    }
+
+    int componentCount(int type) {
+        switch (type) {
+            case TINYGLTF_TYPE_SCALAR: return 1;
+            case TINYGLTF_TYPE_VEC2: return 2;
+            case TINYGLTF_TYPE_VEC3: return 3;
+            case TINYGLTF_TYPE_VEC4: return 4;
+            default: return 0;
+        }
+    }
+
+    template <typename T>
+    T load(const unsigned char* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    // glTF's normalized integer rules: unsigned types divide by their max,
+    // signed types too but clamp so both -128 and -127 map to -1.
+    float readComponent(const unsigned char* data, int componentType, bool normalized) {
+        switch (componentType) {
+            case TINYGLTF_COMPONENT_TYPE_BYTE: {
+                float value = load<int8_t>(data);
+                return normalized ? std::max(value / 127.0f, -1.0f) : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+                float value = load<uint8_t>(data);
+                return normalized ? value / 255.0f : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_SHORT: {
+                float value = load<int16_t>(data);
+                return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                float value = load<uint16_t>(data);
+                return normalized ? value / 65535.0f : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: return static_cast<float>(load<uint32_t>(data));
+            case TINYGLTF_COMPONENT_TYPE_FLOAT: return load<float>(data);
+            default: return 0.0f;
+        }
+    }
+
+    // Reads any vertex accessor as vec4s, missing components left at 0.
+    bool readAttribute(const tinygltf::Model& model, const tinygltf::Accessor& accessor, std::vector<glm::vec4>& out) {
+        size_t size = componentSize(accessor.componentType);
+        int count = componentCount(accessor.type);
+        if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()) ||
+            size == 0 || count == 0) {
+            return false;
+        }
+
+        const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+        const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+        int byteStride = accessor.ByteStride(bufferView);
+        size_t stride = byteStride > 0 ? static_cast<size_t>(byteStride) : size * count;
+        size_t begin = bufferView.byteOffset + accessor.byteOffset;
+        if (accessor.count > 0 && begin + (accessor.count - 1) * stride + size * count > buffer.data.size()) {
+            return false;
+        }
+
+        const unsigned char* data = buffer.data.data() + begin;
+        out.assign(accessor.count, glm::vec4(0.0f));
+        for (size_t i = 0; i < accessor.count; i++) {
+            for (int c = 0; c < count; c++) {
+                out[i][c] = readComponent(data + i * stride + c * size, accessor.componentType, accessor.normalized);
+            }
+        }
+        return true;
+    }
+
+    // Reads the named attribute if the primitive has it; a missing optional
+    // attribute leaves out empty and still succeeds.
+    bool readOptional(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const char* name,
+                      size_t vertexCount, std::vector<glm::vec4>& out) {
+        out.clear();
+        auto it = primitive.attributes.find(name);
+        if (it == primitive.attributes.end()) {
+            return true;
+        }
+        return readAttribute(model, model.accessors[it->second], out) && out.size() == vertexCount;
+    }
+
+    size_t sourceBytesPerVertex(const tinygltf::Model& model, const tinygltf::Primitive& primitive) {
+        size_t bytes = 0;
+        for (const auto& attribute : primitive.attributes) {
+            const tinygltf::Accessor& accessor = model.accessors[attribute.second];
+            bytes += componentSize(accessor.componentType) * componentCount(accessor.type);
+        }
+        return bytes;
+    }
+
+    // Shared part of both packers: position, normal and texture coordinate.
+    template <typename Vertex>
+    bool packCommon(const tinygltf::Model& model, const tinygltf::Primitive& primitive, std::vector<Vertex>& out) {
+        auto positionAttribute = primitive.attributes.find("POSITION");
+        std::vector<glm::vec4> positions, normals, texCoords;
+        if (positionAttribute == primitive.attributes.end() ||
+            !readAttribute(model, model.accessors[positionAttribute->second], positions) ||
+            !readOptional(model, primitive, "NORMAL", positions.size(), normals) ||
+            !readOptional(model, primitive, "TEXCOORD_0", positions.size(), texCoords)) {
+            return false;
+        }
+
+        out.assign(positions.size(), Vertex());
+        for (size_t i = 0; i < positions.size(); i++) {
+            Vertex& vertex = out[i];
+            vertex.position = glm::vec3(positions[i]);
+            vertex.normal = normals.empty() ? 0 : packNormal(glm::vec3(normals[i]));
+            packTexCoord(texCoords.empty() ? glm::vec2(0.0f) : glm::vec2(texCoords[i]), vertex.texCoord);
+        }
+        return true;
+    }
+}
+
+void VertexPackingStats::print() const {
+    if (vertexCount == 0) {
+        return;
+    }
+    std::cout << "  Vertices: " << vertexCount << ", " << sourceBytes / vertexCount << " -> "
+              << packedBytes / vertexCount << " bytes per vertex (" << sourceBytes / 1024 << " KB -> "
+              << packedBytes / 1024 << " KB)" << std::endl;
+}
+
+uint32_t packNormal(const glm::vec3& normal) {
+    float length = glm::length(normal);
+    glm::vec3 unit = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    return glm::packSnorm3x10_1x2(glm::vec4(unit, 0.0f));
+}
+
+void packTexCoord(const glm::vec2& texCoord, uint16_t out[2]) {
+    out[0] = glm::packHalf1x16(texCoord.x);
+    out[1] = glm::packHalf1x16(texCoord.y);
+}
+
+void packWeights(const glm::vec4& weights, uint8_t out[4]) {
+    float sum = weights.x + weights.y + weights.z + weights.w;
+    glm::vec4 normalized = sum > 0.0f ? weights / sum : glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+
+    // Rounding each weight can leave the total off by a few steps; the
+    // largest weight absorbs the difference so skinning keeps its scale.
+    int quantized[4];
+    int total = 0;
+    int largest = 0;
+    for (int c = 0; c < 4; c++) {
+        quantized[c] = static_cast<int>(std::lround(glm::clamp(normalized[c], 0.0f, 1.0f) * 255.0f));
+        total += quantized[c];
+        if (quantized[c] > quantized[largest]) {
+            largest = c;
+        }
+    }
+    quantized[largest] += 255 - total;
+
+    for (int c = 0; c < 4; c++) {
+        out[c] = static_cast<uint8_t>(quantized[c]);
+    }
+}
+
+bool packStaticVertices(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                        std::vector<StaticVertex>& out, VertexPackingStats& stats) {
+    if (!packCommon(model, primitive, out)) {
+        return false;
+    }
+
+    stats.vertexCount += out.size();
+    stats.sourceBytes += out.size() * sourceBytesPerVertex(model, primitive);
+    stats.packedBytes += out.size() * sizeof(StaticVertex);
+    return true;
+}
+
+bool packSkinnedVertices(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                         std::vector<SkinnedVertex>& out, VertexPackingStats& stats) {
+    std::vector<glm::vec4> joints, weights;
+    if (!packCommon(model, primitive, out) ||
+        !readOptional(model, primitive, "JOINTS_0", out.size(), joints) ||
+        !readOptional(model, primitive, "WEIGHTS_0", out.size(), weights)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < out.size(); i++) {
+        SkinnedVertex& vertex = out[i];
+        for (int c = 0; c < 4; c++) {
+            float joint = joints.empty() ? 0.0f : joints[i][c];
+            if (joint < 0.0f || joint > 255.0f) {
+                std::cerr << "Joint index " << joint << " does not fit the packed vertex format" << std::endl;
+                return false;
+            }
+            vertex.joints[c] = static_cast<uint8_t>(joint);
+        }
+        packWeights(weights.empty() ? glm::vec4(0.0f) : weights[i], vertex.weights);
+    }
+
+    stats.vertexCount += out.size();
+    stats.sourceBytes += out.size() * sourceBytesPerVertex(model, primitive);
+    stats.packedBytes += out.size() * sizeof(SkinnedVertex);
+    return true;
+}
+
+bool readIndices(const tinygltf::Model& model, const tinygltf::Accessor& accessor, std::vector<uint32_t>& out) {
+    size_t size = componentSize(accessor.componentType);
+    if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()) ||
+        accessor.type != TINYGLTF_TYPE_SCALAR ||
+        (accessor.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE &&
+         accessor.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT &&
+         accessor.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)) {
+        return false;
+    }
+
+    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+    int byteStride = accessor.ByteStride(bufferView);
+    size_t stride = byteStride > 0 ? static_cast<size_t>(byteStride) : size;
+    size_t begin = bufferView.byteOffset + accessor.byteOffset;
+    if (accessor.count > 0 && begin + (accessor.count - 1) * stride + size > buffer.data.size()) {
+        return false;
+    }
+
+    const unsigned char* data = buffer.data.data() + begin;
+    out.resize(accessor.count);
+    for (size_t i = 0; i < accessor.count; i++) {
+        const unsigned char* element = data + i * stride;
+        if (size == 1) out[i] = *element;
+        else if (size == 2) out[i] = load<uint16_t>(element);
+        else out[i] = load<uint32_t>(element);
+    }
+    return true;
+}
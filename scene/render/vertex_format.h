@@ -0,0 +1,111 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <tinygltf-2.9.3/tiny_gltf.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One attribute of an interleaved vertex: the shader location it feeds, how
+// GL reads it and how many bytes it takes in the stream.
+template <GLuint Location, GLint Components, GLenum Type, GLboolean Normalized, size_t Bytes>
+struct VertexAttribute {
+    static constexpr GLuint location = Location;
+    static constexpr GLint components = Components;
+    static constexpr GLenum type = Type;
+    static constexpr GLboolean normalized = Normalized;
+    static constexpr size_t size = Bytes;
+};
+
+// Compile-time description of an interleaved vertex. Offsets follow the order
+// of the attribute list with no padding, so the matching vertex struct is
+// checked against it with static_asserts below.
+template <typename... Attributes>
+struct VertexLayout {
+    static constexpr size_t stride = (Attributes::size + ... + 0);
+
+    static constexpr size_t offset(size_t index) {
+        constexpr size_t sizes[] = { Attributes::size... };
+        size_t total = 0;
+        for (size_t i = 0; i < index; i++) {
+            total += sizes[i];
+        }
+        return total;
+    }
+
+    // Points every attribute at the buffer bound to GL_ARRAY_BUFFER, with the
+    // first vertex at baseOffset.
+    static void apply(size_t baseOffset = 0) {
+        size_t offset = baseOffset;
+        ((glEnableVertexAttribArray(Attributes::location),
+          glVertexAttribPointer(Attributes::location, Attributes::components, Attributes::type,
+                                Attributes::normalized, static_cast<GLsizei>(stride),
+                                reinterpret_cast<const void*>(offset)),
+          offset += Attributes::size), ...);
+    }
+};
+
+// Positions stay full precision. Normals are signed 10:10:10:2 and texture
+// coordinates half floats (the models use coordinates outside [0, 1]), both
+// expanded by the vertex fetch so the shaders still see vec3/vec2. Joints
+// are plain bytes read as floats and weights unorm8 summing to exactly 255.
+using PositionAttribute = VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 12>;
+using PackedNormalAttribute = VertexAttribute<1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4>;
+using HalfTexCoordAttribute = VertexAttribute<2, 2, GL_HALF_FLOAT, GL_FALSE, 4>;
+using JointsAttribute = VertexAttribute<3, 4, GL_UNSIGNED_BYTE, GL_FALSE, 4>;
+using WeightsAttribute = VertexAttribute<4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4>;
+
+using StaticVertexLayout = VertexLayout<PositionAttribute, PackedNormalAttribute, HalfTexCoordAttribute>;
+using SkinnedVertexLayout = VertexLayout<PositionAttribute, PackedNormalAttribute, HalfTexCoordAttribute,
+                                         JointsAttribute, WeightsAttribute>;
+
+struct StaticVertex {
+    glm::vec3 position;
+    uint32_t normal;
+    uint16_t texCoord[2];
+};
+
+struct SkinnedVertex {
+    glm::vec3 position;
+    uint32_t normal;
+    uint16_t texCoord[2];
+    uint8_t joints[4];
+    uint8_t weights[4];
+};
+
+static_assert(sizeof(StaticVertex) == StaticVertexLayout::stride, "StaticVertex must match its layout");
+static_assert(offsetof(StaticVertex, normal) == StaticVertexLayout::offset(1), "StaticVertex must match its layout");
+static_assert(offsetof(StaticVertex, texCoord) == StaticVertexLayout::offset(2), "StaticVertex must match its layout");
+static_assert(sizeof(SkinnedVertex) == SkinnedVertexLayout::stride, "SkinnedVertex must match its layout");
+static_assert(offsetof(SkinnedVertex, joints) == SkinnedVertexLayout::offset(3), "SkinnedVertex must match its layout");
+static_assert(offsetof(SkinnedVertex, weights) == SkinnedVertexLayout::offset(4), "SkinnedVertex must match its layout");
+
+// Vertex memory of one model before and after packing. sourceBytes counts
+// every glTF attribute the old per-attribute upload would have stored.
+struct VertexPackingStats {
+    size_t vertexCount = 0;
+    size_t sourceBytes = 0;
+    size_t packedBytes = 0;
+
+    void print() const;
+};
+
+uint32_t packNormal(const glm::vec3& normal);
+void packTexCoord(const glm::vec2& texCoord, uint16_t out[2]);
+// Normalizes the weights first; a vertex without weight goes to joint 0.
+void packWeights(const glm::vec4& weights, uint8_t out[4]);
+
+// Repack a glTF primitive into one interleaved stream. They fail when
+// POSITION is missing or an attribute can't be read (or, for skinned
+// vertices, a joint index doesn't fit in a byte).
+bool packStaticVertices(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                        std::vector<StaticVertex>& out, VertexPackingStats& stats);
+bool packSkinnedVertices(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                         std::vector<SkinnedVertex>& out, VertexPackingStats& stats);
+// Widens any glTF index accessor to 32 bits; fails on other component types
+// or data outside the buffer.
+bool readIndices(const tinygltf::Model& model, const tinygltf::Accessor& accessor, std::vector<uint32_t>& out);
+
+#endif
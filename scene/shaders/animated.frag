@@ -5,8 +5,12 @@ in vec3 worldNormal;
 
 out vec3 finalColor;
 
-uniform vec3 lightPosition;
-uniform vec3 lightIntensity;
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
 
 void main()
 {
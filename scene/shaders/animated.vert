@@ -9,7 +9,17 @@ layout(location = 4) in vec4 vertexWeights;
 out vec3 worldPosition;
 out vec3 worldNormal;
 
-uniform mat4 MVP;
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+};
+
 uniform mat4 jointMatrices[100];
 
 void main() {
@@ -21,7 +31,7 @@ void main() {
     vec4 position = skin * vec4(vertexPosition, 1.0);
     vec3 normal = mat3(skin) * vertexNormal;
 
-    gl_Position =  MVP * position;
+    gl_Position = viewProjectionMatrix * modelMatrix * position;
 
     worldPosition = position.xyz;
     worldNormal = normalize(normal);
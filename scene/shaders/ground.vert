@@ -1,19 +1,74 @@
 #version 330 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec2 texCoord;
-layout(location = 3) in vec3 color;
+layout(location = 0) in vec2 gridCoord;
+layout(location = 1) in vec4 chunkInstance;  // origin x, origin z, height tile, LOD
+layout(location = 2) in vec4 neighborLods;   // -x, +x, -z, +z
 
-uniform mat4 MVP;
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
+
+uniform sampler2D heightAtlas;
 
-out vec3 fragColor;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
 
+// Must match terrain.h and GroundPlane.
+const int CELLS = 32;
+const int SAMPLES = CELLS + 3;
+const int TILES_PER_ROW = 32;
+const float CHUNK_SIZE = 1000.0;
+const float CELL_SIZE = CHUNK_SIZE / float(CELLS);
+
+ivec2 tileOrigin;
+
+float heightAt(int x, int z) {
+    return texelFetch(heightAtlas, tileOrigin + ivec2(x + 1, z + 1), 0).r;
+}
+
+// A vertex on an edge shared with a coarser chunk is moved onto that chunk's
+// edge segment, so the two grids meet without cracks.
+float edgeHeight(int fixedCoord, int along, bool alongX, int neighborLod) {
+    int step = 1 << neighborLod;
+    int below = (along / step) * step;
+    int rem = along - below;
+    if (rem == 0) {
+        return alongX ? heightAt(along, fixedCoord) : heightAt(fixedCoord, along);
+    }
+    float t = float(rem) / float(step);
+    float h0 = alongX ? heightAt(below, fixedCoord) : heightAt(fixedCoord, below);
+    float h1 = alongX ? heightAt(below + step, fixedCoord) : heightAt(fixedCoord, below + step);
+    return mix(h0, h1, t);
+}
+
 void main() {
-    gl_Position = MVP * vec4(position, 1.0);
-    fragColor = color;
-    fragNormal = normal;
-    fragTexCoord = texCoord;
-}
\ No newline at end of file
+    int tile = int(chunkInstance.z);
+    tileOrigin = ivec2(tile % TILES_PER_ROW, tile / TILES_PER_ROW) * SAMPLES;
+
+    ivec2 g = ivec2(gridCoord);
+    int lod = int(chunkInstance.w);
+    float height = heightAt(g.x, g.y);
+    if (g.x == 0 && int(neighborLods.x) > lod) {
+        height = edgeHeight(0, g.y, false, int(neighborLods.x));
+    } else if (g.x == CELLS && int(neighborLods.y) > lod) {
+        height = edgeHeight(CELLS, g.y, false, int(neighborLods.y));
+    } else if (g.y == 0 && int(neighborLods.z) > lod) {
+        height = edgeHeight(0, g.x, true, int(neighborLods.z));
+    } else if (g.y == CELLS && int(neighborLods.w) > lod) {
+        height = edgeHeight(CELLS, g.x, true, int(neighborLods.w));
+    }
+
+    vec2 local = gridCoord * CELL_SIZE - 0.5 * CHUNK_SIZE;
+    vec3 worldPosition = vec3(chunkInstance.x + local.x, height, chunkInstance.y + local.y);
+    gl_Position = viewProjectionMatrix * vec4(worldPosition, 1.0);
+
+    // Central differences; the border samples make these continuous across chunks.
+    float dx = heightAt(g.x + 1, g.y) - heightAt(g.x - 1, g.y);
+    float dz = heightAt(g.x, g.y + 1) - heightAt(g.x, g.y - 1);
+    fragNormal = normalize(vec3(-dx, 2.0 * CELL_SIZE, -dz));
+    // Two texture repeats per chunk, continuous across chunk borders.
+    fragTexCoord = worldPosition.xz / 500.0;
+}
@@ -0,0 +1,25 @@
+#version 330 core
+
+in vec2 atlasUV;
+in float fade;
+
+uniform sampler2D textureSampler;
+
+out vec4 finalColor;
+
+float bayer4x4(vec2 fragCoord) {
+    int x = int(mod(fragCoord.x, 4.0));
+    int y = int(mod(fragCoord.y, 4.0));
+    int index = x + y * 4;
+    int pattern[16] = int[16](0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5);
+    return (float(pattern[index]) + 0.5) / 16.0;
+}
+
+void main()
+{
+    vec4 texColor = texture(textureSampler, atlasUV);
+    if (texColor.a < 0.5 || fade < bayer4x4(gl_FragCoord.xy)) {
+        discard;
+    }
+    finalColor = vec4(texColor.rgb, 1.0);
+}
@@ -0,0 +1,60 @@
+#version 330 core
+
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec4 instanceModel0;
+layout(location = 2) in vec4 instanceModel1;
+layout(location = 3) in vec4 instanceModel2;
+layout(location = 4) in vec4 instanceModel3;
+layout(location = 5) in float instanceFade;
+
+uniform mat4 viewProjectionMatrix;
+uniform vec3 viewPosition;
+uniform vec3 boundsCenter;
+uniform float boundsRadius;
+uniform float framesPerSide;
+
+out vec2 atlasUV;
+out float fade;
+
+vec2 signNotZero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 octahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xz;
+    if (n.y < 0.0) {
+        e = (1.0 - abs(n.zx)) * signNotZero(n.xz);
+    }
+    return e;
+}
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    if (n.y < 0.0) {
+        n.xz = (1.0 - abs(n.zx)) * signNotZero(n.xz);
+    }
+    return normalize(n);
+}
+
+void main() {
+    mat4 modelMatrix = mat4(instanceModel0, instanceModel1, instanceModel2, instanceModel3);
+
+    // Pick the baked frame closest to the current view direction in model space.
+    vec3 worldCenter = (modelMatrix * vec4(boundsCenter, 1.0)).xyz;
+    vec3 localDirection = normalize(inverse(mat3(modelMatrix)) * (viewPosition - worldCenter));
+    vec2 grid = (octahedralEncode(localDirection) * 0.5 + 0.5) * framesPerSide;
+    vec2 cell = clamp(floor(grid), vec2(0.0), vec2(framesPerSide - 1.0));
+    vec3 frameDirection = octahedralDecode((cell + 0.5) / framesPerSide * 2.0 - 1.0);
+
+    // Same basis the baker's lookAt used for that frame.
+    vec3 frameUp = abs(frameDirection.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(frameUp, frameDirection));
+    vec3 up = cross(frameDirection, right);
+
+    vec3 localPosition = boundsCenter + (corner.x * right + corner.y * up) * boundsRadius;
+    gl_Position = viewProjectionMatrix * modelMatrix * vec4(localPosition, 1.0);
+
+    atlasUV = (cell + corner * 0.5 + 0.5) / framesPerSide;
+    fade = instanceFade;
+}
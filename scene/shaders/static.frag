@@ -5,10 +5,15 @@ in vec3 worldNormal;
 in vec2 fragTexCoord;
 in vec3 fragColor;
 
-out vec3 finalColor;
+out vec4 finalColor;
+
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
 
-uniform vec3 lightPosition;
-uniform vec3 lightIntensity;
 uniform sampler2D textureSampler;
 
 void main()
@@ -25,5 +30,5 @@ void main()
     vec3 texColor = texture(textureSampler, fragTexCoord).rgb;
     vec3 baseColor = (length(texColor) > 0.1) ? texColor : fragColor;
 
-    finalColor = baseColor * pow(v, vec3(1.0 / 2.2));
+    finalColor = vec4(baseColor * pow(v, vec3(1.0 / 2.2)), 1.0);
 }
\ No newline at end of file
@@ -5,7 +5,16 @@ layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 layout(location = 3) in vec3 color;
 
-uniform mat4 MVP;
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+};
 
 out vec3 worldPosition;
 out vec3 worldNormal;
@@ -13,7 +22,7 @@ out vec2 fragTexCoord;
 out vec3 fragColor;
 
 void main() {
-    gl_Position = MVP * vec4(position, 1.0);
+    gl_Position = viewProjectionMatrix * modelMatrix * vec4(position, 1.0);
 
     worldPosition = position;
     worldNormal = normal;
@@ -0,0 +1,30 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+layout(location = 3) in vec3 color;
+layout(location = 4) in mat4 instanceModelMatrix;
+
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
+
+out vec3 worldPosition;
+out vec3 worldNormal;
+out vec2 fragTexCoord;
+out vec3 fragColor;
+
+// Same outputs as static.vert, with the model matrix taken per instance.
+void main() {
+    gl_Position = viewProjectionMatrix * instanceModelMatrix * vec4(position, 1.0);
+
+    worldPosition = position;
+    worldNormal = normal;
+
+    fragTexCoord = texCoord;
+    fragColor = color;
+}
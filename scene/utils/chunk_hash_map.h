@@ -0,0 +1,178 @@
+#ifndef CHUNK_HASH_MAP_H
+#define CHUNK_HASH_MAP_H
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+inline uint64_t packChunkKey(int x, int z) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+}
+
+// splitmix64 finalizer; spreads the symmetric coordinates of a ring around
+// the origin across the whole table.
+inline uint64_t hashChunkKey(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBull;
+    key ^= key >> 31;
+    return key;
+}
+
+// Open-addressing map from chunk coordinates to V. Entries live densely in
+// one vector, so iteration is a linear walk, and a linear-probed table of
+// indices points into it. Erase swaps the last entry into the hole and uses
+// backward-shift deletion, so there are no tombstones.
+template <typename V>
+class ChunkHashMap {
+public:
+    struct Entry {
+        uint64_t key;
+        V value;
+
+        int getX() const { return static_cast<int32_t>(static_cast<uint32_t>(key >> 32)); }
+        int getZ() const { return static_cast<int32_t>(static_cast<uint32_t>(key)); }
+    };
+
+    ChunkHashMap() { rehash(16); }
+
+    V* find(int x, int z) {
+        int32_t index = findIndex(packChunkKey(x, z));
+        return index >= 0 ? &entries[index].value : nullptr;
+    }
+
+    const V* find(int x, int z) const {
+        int32_t index = findIndex(packChunkKey(x, z));
+        return index >= 0 ? &entries[index].value : nullptr;
+    }
+
+    bool contains(int x, int z) const { return findIndex(packChunkKey(x, z)) >= 0; }
+
+    // Returns the existing value, or a default-constructed one that was just inserted.
+    V& findOrInsert(int x, int z, bool* inserted = nullptr) {
+        uint64_t key = packChunkKey(x, z);
+        int32_t index = findIndex(key);
+        if (inserted) {
+            *inserted = index < 0;
+        }
+        if (index >= 0) {
+            return entries[index].value;
+        }
+
+        if ((entries.size() + 1) * 8 > slots.size() * 7) {
+            rehash(slots.size() * 2);
+        }
+
+        index = static_cast<int32_t>(entries.size());
+        entries.push_back(Entry{ key, V() });
+        slots[probeForEmpty(key)] = index;
+        return entries.back().value;
+    }
+
+    bool erase(int x, int z) {
+        uint64_t key = packChunkKey(x, z);
+        size_t slot = hashChunkKey(key) & mask;
+        while (slots[slot] >= 0 && entries[slots[slot]].key != key) {
+            slot = (slot + 1) & mask;
+        }
+        if (slots[slot] < 0) {
+            return false;
+        }
+
+        int32_t index = slots[slot];
+        removeSlot(slot);
+
+        int32_t last = static_cast<int32_t>(entries.size()) - 1;
+        if (index != last) {
+            slots[slotOf(last)] = index;
+            entries[index] = std::move(entries[last]);
+        }
+        entries.pop_back();
+        return true;
+    }
+
+    void clear() {
+        entries.clear();
+        std::fill(slots.begin(), slots.end(), -1);
+    }
+
+    void reserve(size_t count) {
+        entries.reserve(count);
+        size_t needed = 16;
+        while (needed * 7 < count * 8) {
+            needed *= 2;
+        }
+        if (needed > slots.size()) {
+            rehash(needed);
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    Entry& at(size_t index) { return entries[index]; }
+    const Entry& at(size_t index) const { return entries[index]; }
+
+    typename std::vector<Entry>::iterator begin() { return entries.begin(); }
+    typename std::vector<Entry>::iterator end() { return entries.end(); }
+    typename std::vector<Entry>::const_iterator begin() const { return entries.begin(); }
+    typename std::vector<Entry>::const_iterator end() const { return entries.end(); }
+
+private:
+    std::vector<Entry> entries;
+    std::vector<int32_t> slots;
+    size_t mask = 0;
+
+    int32_t findIndex(uint64_t key) const {
+        size_t slot = hashChunkKey(key) & mask;
+        while (slots[slot] >= 0) {
+            if (entries[slots[slot]].key == key) {
+                return slots[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+        return -1;
+    }
+
+    size_t probeForEmpty(uint64_t key) const {
+        size_t slot = hashChunkKey(key) & mask;
+        while (slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    size_t slotOf(int32_t index) const {
+        size_t slot = hashChunkKey(entries[index].key) & mask;
+        while (slots[slot] != index) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void removeSlot(size_t hole) {
+        slots[hole] = -1;
+        size_t slot = (hole + 1) & mask;
+        while (slots[slot] >= 0) {
+            size_t home = hashChunkKey(entries[slots[slot]].key) & mask;
+            // Move the entry back if the hole lies between its home and its slot.
+            if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+                slots[hole] = slots[slot];
+                slots[slot] = -1;
+                hole = slot;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    void rehash(size_t slotCount) {
+        slots.assign(slotCount, -1);
+        mask = slotCount - 1;
+        for (size_t i = 0; i < entries.size(); i++) {
+            slots[probeForEmpty(entries[i].key)] = static_cast<int32_t>(i);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "chunk_pool.h"
+#include "../entities/chunk.h"
+
+ChunkPool::~ChunkPool() {
+    clear();
+}
+
+std::unique_ptr<Chunk> ChunkPool::acquire(int chunkX, int chunkZ) {
+    if (freeChunks.empty()) {
+        stats.allocations++;
+        return std::make_unique<Chunk>(chunkX, chunkZ);
+    }
+
+    std::unique_ptr<Chunk> chunk = std::move(freeChunks.back());
+    freeChunks.pop_back();
+    chunk->reset(chunkX, chunkZ);
+
+    stats.reuses++;
+    stats.available = freeChunks.size();
+    return chunk;
+}
+
+void ChunkPool::release(std::unique_ptr<Chunk> chunk) {
+    if (!chunk) {
+        return;
+    }
+
+    freeChunks.push_back(std::move(chunk));
+
+    stats.releases++;
+    stats.available = freeChunks.size();
+}
+
+void ChunkPool::reserve(size_t count) {
+    freeChunks.reserve(count);
+}
+
+void ChunkPool::clear() {
+    freeChunks.clear();
+    stats.available = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+class Chunk;
+
+// Keeps evicted chunks, together with their descriptor buffers and model
+// references, so they can be re-seeded for new coordinates instead of being
+// destroyed and re-uploaded. Only used from the GL thread.
+class ChunkPool {
+public:
+    struct Stats {
+        size_t allocations = 0;
+        size_t reuses = 0;
+        size_t releases = 0;
+        size_t available = 0;
+    };
+
+    ChunkPool() = default;
+    ~ChunkPool();
+
+    ChunkPool(const ChunkPool&) = delete;
+    ChunkPool& operator=(const ChunkPool&) = delete;
+
+    std::unique_ptr<Chunk> acquire(int chunkX, int chunkZ);
+    void release(std::unique_ptr<Chunk> chunk);
+    void reserve(size_t count);
+    void clear();
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    std::vector<std::unique_ptr<Chunk>> freeChunks;
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "chunk_worker_pool.h"
+#include "../entities/chunk.h"
+#include "heap_counter.h"
+#include <algorithm>
+
+ChunkWorkerPool::ChunkWorkerPool(unsigned int threadCount) {
+    if (threadCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for (unsigned int i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ChunkWorkerPool::workerLoop, this);
+    }
+}
+
+ChunkWorkerPool::~ChunkWorkerPool() {
+    shutdown();
+}
+
+void ChunkWorkerPool::submit(std::unique_ptr<Chunk> chunk, float priority) {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.push_back({ priority, nextSequence++, std::move(chunk) });
+        std::push_heap(jobs.begin(), jobs.end(), JobOrder());
+    }
+    jobAvailable.notify_one();
+}
+
+void ChunkWorkerPool::collectCompleted(std::vector<std::unique_ptr<Chunk>>& out) {
+    std::lock_guard<std::mutex> lock(completedMutex);
+    for (auto& chunk : completed) {
+        out.push_back(std::move(chunk));
+    }
+    completed.clear();
+}
+
+size_t ChunkWorkerPool::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    return jobs.size() + inFlight;
+}
+
+uint64_t ChunkWorkerPool::getHeapAllocations() const {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    return heapAllocations;
+}
+
+void ChunkWorkerPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+        jobs.clear();
+    }
+    jobAvailable.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void ChunkWorkerPool::workerLoop() {
+    while (true) {
+        std::unique_ptr<Chunk> chunk;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            std::pop_heap(jobs.begin(), jobs.end(), JobOrder());
+            chunk = std::move(jobs.back().chunk);
+            jobs.pop_back();
+            inFlight++;
+        }
+
+        uint64_t allocationsBefore = getThreadHeapAllocations();
+        chunk->generate();
+        uint64_t allocations = getThreadHeapAllocations() - allocationsBefore;
+
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            completed.push_back(std::move(chunk));
+        }
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            inFlight--;
+            heapAllocations += allocations;
+        }
+    }
+}
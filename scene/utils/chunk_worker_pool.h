@@ -0,0 +1,60 @@
+#ifndef CHUNK_WORKER_POOL_H
+#define CHUNK_WORKER_POOL_H
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+class Chunk;
+
+// Runs the CPU half of chunk creation (Chunk::generate) on background threads.
+// Chunks are handed over by value and come back through collectCompleted(), so
+// the GL thread is the only one that ever touches a chunk's GPU resources.
+// Jobs with a lower priority value are generated first; ties keep submit order.
+class ChunkWorkerPool {
+public:
+    explicit ChunkWorkerPool(unsigned int threadCount = 0);
+    ~ChunkWorkerPool();
+
+    ChunkWorkerPool(const ChunkWorkerPool&) = delete;
+    ChunkWorkerPool& operator=(const ChunkWorkerPool&) = delete;
+
+    void submit(std::unique_ptr<Chunk> chunk, float priority = 0.0f);
+    void collectCompleted(std::vector<std::unique_ptr<Chunk>>& out);
+    void shutdown();
+
+    size_t getPendingCount() const;
+    // Heap allocations made by Chunk::generate on the worker threads.
+    uint64_t getHeapAllocations() const;
+
+private:
+    struct Job {
+        float priority;
+        uint64_t sequence;
+        std::unique_ptr<Chunk> chunk;
+    };
+
+    struct JobOrder {
+        bool operator()(const Job& a, const Job& b) const {
+            return a.priority > b.priority || (a.priority == b.priority && a.sequence > b.sequence);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Job> jobs;
+    uint64_t nextSequence = 0;
+    std::vector<std::unique_ptr<Chunk>> completed;
+
+    mutable std::mutex jobMutex;
+    std::mutex completedMutex;
+    std::condition_variable jobAvailable;
+    size_t inFlight = 0;
+    uint64_t heapAllocations = 0;
+    bool stopping = false;
+
+    void workerLoop();
+};
+
+#endif
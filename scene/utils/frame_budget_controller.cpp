@@ -0,0 +1,122 @@
+#include "frame_budget_controller.h"
+#include <algorithm>
+
+static constexpr float SMOOTHING = 0.1f;
+static constexpr float MIN_DETAIL_SCALE = 0.5f;
+static constexpr float DETAIL_RATE = 0.5f;
+static constexpr float OVER_BUDGET = 1.1f;
+static constexpr float FAR_OVER_BUDGET = 1.3f;
+static constexpr float UNDER_BUDGET = 0.75f;
+static constexpr float SHRINK_AFTER_SECONDS = 0.5f;
+static constexpr float GROW_AFTER_SECONDS = 2.0f;
+// Streaming a new ring costs time of its own, so let it settle before judging.
+static constexpr float COOLDOWN_SECONDS = 1.5f;
+
+FrameBudgetController::FrameBudgetController() {
+}
+
+FrameBudgetController::~FrameBudgetController() {
+    cleanup();
+}
+
+void FrameBudgetController::initialize(int initialRadius, int minimumRadius, int maximumRadius) {
+    minRadius = minimumRadius;
+    maxRadius = maximumRadius;
+    radius = std::max(minRadius, std::min(initialRadius, maxRadius));
+
+    glGenQueries(QUERY_COUNT, queries);
+}
+
+void FrameBudgetController::cleanup() {
+    if (queries[0]) {
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+    std::fill(std::begin(queries), std::end(queries), 0);
+    std::fill(std::begin(queryIssued), std::end(queryIssued), false);
+}
+
+void FrameBudgetController::beginFrame() {
+    frameStart = std::chrono::steady_clock::now();
+    if (queries[0]) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[queryIndex]);
+    }
+}
+
+void FrameBudgetController::readGpuTime() {
+    // The slot about to be reused holds the oldest query.
+    int oldest = (queryIndex + 1) % QUERY_COUNT;
+    if (!queryIssued[oldest]) {
+        return;
+    }
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return;
+    }
+
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &nanoseconds);
+    queryIssued[oldest] = false;
+
+    float sample = static_cast<float>(nanoseconds) / 1.0e6f;
+    gpuMs = hasSample ? gpuMs + (sample - gpuMs) * SMOOTHING : sample;
+}
+
+void FrameBudgetController::endFrame(float deltaTime) {
+    if (queries[0]) {
+        glEndQuery(GL_TIME_ELAPSED);
+        queryIssued[queryIndex] = true;
+        readGpuTime();
+        queryIndex = (queryIndex + 1) % QUERY_COUNT;
+    }
+
+    std::chrono::duration<float, std::milli> cpuElapsed = std::chrono::steady_clock::now() - frameStart;
+    cpuMs = hasSample ? cpuMs + (cpuElapsed.count() - cpuMs) * SMOOTHING : cpuElapsed.count();
+    hasSample = true;
+
+    elapsedTime += deltaTime;
+    cooldown = std::max(cooldown - deltaTime, 0.0f);
+
+    float pressure = std::max(cpuMs, gpuMs) / targetFrameMs;
+
+    if (pressure > OVER_BUDGET) {
+        overBudgetTime += deltaTime;
+        underBudgetTime = 0.0f;
+        detailScale = std::max(detailScale - (pressure - 1.0f) * DETAIL_RATE * deltaTime, MIN_DETAIL_SCALE);
+    }
+    else if (pressure < UNDER_BUDGET) {
+        underBudgetTime += deltaTime;
+        overBudgetTime = 0.0f;
+        detailScale = std::min(detailScale + (1.0f - pressure) * DETAIL_RATE * deltaTime, 1.0f);
+    }
+    else {
+        overBudgetTime = 0.0f;
+        underBudgetTime = 0.0f;
+    }
+
+    if (cooldown > 0.0f) {
+        return;
+    }
+
+    bool detailExhausted = detailScale <= MIN_DETAIL_SCALE;
+    if (overBudgetTime >= SHRINK_AFTER_SECONDS && (detailExhausted || pressure > FAR_OVER_BUDGET) &&
+        radius > minRadius) {
+        changeRadius(radius - 1, "over budget");
+    }
+    else if (underBudgetTime >= GROW_AFTER_SECONDS && detailScale >= 1.0f && radius < maxRadius) {
+        changeRadius(radius + 1, "headroom");
+    }
+}
+
+void FrameBudgetController::changeRadius(int newRadius, const char* reason) {
+    lastDecision = { elapsedTime, radius, newRadius, detailScale, cpuMs, gpuMs, reason };
+    radius = newRadius;
+    overBudgetTime = 0.0f;
+    underBudgetTime = 0.0f;
+    cooldown = COOLDOWN_SECONDS;
+
+    if (onDecision) {
+        onDecision(lastDecision);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef FRAME_BUDGET_CONTROLLER_H
+#define FRAME_BUDGET_CONTROLLER_H
+#include <glad/gl.h>
+#include <chrono>
+#include <functional>
+
+// Holds the frame time near a target by trading view distance for speed.
+// CPU time is taken from beginFrame() to endFrame() and GPU time from a ring
+// of GL_TIME_ELAPSED queries read back a few frames late so the CPU never
+// waits on them. Small overshoots are absorbed by lowering the prop detail
+// scale; sustained ones step the chunk radius down, and headroom steps it
+// back up once detail is fully restored.
+class FrameBudgetController {
+public:
+    struct Decision {
+        float time;
+        int previousRadius;
+        int radius;
+        float detailScale;
+        float cpuMs;
+        float gpuMs;
+        const char* reason;
+    };
+
+    FrameBudgetController();
+    ~FrameBudgetController();
+
+    FrameBudgetController(const FrameBudgetController&) = delete;
+    FrameBudgetController& operator=(const FrameBudgetController&) = delete;
+
+    void initialize(int initialRadius, int minRadius, int maxRadius);
+    void cleanup();
+
+    void setTargetFrameMs(float ms) { targetFrameMs = ms; }
+    float getTargetFrameMs() const { return targetFrameMs; }
+    void setDecisionCallback(std::function<void(const Decision&)> callback) { onDecision = callback; }
+
+    void beginFrame();
+    void endFrame(float deltaTime);
+
+    int getRadius() const { return radius; }
+    float getDetailScale() const { return detailScale; }
+    float getCpuMs() const { return cpuMs; }
+    float getGpuMs() const { return gpuMs; }
+    const Decision& getLastDecision() const { return lastDecision; }
+
+private:
+    static constexpr int QUERY_COUNT = 4;
+
+    GLuint queries[QUERY_COUNT] = {};
+    bool queryIssued[QUERY_COUNT] = {};
+    int queryIndex = 0;
+    std::chrono::steady_clock::time_point frameStart;
+
+    float targetFrameMs = 1000.0f / 60.0f;
+    float cpuMs = 0.0f;
+    float gpuMs = 0.0f;
+    bool hasSample = false;
+
+    int radius = 7;
+    int minRadius = 2;
+    int maxRadius = 12;
+    float detailScale = 1.0f;
+
+    float elapsedTime = 0.0f;
+    float overBudgetTime = 0.0f;
+    float underBudgetTime = 0.0f;
+    float cooldown = 0.0f;
+
+    Decision lastDecision = {};
+    std::function<void(const Decision&)> onDecision;
+
+    void readGpuTime();
+    void changeRadius(int newRadius, const char* reason);
+};
+
+#endif
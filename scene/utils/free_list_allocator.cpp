@@ -0,0 +1,91 @@
+#include "free_list_allocator.h"
+#include <algorithm>
+
+FreeListAllocator::FreeListAllocator(size_t capacity) {
+    grow(capacity);
+}
+
+size_t FreeListAllocator::allocate(size_t size, size_t alignment) {
+    if (size == 0 || alignment == 0) {
+        return INVALID_OFFSET;
+    }
+
+    for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+        size_t blockOffset = it->first;
+        size_t blockEnd = blockOffset + it->second;
+        size_t offset = (blockOffset + alignment - 1) / alignment * alignment;
+        if (offset + size > blockEnd) {
+            continue;
+        }
+
+        freeBlocks.erase(it);
+        if (offset > blockOffset) {
+            freeBlocks[blockOffset] = offset - blockOffset;
+        }
+        if (offset + size < blockEnd) {
+            freeBlocks[offset + size] = blockEnd - (offset + size);
+        }
+        allocations[offset] = size;
+        used += size;
+        return offset;
+    }
+    return INVALID_OFFSET;
+}
+
+void FreeListAllocator::free(size_t offset) {
+    auto allocation = allocations.find(offset);
+    if (allocation == allocations.end()) {
+        return;
+    }
+    size_t size = allocation->second;
+    allocations.erase(allocation);
+    used -= size;
+
+    auto next = freeBlocks.lower_bound(offset);
+    if (next != freeBlocks.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeBlocks.erase(next);
+    }
+    if (next != freeBlocks.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    freeBlocks[offset] = size;
+}
+
+void FreeListAllocator::grow(size_t newCapacity) {
+    if (newCapacity <= capacity) {
+        return;
+    }
+
+    size_t added = newCapacity - capacity;
+    if (!freeBlocks.empty()) {
+        auto last = std::prev(freeBlocks.end());
+        if (last->first + last->second == capacity) {
+            last->second += added;
+            capacity = newCapacity;
+            return;
+        }
+    }
+    freeBlocks[capacity] = added;
+    capacity = newCapacity;
+}
+
+size_t FreeListAllocator::getLargestFreeBlock() const {
+    size_t largest = 0;
+    for (const auto& block : freeBlocks) {
+        largest = std::max(largest, block.second);
+    }
+    return largest;
+}
+
+float FreeListAllocator::getFragmentation() const {
+    size_t freeSpace = capacity - used;
+    if (freeSpace == 0) {
+        return 0.0f;
+    }
+    return 1.0f - static_cast<float>(getLargestFreeBlock()) / static_cast<float>(freeSpace);
+}
@@ -0,0 +1,39 @@
+#ifndef FREE_LIST_ALLOCATOR_H
+#define FREE_LIST_ALLOCATOR_H
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+
+// Hands out ranges of [0, capacity) in abstract units (vertices, bytes, ...).
+// Free space is kept as an offset-ordered list of blocks, allocation is first
+// fit, and freed ranges are merged with their free neighbours. It only does
+// the bookkeeping; the owner moves the data when it grows the range.
+class FreeListAllocator {
+public:
+    static constexpr size_t INVALID_OFFSET = static_cast<size_t>(-1);
+
+    explicit FreeListAllocator(size_t capacity = 0);
+
+    // Returns INVALID_OFFSET when no free block can hold size at the
+    // requested alignment. Alignment padding stays in the free list.
+    size_t allocate(size_t size, size_t alignment = 1);
+    void free(size_t offset);
+    // New space at the end merges with a free block that touches it.
+    void grow(size_t newCapacity);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+    size_t getAllocationCount() const { return allocations.size(); }
+    size_t getFreeBlockCount() const { return freeBlocks.size(); }
+    size_t getLargestFreeBlock() const;
+    // 0 while the free space is one block, approaching 1 as it splinters.
+    float getFragmentation() const;
+
+private:
+    std::map<size_t, size_t> freeBlocks;
+    std::unordered_map<size_t, size_t> allocations;
+    size_t capacity = 0;
+    size_t used = 0;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "heap_counter.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+    // Zero-initialized, so it is safe to touch from allocations made before
+    // main or while a thread starts up.
+    thread_local uint64_t threadAllocations = 0;
+
+    void* allocate(std::size_t size) {
+        threadAllocations++;
+        return std::malloc(size > 0 ? size : 1);
+    }
+}
+
+uint64_t getThreadHeapAllocations() {
+    return threadAllocations;
+}
+
+void* operator new(std::size_t size) {
+    void* memory = allocate(size);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
@@ -0,0 +1,19 @@
+#ifndef HEAP_COUNTER_H
+#define HEAP_COUNTER_H
+#include <cstdint>
+
+// Counts heap allocations per thread, so reading the count before and after a
+// piece of code shows whether it allocated. Only built with the CMake option
+// WONDERLAND_COUNT_HEAP_ALLOCATIONS, because heap_counter.cpp replaces the
+// global operator new; otherwise the count is always zero and
+// HEAP_COUNTING_AVAILABLE says so. Over-aligned new is not counted; nothing
+// in the scene asks for more than the default alignment.
+#ifdef WONDERLAND_COUNT_HEAP_ALLOCATIONS
+constexpr bool HEAP_COUNTING_AVAILABLE = true;
+uint64_t getThreadHeapAllocations();
+#else
+constexpr bool HEAP_COUNTING_AVAILABLE = false;
+inline uint64_t getThreadHeapAllocations() { return 0; }
+#endif
+
+#endif
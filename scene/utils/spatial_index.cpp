@@ -0,0 +1,276 @@
+#include "spatial_index.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    int childIndexFor(const glm::vec2& nodeCenter, const glm::vec2& point) {
+        return (point.x >= nodeCenter.x ? 1 : 0) | (point.y >= nodeCenter.y ? 2 : 0);
+    }
+
+    glm::vec2 childCenter(const glm::vec2& nodeCenter, float halfSize, int childIndex) {
+        float offset = halfSize * 0.5f;
+        return nodeCenter + glm::vec2((childIndex & 1) ? offset : -offset,
+                                      (childIndex & 2) ? offset : -offset);
+    }
+
+    bool sphereIntersectsBox(const glm::vec3& center, float radiusSquared, const AABB& box) {
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 delta = closest - center;
+        return glm::dot(delta, delta) <= radiusSquared;
+    }
+
+    bool rayIntersectsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+                          const AABB& box) {
+        glm::vec3 t0 = (box.min - origin) * inverseDirection;
+        glm::vec3 t1 = (box.max - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+        return enter <= exit;
+    }
+}
+
+SpatialIndex::SpatialIndex(float rootHalfSize, float minNodeHalfSize)
+    : initialHalfSize(rootHalfSize), minHalfSize(minNodeHalfSize) {
+}
+
+int32_t SpatialIndex::allocateNode(const glm::vec2& center, float halfSize, int32_t parent) {
+    int32_t index;
+    if (!freeNodes.empty()) {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else {
+        index = static_cast<int32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    Node& node = nodes[index];
+    node.center = center;
+    node.halfSize = halfSize;
+    node.minY = 1e30f;
+    node.maxY = -1e30f;
+    node.parent = parent;
+    std::fill(std::begin(node.children), std::end(node.children), -1);
+    node.subtreeCount = 0;
+    node.items.clear();
+    return index;
+}
+
+void SpatialIndex::releaseNode(int32_t nodeIndex) {
+    nodes[nodeIndex].items.clear();
+    freeNodes.push_back(nodeIndex);
+}
+
+void SpatialIndex::growRootToContain(const glm::vec2& center, float extent) {
+    if (root < 0) {
+        root = allocateNode(glm::vec2(0.0f), initialHalfSize, -1);
+    }
+
+    while (true) {
+        const Node& current = nodes[root];
+        if (std::fabs(center.x - current.center.x) <= current.halfSize &&
+            std::fabs(center.y - current.center.y) <= current.halfSize &&
+            extent <= current.halfSize) {
+            return;
+        }
+
+        // Double the root towards the item; the old root becomes one quadrant.
+        float halfSize = current.halfSize;
+        glm::vec2 direction(center.x >= current.center.x ? 1.0f : -1.0f,
+                            center.y >= current.center.y ? 1.0f : -1.0f);
+        glm::vec2 oldCenter = current.center;
+        uint32_t oldCount = current.subtreeCount;
+        float oldMinY = current.minY;
+        float oldMaxY = current.maxY;
+
+        int32_t newRoot = allocateNode(oldCenter + direction * halfSize, halfSize * 2.0f, -1);
+        Node& grown = nodes[newRoot];
+        grown.children[childIndexFor(grown.center, oldCenter)] = root;
+        grown.subtreeCount = oldCount;
+        grown.minY = oldMinY;
+        grown.maxY = oldMaxY;
+
+        nodes[root].parent = newRoot;
+        root = newRoot;
+    }
+}
+
+int32_t SpatialIndex::findInsertNode(const glm::vec2& center, float extent) {
+    int32_t nodeIndex = root;
+    while (true) {
+        float childHalfSize = nodes[nodeIndex].halfSize * 0.5f;
+        if (nodes[nodeIndex].items.size() < MAX_NODE_ITEMS || childHalfSize < minHalfSize ||
+            extent > childHalfSize) {
+            return nodeIndex;
+        }
+
+        int childIndex = childIndexFor(nodes[nodeIndex].center, center);
+        int32_t child = nodes[nodeIndex].children[childIndex];
+        if (child < 0) {
+            glm::vec2 newCenter = childCenter(nodes[nodeIndex].center, nodes[nodeIndex].halfSize, childIndex);
+            child = allocateNode(newCenter, childHalfSize, nodeIndex);
+            nodes[nodeIndex].children[childIndex] = child;
+        }
+        nodeIndex = child;
+    }
+}
+
+SpatialIndex::Handle SpatialIndex::insert(const AABB& bounds, uint64_t userData) {
+    glm::vec3 boundsCenter = bounds.getCenter();
+    glm::vec3 boundsExtents = bounds.getExtents();
+    glm::vec2 center(boundsCenter.x, boundsCenter.z);
+    float extent = std::max(boundsExtents.x, boundsExtents.z);
+
+    growRootToContain(center, extent);
+    int32_t nodeIndex = findInsertNode(center, extent);
+
+    Handle handle;
+    if (!freeEntries.empty()) {
+        handle = freeEntries.back();
+        freeEntries.pop_back();
+    }
+    else {
+        handle = static_cast<Handle>(entries.size());
+        entries.emplace_back();
+    }
+
+    Entry& entry = entries[handle];
+    entry.bounds = bounds;
+    entry.userData = userData;
+    entry.node = nodeIndex;
+    entry.slot = static_cast<uint32_t>(nodes[nodeIndex].items.size());
+    nodes[nodeIndex].items.push_back({ bounds, handle });
+
+    for (int32_t n = nodeIndex; n >= 0; n = nodes[n].parent) {
+        nodes[n].subtreeCount++;
+        nodes[n].minY = std::min(nodes[n].minY, bounds.min.y);
+        nodes[n].maxY = std::max(nodes[n].maxY, bounds.max.y);
+    }
+
+    liveCount++;
+    return handle;
+}
+
+void SpatialIndex::remove(Handle handle) {
+    if (handle >= entries.size() || entries[handle].node < 0) {
+        return;
+    }
+
+    Entry& entry = entries[handle];
+    int32_t nodeIndex = entry.node;
+    std::vector<NodeItem>& items = nodes[nodeIndex].items;
+
+    items[entry.slot] = items.back();
+    entries[items[entry.slot].handle].slot = entry.slot;
+    items.pop_back();
+
+    for (int32_t n = nodeIndex; n >= 0; n = nodes[n].parent) {
+        nodes[n].subtreeCount--;
+    }
+
+    // Empty nodes never have children, so pruning can walk straight up.
+    while (nodeIndex != root && nodes[nodeIndex].subtreeCount == 0) {
+        int32_t parent = nodes[nodeIndex].parent;
+        for (auto& child : nodes[parent].children) {
+            if (child == nodeIndex) {
+                child = -1;
+            }
+        }
+        releaseNode(nodeIndex);
+        nodeIndex = parent;
+    }
+
+    entry.node = -1;
+    freeEntries.push_back(handle);
+    liveCount--;
+}
+
+void SpatialIndex::clear() {
+    nodes.clear();
+    freeNodes.clear();
+    entries.clear();
+    freeEntries.clear();
+    root = -1;
+    liveCount = 0;
+}
+
+AABB SpatialIndex::looseBounds(const Node& node) const {
+    float looseSize = node.halfSize * 2.0f;
+    return AABB(glm::vec3(node.center.x - looseSize, node.minY, node.center.y - looseSize),
+                glm::vec3(node.center.x + looseSize, node.maxY, node.center.y + looseSize));
+}
+
+template <typename NodeTest, typename NodeInside, typename ItemTest>
+void SpatialIndex::query(NodeTest nodeTest, NodeInside nodeInside, ItemTest itemTest,
+                         std::vector<Handle>& out) const {
+    if (root < 0) {
+        return;
+    }
+
+    // The root grows without bound, so the depth is not fixed; the stack is
+    // kept between queries so it only allocates when the tree gets deeper.
+    // Nodes already known to be inside are pushed as ~index.
+    queryStack.clear();
+    queryStack.push_back(root);
+
+    while (!queryStack.empty()) {
+        int32_t entry = queryStack.back();
+        queryStack.pop_back();
+        bool inside = entry < 0;
+        const Node& node = nodes[inside ? ~entry : entry];
+        if (node.subtreeCount == 0) {
+            continue;
+        }
+        if (!inside) {
+            AABB bounds = looseBounds(node);
+            if (!nodeTest(bounds)) {
+                continue;
+            }
+            inside = nodeInside(bounds);
+        }
+
+        for (const NodeItem& item : node.items) {
+            if (inside || itemTest(item.bounds)) {
+                out.push_back(item.handle);
+            }
+        }
+
+        for (int32_t child : node.children) {
+            if (child >= 0) {
+                queryStack.push_back(inside ? ~child : child);
+            }
+        }
+    }
+}
+
+void SpatialIndex::queryFrustum(const Frustum& frustum, std::vector<Handle>& out) const {
+    auto test = [&frustum](const AABB& box) { return frustum.intersects(box); };
+    auto inside = [&frustum](const AABB& box) { return frustum.contains(box); };
+    query(test, inside, test, out);
+}
+
+void SpatialIndex::querySphere(const glm::vec3& center, float radius, std::vector<Handle>& out) const {
+    float radiusSquared = radius * radius;
+    auto test = [&center, radiusSquared](const AABB& box) {
+        return sphereIntersectsBox(center, radiusSquared, box);
+    };
+    auto inside = [&center, radiusSquared](const AABB& box) {
+        glm::vec3 farthest = glm::max(glm::abs(box.min - center), glm::abs(box.max - center));
+        return glm::dot(farthest, farthest) <= radiusSquared;
+    };
+    query(test, inside, test, out);
+}
+
+void SpatialIndex::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                            std::vector<Handle>& out) const {
+    glm::vec3 inverseDirection = 1.0f / direction;
+    auto test = [&origin, &inverseDirection, maxDistance](const AABB& box) {
+        return rayIntersectsBox(origin, inverseDirection, maxDistance, box);
+    };
+    // A ray never contains a box.
+    auto inside = [](const AABB&) { return false; };
+    query(test, inside, test, out);
+}
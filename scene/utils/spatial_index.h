@@ -0,0 +1,84 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "../render/frustum.h"
+
+// Loose quadtree over the XZ plane. An item goes into the first node on its
+// way down that has room (MAX_NODE_ITEMS) and whose loose bounds (twice the
+// node size) contain it, so the tree deepens where items are dense and an
+// insert or remove never has to split an item across nodes. Items too big
+// for a child, or under a node at the size floor, stay above the limit. The
+// root grows outwards when an item lands outside it, which suits a world
+// that streams in any direction.
+class SpatialIndex {
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = 0xffffffffu;
+    static constexpr size_t MAX_NODE_ITEMS = 24;
+
+    explicit SpatialIndex(float rootHalfSize = 8000.0f, float minNodeHalfSize = 8.0f);
+
+    Handle insert(const AABB& bounds, uint64_t userData);
+    void remove(Handle handle);
+    void clear();
+
+    void queryFrustum(const Frustum& frustum, std::vector<Handle>& out) const;
+    void querySphere(const glm::vec3& center, float radius, std::vector<Handle>& out) const;
+    void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                  std::vector<Handle>& out) const;
+
+    const AABB& getBounds(Handle handle) const { return entries[handle].bounds; }
+    uint64_t getUserData(Handle handle) const { return entries[handle].userData; }
+    size_t size() const { return liveCount; }
+    size_t getNodeCount() const { return nodes.size() - freeNodes.size(); }
+
+private:
+    // Items keep a copy of their bounds so a query reads only the node.
+    struct NodeItem {
+        AABB bounds;
+        Handle handle;
+    };
+
+    struct Node {
+        glm::vec2 center;
+        float halfSize = 0.0f;
+        float minY = 1e30f;
+        float maxY = -1e30f;
+        int32_t parent = -1;
+        int32_t children[4] = { -1, -1, -1, -1 };
+        uint32_t subtreeCount = 0;
+        std::vector<NodeItem> items;
+    };
+
+    struct Entry {
+        AABB bounds;
+        uint64_t userData = 0;
+        int32_t node = -1;
+        uint32_t slot = 0;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int32_t> freeNodes;
+    std::vector<Entry> entries;
+    std::vector<Handle> freeEntries;
+    int32_t root = -1;
+    size_t liveCount = 0;
+    float initialHalfSize;
+    float minHalfSize;
+    mutable std::vector<int32_t> queryStack;
+
+    int32_t allocateNode(const glm::vec2& center, float halfSize, int32_t parent);
+    void releaseNode(int32_t nodeIndex);
+    void growRootToContain(const glm::vec2& center, float extent);
+    int32_t findInsertNode(const glm::vec2& center, float extent);
+    AABB looseBounds(const Node& node) const;
+
+    // nodeInside says a node's loose bounds are wholly inside the query, so
+    // its whole subtree is taken without testing the items.
+    template <typename NodeTest, typename NodeInside, typename ItemTest>
+    void query(NodeTest nodeTest, NodeInside nodeInside, ItemTest itemTest, std::vector<Handle>& out) const;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "texture_manager.h"
+#include "../render/gl_state_cache.h"
 #include <tinygltf-2.9.3/stb_image.h>
 #include <iostream>
 
@@ -25,9 +26,9 @@ GLuint TextureManager::loadTextureFromFile(const std::string& path) {
     int w, h, channels;
     stbi_set_flip_vertically_on_load(true);
     uint8_t* img = stbi_load(path.c_str(), &w, &h, &channels, 0);
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    GLStateCache& glState = GLStateCache::getInstance();
+    GLuint texture = glState.genTexture();
+    glState.bindTextureUnit(0, GL_TEXTURE_2D, texture);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
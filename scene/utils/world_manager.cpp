@@ -1,18 +1,176 @@
 #include "world_manager.h"
 #include "../entities/chunk.h"
+#include "../render/gl_state_cache.h"
+#include "heap_counter.h"
+#include <chrono>
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 
-static constexpr int CHUNK_RADIUS = 7;
+static constexpr int UNLOAD_HYSTERESIS = 1;
+
+// Height tiles the ground atlas starts with: the full unload ring at the
+// largest radius, plus what prefetching can add on top of it. Each chunk
+// step along the path adds at most an L of 4R + 1 cells, for up to R steps.
+static constexpr int RING_SIDE = 2 * (WorldManager::MAX_CHUNK_RADIUS + UNLOAD_HYSTERESIS) + 1;
+static constexpr int HEIGHT_TILE_CAPACITY =
+    RING_SIDE * RING_SIDE + WorldManager::MAX_CHUNK_RADIUS * (4 * WorldManager::MAX_CHUNK_RADIUS + 1);
+
+static constexpr float VELOCITY_SMOOTHING_SECONDS = 0.3f;
+static constexpr float PREFETCH_MIN_SPEED = 100.0f;
+static constexpr float PREFETCH_GRACE_SECONDS = 1.0f;
+
+// Horizontal distance from the camera to the nearest point of a chunk at
+// which its terrain drops to the next LOD.
+static constexpr float TERRAIN_LOD_DISTANCES[TERRAIN_MAX_LOD] = { 1500.0f, 3500.0f, 7000.0f };
+
+static constexpr int IMPOSTOR_FRAMES_PER_SIDE = 8;
+static constexpr int IMPOSTOR_FRAME_SIZE = 128;
+
+struct ImpostorSource {
+    const char* modelPath;
+    const char* atlasPath;
+};
+
+static const ImpostorSource IMPOSTOR_SOURCES[] = {
+    { TREE_MODEL_PATH, "../scene/textures/impostor_fir_tree.png" },
+    { CANE_MODEL_PATH, "../scene/textures/impostor_candy_cane.png" },
+    { SNOWMAN_MODEL_PATH, "../scene/textures/impostor_snowman.png" },
+};
+
+namespace {
+    struct ChunkRect {
+        int minX, maxX, minZ, maxZ;
+
+        bool contains(int x, int z) const {
+            return x >= minX && x <= maxX && z >= minZ && z <= maxZ;
+        }
+    };
+
+    // Depends only on the chunk and the camera, so a chunk and its neighbours
+    // agree on each other's LOD without sharing state.
+    int terrainLodFor(int chunkX, int chunkZ, const glm::vec3& viewPosition) {
+        float halfSize = Chunk::SIZE * 0.5f;
+        float dx = std::max(std::abs(viewPosition.x - chunkX * Chunk::SIZE) - halfSize, 0.0f);
+        float dz = std::max(std::abs(viewPosition.z - chunkZ * Chunk::SIZE) - halfSize, 0.0f);
+        float distance = std::sqrt(dx * dx + dz * dz);
+        int lod = 0;
+        while (lod < TERRAIN_MAX_LOD && distance > TERRAIN_LOD_DISTANCES[lod]) {
+            lod++;
+        }
+        return lod;
+    }
+
+    // Distance from a point to the farthest corner of a box.
+    float farthestDistance(const AABB& box, const glm::vec3& point) {
+        return glm::length(glm::max(glm::abs(box.min - point), glm::abs(box.max - point)));
+    }
+
+    ChunkRect rectAround(int centerX, int centerZ, int radius) {
+        return { centerX - radius, centerX + radius, centerZ - radius, centerZ + radius };
+    }
+
+    // Visits every cell of a that is not in b, walking only the rows and
+    // columns that differ instead of the whole rectangle.
+    template <typename Fn>
+    void forEachCellInDifference(const ChunkRect& a, const ChunkRect& b, Fn fn) {
+        for (int x = a.minX; x <= a.maxX; x++) {
+            if (x < b.minX || x > b.maxX) {
+                for (int z = a.minZ; z <= a.maxZ; z++) {
+                    fn(x, z);
+                }
+                continue;
+            }
+            for (int z = a.minZ; z <= std::min(a.maxZ, b.minZ - 1); z++) {
+                fn(x, z);
+            }
+            for (int z = std::max(a.minZ, b.maxZ + 1); z <= a.maxZ; z++) {
+                fn(x, z);
+            }
+        }
+    }
+}
 
 WorldManager::WorldManager()
-    : centerChunkX(0), centerChunkZ(0), initialized(false)
+    : centerChunkX(0), centerChunkZ(0), initialized(false),
+      lastCameraPos(0.0f), cameraVelocity(0.0f)
 {
     std::cout << "WorldManager constructor" << std::endl;
+    ground.initialize(HEIGHT_TILE_CAPACITY);
+    treeModel.loadModel(TREE_MODEL_PATH);
+    caneModel.loadModel(CANE_MODEL_PATH);
+    snowmanModel.loadModel(SNOWMAN_MODEL_PATH);
+    impostorRenderer.initialize();
+    setFieldOfView(glm::radians(60.0f));
 }
 
 WorldManager::~WorldManager() {
+    workerPool.shutdown();
+    uploadQueue.clear();
+    prefetchedChunks.clear();
     chunkMap.clear();
+    chunkPool.clear();
+    spatialIndex.clear();
+    impostorRenderer.cleanup();
+    impostorSources.clear();
+    gpuCuller.cleanup();
+    treeModel.cleanup();
+    caneModel.cleanup();
+    snowmanModel.cleanup();
+}
+
+bool WorldManager::initializeGpuCulling(GLADloadfunc load) {
+    if (!renderQueue.usesIndirectDraws()) {
+        return false;
+    }
+    return gpuCuller.initialize(load);
+}
+
+void WorldManager::setFieldOfView(float fovYRadians) {
+    projectionScale = 1.0f / std::tan(fovYRadians * 0.5f);
+}
+
+// Takes effect on the next update, which diffs the old ring against the new one.
+void WorldManager::setChunkRadius(int radius) {
+    chunkRadius = glm::clamp(radius, MIN_CHUNK_RADIUS, MAX_CHUNK_RADIUS);
+}
+
+void WorldManager::setImpostorDistance(float switchDistance, float fadeBand) {
+    impostorSwitchDistance = switchDistance;
+    impostorFadeBand = fadeBand;
+    impostorRenderer.setSwitchDistance(impostorSwitchDistance * propDetailScale, impostorFadeBand * propDetailScale);
+}
+
+void WorldManager::setPropDetailScale(float scale) {
+    propDetailScale = scale;
+    impostorRenderer.setSwitchDistance(impostorSwitchDistance * propDetailScale, impostorFadeBand * propDetailScale);
+}
+
+// Loads the baked atlas of each impostor source, baking (and saving) any that
+// are missing or when a rebake is requested.
+void WorldManager::initializeImpostors(const glm::vec3& lightPosition, const glm::vec3& lightIntensity, bool rebake) {
+    impostorSources.clear();
+
+    for (const ImpostorSource& source : IMPOSTOR_SOURCES) {
+        StaticModel model;
+        if (!model.loadModel(source.modelPath)) {
+            std::cerr << "Failed to load impostor source " << source.modelPath << std::endl;
+            continue;
+        }
+
+        ImpostorAtlas atlas;
+        bool loaded = !rebake && loadImpostorAtlas(source.atlasPath, model.getBounds(), IMPOSTOR_FRAMES_PER_SIDE, atlas);
+        if (!loaded) {
+            if (!bakeImpostorAtlas(model, IMPOSTOR_FRAMES_PER_SIDE, IMPOSTOR_FRAME_SIZE, lightPosition, lightIntensity, atlas)) {
+                std::cerr << "Failed to bake impostor for " << source.modelPath << std::endl;
+                continue;
+            }
+            saveImpostorAtlas(atlas, source.atlasPath);
+        }
+
+        model.setImpostorId(impostorRenderer.addAtlas(atlas));
+        impostorSources.push_back(std::move(model));
+    }
 }
 
 int WorldManager::getChunkCoord(float worldCoord) {
@@ -23,41 +181,355 @@ void WorldManager::update(const glm::vec3& cameraPos, const float& deltaTime, fl
     int newCenterChunkX = getChunkCoord(cameraPos.x);
     int newCenterChunkZ = getChunkCoord(cameraPos.z);
 
-    for (auto& pair : chunkMap) {
-        pair.second->update(deltaTime, globalTime);
+    for (auto& entry : chunkMap) {
+        if (entry.value) {
+            entry.value->update(deltaTime, globalTime);
+        }
     }
 
-    if (!initialized || newCenterChunkX != centerChunkX || newCenterChunkZ != centerChunkZ) {
-        centerChunkX = newCenterChunkX;
-        centerChunkZ = newCenterChunkZ;
+    // Everything from here on is streaming work.
+    uint64_t heapAllocationsBefore = getThreadHeapAllocations();
+    GLStateCache::Stats glStatsBefore = GLStateCache::getInstance().getStats();
 
-        std::unordered_map<std::pair<int, int>, std::unique_ptr<Chunk>, PairHash> newChunkMap;
+    updateCameraVelocity(cameraPos, deltaTime);
 
-        for (int dx = -CHUNK_RADIUS; dx <= CHUNK_RADIUS; dx++) {
-            for (int dz = -CHUNK_RADIUS; dz <= CHUNK_RADIUS; dz++) {
-                int chunkX = centerChunkX + dx;
-                int chunkZ = centerChunkZ + dz;
-                auto key = std::make_pair(chunkX, chunkZ);
-                auto it = chunkMap.find(key);
-                if (it != chunkMap.end()) {
-                    newChunkMap[key] = std::move(it->second);
-                }
-                else {
-                    auto chunk = std::make_unique<Chunk>(chunkX, chunkZ);
-                    chunk->initialize();
-                    newChunkMap[key] = std::move(chunk);
-                }
+    if (!initialized || newCenterChunkX != centerChunkX || newCenterChunkZ != centerChunkZ ||
+        chunkRadius != activeRadius) {
+        updateChunkGrid(newCenterChunkX, newCenterChunkZ);
+    }
+
+    prefetchAlongPath(cameraPos, globalTime);
+    expirePrefetchedChunks(globalTime);
+
+    updateChurnStats(deltaTime);
+    uploadCompletedChunks();
+    assignFlatChunkTiles();
+
+    const GLStateCache::Stats& glStats = GLStateCache::getInstance().getStats();
+    updateHeapAllocations += getThreadHeapAllocations() - heapAllocationsBefore;
+    streamingStats.heapAllocations = updateHeapAllocations + workerPool.getHeapAllocations();
+    streamingStats.glObjectsCreated += glStats.objectsCreated - glStatsBefore.objectsCreated;
+    streamingStats.glObjectsDeleted += glStats.objectsDeleted - glStatsBefore.objectsDeleted;
+}
+
+void WorldManager::updateChunkGrid(int newCenterChunkX, int newCenterChunkZ) {
+    ChunkRect newLoadRect = rectAround(newCenterChunkX, newCenterChunkZ, chunkRadius);
+    ChunkRect newUnloadRect = rectAround(newCenterChunkX, newCenterChunkZ, chunkRadius + UNLOAD_HYSTERESIS);
+
+    // Every loaded chunk lies inside the previous unload rectangle, so only the
+    // strips that fall out of it can leave, and only the strips that are new to
+    // the load rectangle can enter. The same holds when the radius changes.
+    if (initialized) {
+        ChunkRect oldLoadRect = rectAround(centerChunkX, centerChunkZ, activeRadius);
+        ChunkRect oldUnloadRect = rectAround(centerChunkX, centerChunkZ, activeRadius + UNLOAD_HYSTERESIS);
+
+        // Prefetched chunks are left to expirePrefetchedChunks.
+        forEachCellInDifference(oldUnloadRect, newUnloadRect, [this](int chunkX, int chunkZ) {
+            if (!prefetchedChunks.contains(chunkX, chunkZ)) {
+                unloadChunk(chunkX, chunkZ);
+            }
+        });
+
+        forEachCellInDifference(newLoadRect, oldLoadRect, [&](int chunkX, int chunkZ) {
+            if (prefetchedChunks.erase(chunkX, chunkZ)) {
+                prefetchStats.hits++;
+                return;
+            }
+            requestChunk(chunkX, chunkZ, std::hypot(float(chunkX - newCenterChunkX), float(chunkZ - newCenterChunkZ)));
+        });
+    }
+    else {
+        int side = 2 * (chunkRadius + UNLOAD_HYSTERESIS) + 1;
+        chunkPool.reserve(side * side);
+        chunkMap.reserve(side * side);
+
+        for (int chunkX = newLoadRect.minX; chunkX <= newLoadRect.maxX; chunkX++) {
+            for (int chunkZ = newLoadRect.minZ; chunkZ <= newLoadRect.maxZ; chunkZ++) {
+                requestChunk(chunkX, chunkZ, std::hypot(float(chunkX - newCenterChunkX), float(chunkZ - newCenterChunkZ)));
+            }
+        }
+    }
+
+    centerChunkX = newCenterChunkX;
+    centerChunkZ = newCenterChunkZ;
+    activeRadius = chunkRadius;
+    initialized = true;
+}
+
+void WorldManager::updateCameraVelocity(const glm::vec3& cameraPos, float deltaTime) {
+    if (!initialized || deltaTime <= 0.0f) {
+        lastCameraPos = cameraPos;
+        return;
+    }
+
+    // Key repeats move the camera in steps, so smooth them into a velocity.
+    glm::vec3 instantaneous = (cameraPos - lastCameraPos) / deltaTime;
+    float alpha = 1.0f - std::exp(-deltaTime / VELOCITY_SMOOTHING_SECONDS);
+    cameraVelocity += (instantaneous - cameraVelocity) * alpha;
+    lastCameraPos = cameraPos;
+}
+
+// Walks the predicted path prefetchSeconds ahead and requests the cells that
+// the ring would gain at each step, nearest along the path first.
+void WorldManager::prefetchAlongPath(const glm::vec3& cameraPos, float globalTime) {
+    glm::vec2 velocity(cameraVelocity.x, cameraVelocity.z);
+    float speed = glm::length(velocity);
+    if (prefetchSeconds <= 0.0f || speed < PREFETCH_MIN_SPEED) {
+        return;
+    }
+
+    glm::vec2 heading = velocity / speed;
+    float pathLength = std::min(speed * prefetchSeconds, static_cast<float>(chunkRadius * Chunk::SIZE));
+    float step = Chunk::SIZE * 0.5f;
+    float expiry = globalTime + prefetchSeconds + PREFETCH_GRACE_SECONDS;
+
+    ChunkRect loadRect = rectAround(centerChunkX, centerChunkZ, chunkRadius);
+    int lastX = centerChunkX;
+    int lastZ = centerChunkZ;
+
+    for (float distance = step; distance <= pathLength; distance += step) {
+        int futureX = getChunkCoord(cameraPos.x + heading.x * distance);
+        int futureZ = getChunkCoord(cameraPos.z + heading.y * distance);
+        if (futureX == lastX && futureZ == lastZ) {
+            continue;
+        }
+
+        float priority = chunkRadius + distance / Chunk::SIZE;
+        ChunkRect futureRect = rectAround(futureX, futureZ, chunkRadius);
+        ChunkRect previousRect = rectAround(lastX, lastZ, chunkRadius);
+
+        forEachCellInDifference(futureRect, previousRect, [&](int chunkX, int chunkZ) {
+            if (loadRect.contains(chunkX, chunkZ)) {
+                return;
+            }
+
+            float* prefetchedExpiry = prefetchedChunks.find(chunkX, chunkZ);
+            if (prefetchedExpiry) {
+                *prefetchedExpiry = expiry;
+                return;
             }
+            if (chunkMap.contains(chunkX, chunkZ)) {
+                return;
+            }
+
+            requestChunk(chunkX, chunkZ, priority);
+            prefetchedChunks.findOrInsert(chunkX, chunkZ) = expiry;
+            prefetchStats.issued++;
+        });
+
+        lastX = futureX;
+        lastZ = futureZ;
+    }
+}
+
+void WorldManager::expirePrefetchedChunks(float globalTime) {
+    ChunkRect unloadRect = rectAround(centerChunkX, centerChunkZ, chunkRadius + UNLOAD_HYSTERESIS);
+
+    // Walk backwards: erase moves the last entry into the erased one's place.
+    for (size_t i = prefetchedChunks.size(); i-- > 0;) {
+        const auto& entry = prefetchedChunks.at(i);
+        if (entry.value > globalTime) {
+            continue;
+        }
+
+        int chunkX = entry.getX();
+        int chunkZ = entry.getZ();
+        // Inside the hysteresis band the chunk is an ordinary ring chunk now.
+        if (!unloadRect.contains(chunkX, chunkZ)) {
+            unloadChunk(chunkX, chunkZ);
+            prefetchStats.wasted++;
+        }
+        prefetchedChunks.erase(chunkX, chunkZ);
+    }
+}
+
+void WorldManager::requestChunk(int chunkX, int chunkZ, float priority) {
+    bool inserted = false;
+    chunkMap.findOrInsert(chunkX, chunkZ, &inserted);
+    if (!inserted) {
+        return;
+    }
+
+    workerPool.submit(chunkPool.acquire(chunkX, chunkZ), priority);
+    chunkLoadsThisWindow++;
+}
+
+void WorldManager::unloadChunk(int chunkX, int chunkZ) {
+    std::unique_ptr<Chunk>* chunk = chunkMap.find(chunkX, chunkZ);
+    if (!chunk) {
+        return;
+    }
+
+    if (*chunk) {
+        (*chunk)->unregisterInstances(spatialIndex);
+        if ((*chunk)->getTerrainTile() == 0) {
+            flatChunkCount--;
+        }
+        ground.releaseHeightTile((*chunk)->getTerrainTile());
+        (*chunk)->setTerrainTile(0);
+        gpuCuller.releaseSlot((*chunk)->getCullSlot());
+        (*chunk)->setCullSlot(-1);
+    }
+    chunkPool.release(std::move(*chunk));
+    chunkMap.erase(chunkX, chunkZ);
+    chunkUnloadsThisWindow++;
+}
+
+void WorldManager::updateChurnStats(float deltaTime) {
+    churnWindowTime += deltaTime;
+    if (churnWindowTime >= 1.0f) {
+        chunkChurnPerSecond = (chunkLoadsThisWindow + chunkUnloadsThisWindow) / churnWindowTime;
+        uint64_t glObjectCalls = streamingStats.glObjectsCreated + streamingStats.glObjectsDeleted;
+        streamingStats.recentHeapAllocations = streamingStats.heapAllocations - windowStartHeapAllocations;
+        streamingStats.recentGlObjectCalls = glObjectCalls - windowStartGlObjectCalls;
+        windowStartHeapAllocations = streamingStats.heapAllocations;
+        windowStartGlObjectCalls = glObjectCalls;
+        chunkLoadsThisWindow = 0;
+        chunkUnloadsThisWindow = 0;
+        churnWindowTime = 0.0f;
+    }
+}
+
+void WorldManager::uploadCompletedChunks() {
+    workerPool.collectCompleted(uploadQueue);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t handled = 0;
+    while (handled < uploadQueue.size()) {
+        std::unique_ptr<Chunk> chunk = std::move(uploadQueue[handled++]);
+
+        // Drop results for chunks that left the ring while they were being generated.
+        std::unique_ptr<Chunk>* slot = chunkMap.find(chunk->getX(), chunk->getZ());
+        if (!slot || *slot) {
+            chunkPool.release(std::move(chunk));
+            continue;
+        }
+
+        chunk->initialize();
+        chunk->setTerrainTile(ground.allocateHeightTile(chunk->getDescriptor().heights.data()));
+        if (chunk->getTerrainTile() == 0) {
+            flatChunkCount++;
+        }
+        chunk->registerInstances(spatialIndex);
+        if (gpuCuller.isAvailable()) {
+            GpuCuller::CullInstance cullInstances[GpuCuller::INSTANCES_PER_SLOT];
+            int count = chunk->getCullInstances(cullInstances);
+            chunk->setCullSlot(count > 0 ? gpuCuller.allocateSlot(cullInstances, count) : -1);
+        }
+        *slot = std::move(chunk);
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() >= uploadBudgetMs) {
+            break;
+        }
+    }
+    uploadQueue.erase(uploadQueue.begin(), uploadQueue.begin() + handled);
+}
+
+// Chunks uploaded while the atlas could not grow are drawn flat while their
+// props stand on the real heights, so they take the first tiles freed up.
+void WorldManager::assignFlatChunkTiles() {
+    if (flatChunkCount == 0 || !ground.hasFreeHeightTile()) {
+        return;
+    }
+    for (auto& entry : chunkMap) {
+        if (!entry.value || entry.value->getTerrainTile() != 0) {
+            continue;
+        }
+        int tile = ground.allocateHeightTile(entry.value->getDescriptor().heights.data());
+        if (tile == 0) {
+            return;
+        }
+        entry.value->setTerrainTile(tile);
+        if (--flatChunkCount == 0) {
+            return;
         }
-        chunkMap = std::move(newChunkMap);
+    }
+}
 
-        initialized = true;
+void WorldManager::resolveQuery(std::vector<ChunkInstanceRef>& out) const {
+    for (SpatialIndex::Handle handle : queryHandles) {
+        out.push_back(ChunkInstanceRef::unpack(spatialIndex.getUserData(handle)));
     }
+    queryHandles.clear();
+}
+
+void WorldManager::queryInstancesInFrustum(const Frustum& queryFrustum, std::vector<ChunkInstanceRef>& out) const {
+    spatialIndex.queryFrustum(queryFrustum, queryHandles);
+    resolveQuery(out);
+}
+
+void WorldManager::queryInstancesInRadius(const glm::vec3& center, float radius,
+                                          std::vector<ChunkInstanceRef>& out) const {
+    spatialIndex.querySphere(center, radius, queryHandles);
+    resolveQuery(out);
+}
+
+void WorldManager::queryInstancesAlongRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                                          std::vector<ChunkInstanceRef>& out) const {
+    spatialIndex.queryRay(origin, direction, maxDistance, queryHandles);
+    resolveQuery(out);
 }
 
 void WorldManager::render(const glm::mat4& viewProjectionMatrix, const glm::vec3& lightPosition,
                                 const glm::vec3& lightIntensity, const glm::vec3& viewPosition) {
-    for (auto& pair : chunkMap) {
-        pair.second->render(viewProjectionMatrix, lightPosition, lightIntensity, viewPosition);
+    frustum.update(viewProjectionMatrix);
+    cullingStats = CullingStats();
+    impostorRenderer.beginFrame();
+    gpuCuller.beginFrame();
+
+    terrainInstances.clear();
+    staticBatches.clear();
+
+    FrameUniforms frameUniforms;
+    frameUniforms.viewProjectionMatrix = viewProjectionMatrix;
+    frameUniforms.lightPosition = lightPosition;
+    frameUniforms.lightIntensity = lightIntensity;
+    frameUniforms.viewPosition = viewPosition;
+    renderQueue.begin(frameUniforms);
+
+    for (auto& entry : chunkMap) {
+        const AABB& chunkBounds = entry.value ? entry.value->getBounds() : Chunk::groundBounds(entry.getX(), entry.getZ());
+        if (!frustum.intersects(chunkBounds)) {
+            cullingStats.chunksCulled++;
+            continue;
+        }
+        cullingStats.chunksVisible++;
+
+        int x = entry.getX();
+        int z = entry.getZ();
+        TerrainInstance instance;
+        instance.chunk = glm::vec4(x * Chunk::SIZE, z * Chunk::SIZE,
+                                   entry.value ? entry.value->getTerrainTile() : 0,
+                                   terrainLodFor(x, z, viewPosition));
+        instance.neighborLods = glm::vec4(terrainLodFor(x - 1, z, viewPosition), terrainLodFor(x + 1, z, viewPosition),
+                                          terrainLodFor(x, z - 1, viewPosition), terrainLodFor(x, z + 1, viewPosition));
+        terrainInstances.push_back(instance);
+
+        if (entry.value && entry.value->getCullSlot() >= 0 &&
+            farthestDistance(chunkBounds, viewPosition) < impostorRenderer.getFadeStartDistance()) {
+            gpuCuller.addVisibleSlot(entry.value->getCullSlot());
+        }
+        else if (entry.value) {
+            entry.value->render(frustum, viewPosition, projectionScale, renderQueue, impostorRenderer,
+                                staticBatches, cullingStats);
+        }
+    }
+    cullingStats.instancesGpuCulled = gpuCuller.getCandidateCount();
+
+    ground.submit(renderQueue, terrainInstances);
+    treeModel.submitInstanced(renderQueue, staticBatches.trees);
+    caneModel.submitInstanced(renderQueue, staticBatches.canes);
+    snowmanModel.submitInstanced(renderQueue, staticBatches.snowmen);
+    if (gpuCuller.isAvailable()) {
+        StaticModel* const models[GpuCuller::KIND_COUNT] = { &treeModel, &caneModel, &snowmanModel };
+        gpuCuller.buildFrame(frustum, viewPosition, projectionScale, models, gpuCullFrame);
+        gpuCuller.cullAndSubmit(gpuCullFrame, models, renderQueue);
+        if (verifyGpuCulling) {
+            gpuCuller.verify(gpuCullFrame);
+        }
     }
-}
\ No newline at end of file
+    renderQueue.flush();
+
+    impostorRenderer.render(viewProjectionMatrix, viewPosition);
+}
@@ -3,22 +3,51 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <memory>
-#include <unordered_map>
-#include <utility>
-
-class Chunk;
-
-struct PairHash {
-    template <class T1, class T2>
-    std::size_t operator()(const std::pair<T1, T2>& p) const {
-        auto hash1 = std::hash<T1>{}(p.first);
-        auto hash2 = std::hash<T2>{}(p.second);
-        return hash1 ^ (hash2 << 1);
-    }
+#include <cstdint>
+#include "chunk_worker_pool.h"
+#include "chunk_pool.h"
+#include "chunk_hash_map.h"
+#include "../entities/ground.h"
+#include "../entities/chunk.h"
+#include "../render/frustum.h"
+#include "../render/impostor.h"
+#include "../render/render_queue.h"
+#include "../render/gpu_culler.h"
+#include "../entities/static_model.h"
+#include "spatial_index.h"
+#include "heap_counter.h"
+
+struct PrefetchStats {
+    int issued = 0;
+    int hits = 0;
+    int wasted = 0;
+
+    float getHitRate() const { return hits + wasted > 0 ? static_cast<float>(hits) / (hits + wasted) : 0.0f; }
+};
+
+// What streaming chunks in and out costs: heap allocations in
+// WorldManager::update and in chunk generation on the workers, and GL objects
+// created or deleted through GLStateCache. Heap allocations are only counted
+// in builds with WONDERLAND_COUNT_HEAP_ALLOCATIONS; heapCounted says whether
+// they were. The chunk pool and the reused maps are meant to bring both to
+// zero in steady flight, but that has not been measured in flight yet, and a
+// pooled chunk still allocates the first time it shows a given model.
+struct StreamingStats {
+    bool heapCounted = HEAP_COUNTING_AVAILABLE;
+    uint64_t heapAllocations = 0;
+    uint64_t glObjectsCreated = 0;
+    uint64_t glObjectsDeleted = 0;
+    // Over the last churn window, about a second.
+    uint64_t recentHeapAllocations = 0;
+    uint64_t recentGlObjectCalls = 0;
 };
 
 class WorldManager {
 public:
+    static constexpr int DEFAULT_CHUNK_RADIUS = 7;
+    static constexpr int MIN_CHUNK_RADIUS = 2;
+    static constexpr int MAX_CHUNK_RADIUS = 12;
+
     WorldManager();
     ~WorldManager();
 
@@ -28,15 +57,123 @@ public:
     void setMarkedForRemoval(bool marked) { markedForRemoval = marked; }
     bool isMarkedForRemoval() const { return markedForRemoval; }
 
+    void setFieldOfView(float fovYRadians);
+    void initializeImpostors(const glm::vec3& lightPosition, const glm::vec3& lightIntensity, bool rebake = false);
+    void setImpostorDistance(float switchDistance, float fadeBand);
+    void setPropDetailScale(float scale);
+    float getPropDetailScale() const { return propDetailScale; }
+    void setChunkRadius(int radius);
+    int getChunkRadius() const { return chunkRadius; }
+    int getImpostorCount() const { return impostorRenderer.getSubmittedCount(); }
+    void setUploadBudgetMs(float budgetMs) { uploadBudgetMs = budgetMs; }
+    float getUploadBudgetMs() const { return uploadBudgetMs; }
+    size_t getPendingChunkCount() const { return workerPool.getPendingCount() + uploadQueue.size(); }
+    float getChunkChurnPerSecond() const { return chunkChurnPerSecond; }
+    const ChunkPool::Stats& getChunkPoolStats() const { return chunkPool.getStats(); }
+    const StreamingStats& getStreamingStats() const { return streamingStats; }
+    const CullingStats& getCullingStats() const { return cullingStats; }
+    const RenderQueueStats& getRenderStats() const { return renderQueue.getStats(); }
+    // Indirect draws need GL 4.3; without it the queue keeps the per-draw loop.
+    bool initializeIndirectDraws(GLADloadfunc load) { return renderQueue.initializeIndirectDraws(load); }
+    void setIndirectDraws(bool enabled) { renderQueue.setIndirectDraws(enabled); }
+    bool usesIndirectDraws() const { return renderQueue.usesIndirectDraws(); }
+    // Culls and picks LODs for nearby trees, canes and snowmen in a compute
+    // pass. Needs GL 4.3 and indirect draws; call before the first update.
+    bool initializeGpuCulling(GLADloadfunc load);
+    bool usesGpuCulling() const { return gpuCuller.isAvailable(); }
+    // Compares every GPU cull with the CPU reference; stalls each frame.
+    void setGpuCullingVerification(bool enabled) { verifyGpuCulling = enabled; }
+    const GpuCuller::VerifyStats& getGpuCullingVerifyStats() const { return gpuCuller.getVerifyStats(); }
+    void setPrefetchSeconds(float seconds) { prefetchSeconds = seconds; }
+    float getPrefetchSeconds() const { return prefetchSeconds; }
+    const PrefetchStats& getPrefetchStats() const { return prefetchStats; }
+    const glm::vec3& getCameraVelocity() const { return cameraVelocity; }
+
+    void queryInstancesInFrustum(const Frustum& queryFrustum, std::vector<ChunkInstanceRef>& out) const;
+    void queryInstancesInRadius(const glm::vec3& center, float radius, std::vector<ChunkInstanceRef>& out) const;
+    void queryInstancesAlongRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                                std::vector<ChunkInstanceRef>& out) const;
+    const SpatialIndex& getSpatialIndex() const { return spatialIndex; }
+
 private:
-    std::unordered_map<std::pair<int, int>, std::unique_ptr<Chunk>, PairHash> chunkMap;
+    // A null entry means the chunk has been requested but is still being
+    // generated or waiting for its GPU upload; only its ground is drawn.
+    ChunkHashMap<std::unique_ptr<Chunk>> chunkMap;
     int centerChunkX;
     int centerChunkZ;
     bool initialized;
     bool markedForRemoval = false;
+    int chunkRadius = DEFAULT_CHUNK_RADIUS;
+    int activeRadius = DEFAULT_CHUNK_RADIUS;
+
+    ChunkPool chunkPool;
+    ChunkWorkerPool workerPool;
+    // Not a deque: a deque frees and allocates a block every few dozen chunks
+    // as the queue moves; the vector keeps its capacity.
+    std::vector<std::unique_ptr<Chunk>> uploadQueue;
+    float uploadBudgetMs = 4.0f;
+    GroundPlane ground;
+    std::vector<TerrainInstance> terrainInstances;
+
+    // One model per instanced batch; they share the chunks' model caches.
+    StaticModel treeModel;
+    StaticModel caneModel;
+    StaticModel snowmanModel;
+    StaticInstanceBatches staticBatches;
+    RenderQueue renderQueue;
+
+    // Chunks with a slot whose props are all closer than the impostor fade
+    // start are culled here instead of in Chunk::render.
+    GpuCuller gpuCuller;
+    GpuCuller::Frame gpuCullFrame;
+    bool verifyGpuCulling = false;
+
+    Frustum frustum;
+    CullingStats cullingStats;
+    float projectionScale;
+
+    // The source models keep the shared model caches, and with them the
+    // impostor ids, alive for as long as the world exists.
+    ImpostorRenderer impostorRenderer;
+    float impostorSwitchDistance = 4000.0f;
+    float impostorFadeBand = 600.0f;
+    float propDetailScale = 1.0f;
+    std::vector<StaticModel> impostorSources;
+
+    SpatialIndex spatialIndex;
+    mutable std::vector<SpatialIndex::Handle> queryHandles;
+
+    // Chunks requested ahead of the camera that are outside the unload ring.
+    // They are kept until their expiry time (refreshed while they stay on the
+    // predicted path) and become ordinary ring chunks once the ring reaches them.
+    ChunkHashMap<float> prefetchedChunks;
+    glm::vec3 lastCameraPos;
+    glm::vec3 cameraVelocity;
+    float prefetchSeconds = 2.0f;
+    PrefetchStats prefetchStats;
+
+    int chunkLoadsThisWindow = 0;
+    int chunkUnloadsThisWindow = 0;
+    float churnWindowTime = 0.0f;
+    float chunkChurnPerSecond = 0.0f;
+    StreamingStats streamingStats;
+    uint64_t updateHeapAllocations = 0;
+    uint64_t windowStartHeapAllocations = 0;
+    uint64_t windowStartGlObjectCalls = 0;
+    // Uploaded chunks still drawn with the flat height tile.
+    int flatChunkCount = 0;
 
     int getChunkCoord(float worldCoord);
-    void updateChunkGrid();
+    void updateChunkGrid(int newCenterChunkX, int newCenterChunkZ);
+    void updateChurnStats(float deltaTime);
+    void updateCameraVelocity(const glm::vec3& cameraPos, float deltaTime);
+    void prefetchAlongPath(const glm::vec3& cameraPos, float globalTime);
+    void expirePrefetchedChunks(float globalTime);
+    void requestChunk(int chunkX, int chunkZ, float priority);
+    void unloadChunk(int chunkX, int chunkZ);
+    void uploadCompletedChunks();
+    void assignFlatChunkTiles();
+    void resolveQuery(std::vector<ChunkInstanceRef>& out) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,427 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include "render/gl_state_cache.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+// Drives GLStateCache with random binds, enables, viewport and clear color
+// changes and object deletes and recreates, reading the driver's state back
+// after each one: the driver must hold what was last requested, and issuing
+// the same state again must not reach the driver. Without a GL 3.3 context
+// the test is skipped, not failed.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    constexpr int OPERATIONS = 200000;
+    constexpr int OBJECTS = 3;
+    constexpr int UNITS = GLStateCache::MAX_TEXTURE_UNITS;
+    constexpr int BINDINGS = GLStateCache::MAX_UNIFORM_BINDINGS;
+    constexpr GLsizeiptr BUFFER_SIZE = 4096;
+    constexpr GLuint UNKNOWN = ~0u;
+    const GLenum CAPABILITIES[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND };
+
+    GLuint buildProgram(float red) {
+        const char* vertexCode = "#version 330 core\nvoid main() { gl_Position = vec4(0.0); }\n";
+        std::string fragment = "#version 330 core\nout vec4 color;\nvoid main() { color = vec4(" +
+                               std::to_string(red) + "); }\n";
+        const char* fragmentCode = fragment.c_str();
+        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexCode, NULL);
+        glCompileShader(vertexShader);
+        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentCode, NULL);
+        glCompileShader(fragmentShader);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return program;
+    }
+
+    GLint getInteger(GLenum name) {
+        GLint value = 0;
+        glGetIntegerv(name, &value);
+        return value;
+    }
+
+    GLint getInteger(GLenum name, GLuint index) {
+        GLint value = 0;
+        glGetIntegeri_v(name, index, &value);
+        return value;
+    }
+
+    // What the driver should hold, tracked the way GL defines it rather than
+    // the way the cache does. UNKNOWN marks a binding GL leaves unspecified.
+    struct Expected {
+        GLuint program = 0;
+        GLuint vertexArray = 0;
+        GLuint arrayBuffer = 0;
+        GLuint elementBuffer = 0;
+        GLuint uniformBuffer = 0;
+        GLuint uniformBindings[BINDINGS] = {};
+        GLintptr uniformOffsets[BINDINGS] = {};
+        // 0 for a glBindBufferBase binding.
+        GLsizeiptr uniformSizes[BINDINGS] = {};
+        GLuint unit = 0;
+        GLuint textures2D[UNITS] = {};
+        GLuint texturesCube[UNITS] = {};
+        GLuint framebuffer = 0;
+        bool enabled[3] = {};
+        GLint viewport[4] = {};
+        GLfloat clearColor[4] = {};
+    };
+
+    bool matchesDriver(const Expected& expected) {
+        bool same = getInteger(GL_CURRENT_PROGRAM) == GLint(expected.program) &&
+                    getInteger(GL_VERTEX_ARRAY_BINDING) == GLint(expected.vertexArray) &&
+                    getInteger(GL_ARRAY_BUFFER_BINDING) == GLint(expected.arrayBuffer) &&
+                    getInteger(GL_UNIFORM_BUFFER_BINDING) == GLint(expected.uniformBuffer) &&
+                    getInteger(GL_ACTIVE_TEXTURE) == GLint(GL_TEXTURE0 + expected.unit) &&
+                    getInteger(GL_DRAW_FRAMEBUFFER_BINDING) == GLint(expected.framebuffer);
+        if (expected.vertexArray != 0) {
+            same = same && getInteger(GL_ELEMENT_ARRAY_BUFFER_BINDING) == GLint(expected.elementBuffer);
+        }
+        for (GLuint index = 0; index < BINDINGS; index++) {
+            if (expected.uniformBindings[index] != UNKNOWN) {
+                same = same && getInteger(GL_UNIFORM_BUFFER_BINDING, index) == GLint(expected.uniformBindings[index]) &&
+                       getInteger(GL_UNIFORM_BUFFER_START, index) == GLint(expected.uniformOffsets[index]);
+            }
+        }
+        for (int unit = 0; unit < UNITS; unit++) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            same = same && getInteger(GL_TEXTURE_BINDING_2D) == GLint(expected.textures2D[unit]) &&
+                   getInteger(GL_TEXTURE_BINDING_CUBE_MAP) == GLint(expected.texturesCube[unit]);
+        }
+        glActiveTexture(GL_TEXTURE0 + expected.unit);
+        for (int i = 0; i < 3; i++) {
+            same = same && (glIsEnabled(CAPABILITIES[i]) == GL_TRUE) == expected.enabled[i];
+        }
+        GLint viewport[4];
+        GLfloat clearColor[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        for (int i = 0; i < 4; i++) {
+            same = same && viewport[i] == expected.viewport[i] && clearColor[i] == expected.clearColor[i];
+        }
+        return same;
+    }
+
+    struct Objects {
+        GLuint programs[OBJECTS];
+        GLuint vertexArrays[OBJECTS];
+        GLuint buffers[OBJECTS];
+        GLuint textures2D[OBJECTS];
+        GLuint texturesCube[OBJECTS];
+        GLuint framebuffers[OBJECTS];
+    };
+
+    GLuint makeBuffer(GLStateCache& cache) {
+        GLuint buffer = cache.genBuffer();
+        cache.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, BUFFER_SIZE, NULL, GL_STATIC_DRAW);
+        return buffer;
+    }
+
+    void testRandomOperations() {
+        GLStateCache& cache = GLStateCache::getInstance();
+        std::mt19937 random(16);
+        auto pick = [&](int count) { return std::uniform_int_distribution<int>(0, count - 1)(random); };
+        GLint alignment = std::max(1, getInteger(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT));
+
+        Objects objects;
+        for (int i = 0; i < OBJECTS; i++) {
+            objects.programs[i] = buildProgram(0.25f * i);
+            objects.vertexArrays[i] = cache.genVertexArray();
+            objects.buffers[i] = makeBuffer(cache);
+            objects.textures2D[i] = cache.genTexture();
+            objects.texturesCube[i] = cache.genTexture();
+            objects.framebuffers[i] = cache.genFramebuffer();
+            // A name becomes an object of its kind on first bind.
+            cache.bindTextureUnit(0, GL_TEXTURE_2D, objects.textures2D[i]);
+            cache.bindTextureUnit(0, GL_TEXTURE_CUBE_MAP, objects.texturesCube[i]);
+            cache.bindVertexArray(objects.vertexArrays[i]);
+            cache.bindFramebuffer(objects.framebuffers[i]);
+        }
+
+        // Start from a state both sides know.
+        Expected expected;
+        cache.useProgram(0);
+        cache.bindVertexArray(0);
+        cache.bindBuffer(GL_ARRAY_BUFFER, 0);
+        for (GLuint index = 0; index < BINDINGS; index++) {
+            cache.bindUniformBufferBase(index, 0);
+        }
+        for (int unit = UNITS - 1; unit >= 0; unit--) {
+            cache.bindTextureUnit(unit, GL_TEXTURE_2D, 0);
+            cache.bindTextureUnit(unit, GL_TEXTURE_CUBE_MAP, 0);
+        }
+        cache.bindFramebuffer(0);
+        for (GLenum capability : CAPABILITIES) {
+            cache.disable(capability);
+        }
+        cache.viewport(0, 0, 64, 64);
+        cache.clearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        expected.viewport[2] = expected.viewport[3] = 64;
+        check(matchesDriver(expected), "initial state");
+
+        int mismatches = 0;
+        int reissued = 0;
+        cache.resetStats();
+        for (int operation = 0; operation < OPERATIONS; operation++) {
+            // Everything random is drawn up front, so apply() repeats exactly.
+            int object = pick(OBJECTS + 1) - 1;
+            int kind = pick(10);
+            int choice = pick(UNITS);
+            bool cube = pick(2) == 1;
+            // Applies the operation; called twice, the second call must be free.
+            auto apply = [&]() {
+                switch (kind) {
+                    case 0: {
+                        GLuint program = object < 0 ? 0 : objects.programs[object];
+                        cache.useProgram(program);
+                        expected.program = program;
+                        break;
+                    }
+                    case 1: {
+                        GLuint vertexArray = object < 0 ? 0 : objects.vertexArrays[object];
+                        cache.bindVertexArray(vertexArray);
+                        expected.vertexArray = vertexArray;
+                        expected.elementBuffer = vertexArray == 0 ? 0 : UNKNOWN;
+                        break;
+                    }
+                    case 2: {
+                        GLuint buffer = object < 0 ? 0 : objects.buffers[object];
+                        GLenum targets[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER };
+                        GLenum target = targets[choice % 3];
+                        // The element binding needs a vertex array to live in.
+                        if (target == GL_ELEMENT_ARRAY_BUFFER && expected.vertexArray == 0) {
+                            target = GL_ARRAY_BUFFER;
+                        }
+                        cache.bindBuffer(target, buffer);
+                        if (target == GL_ARRAY_BUFFER) {
+                            expected.arrayBuffer = buffer;
+                        } else if (target == GL_ELEMENT_ARRAY_BUFFER) {
+                            expected.elementBuffer = buffer;
+                        } else {
+                            expected.uniformBuffer = buffer;
+                        }
+                        break;
+                    }
+                    case 3: {
+                        GLuint index = choice % BINDINGS;
+                        GLuint buffer = objects.buffers[object < 0 ? 0 : object];
+                        GLintptr offset = object < 0 ? 0 : alignment * object;
+                        GLsizeiptr size = object < 0 ? 0 : 256;
+                        if (object < 0) {
+                            cache.bindUniformBufferBase(index, buffer);
+                        } else {
+                            cache.bindUniformBufferRange(index, buffer, offset, size);
+                        }
+                        // The generic binding follows only a bind that changed something.
+                        if (expected.uniformBindings[index] != buffer || expected.uniformOffsets[index] != offset ||
+                            expected.uniformSizes[index] != size) {
+                            expected.uniformBuffer = buffer;
+                        }
+                        expected.uniformBindings[index] = buffer;
+                        expected.uniformOffsets[index] = offset;
+                        expected.uniformSizes[index] = size;
+                        break;
+                    }
+                    case 4: {
+                        GLuint unit = choice;
+                        GLuint texture = object < 0 ? 0 : (cube ? objects.texturesCube : objects.textures2D)[object];
+                        cache.bindTextureUnit(unit, cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D, texture);
+                        (cube ? expected.texturesCube : expected.textures2D)[unit] = texture;
+                        expected.unit = unit;
+                        break;
+                    }
+                    case 5: {
+                        GLuint framebuffer = object < 0 ? 0 : objects.framebuffers[object];
+                        cache.bindFramebuffer(framebuffer);
+                        expected.framebuffer = framebuffer;
+                        break;
+                    }
+                    case 6: {
+                        int capability = choice % 3;
+                        bool enabled = object >= 0;
+                        cache.setEnabled(CAPABILITIES[capability], enabled);
+                        expected.enabled[capability] = enabled;
+                        break;
+                    }
+                    case 7: {
+                        GLint size = 32 + 16 * (object + 1);
+                        cache.viewport(object + 1, 0, size, size / 2);
+                        GLint viewport[4] = { object + 1, 0, size, size / 2 };
+                        std::copy(viewport, viewport + 4, expected.viewport);
+                        break;
+                    }
+                    case 8: {
+                        GLfloat value = 0.25f * (object + 1);
+                        cache.clearColor(value, 0.5f, 1.0f - value, 1.0f);
+                        GLfloat color[4] = { value, 0.5f, 1.0f - value, 1.0f };
+                        std::copy(color, color + 4, expected.clearColor);
+                        break;
+                    }
+                }
+            };
+
+            if (kind == 9) {
+                // Delete and recreate one object; GL often hands the same name
+                // back, which must not be mistaken for the still-bound one.
+                int index = object < 0 ? 0 : object;
+                switch (choice % 4) {
+                    case 0: {
+                        GLuint old = objects.vertexArrays[index];
+                        cache.deleteVertexArray(old);
+                        if (expected.vertexArray == old) {
+                            expected.vertexArray = 0;
+                            expected.elementBuffer = 0;
+                        }
+                        objects.vertexArrays[index] = cache.genVertexArray();
+                        GLuint current = expected.vertexArray;
+                        cache.bindVertexArray(objects.vertexArrays[index]);
+                        cache.bindVertexArray(current);
+                        expected.elementBuffer = current == 0 ? 0 : UNKNOWN;
+                        break;
+                    }
+                    case 1: {
+                        GLuint old = objects.buffers[index];
+                        cache.deleteBuffer(old);
+                        for (GLuint* binding : { &expected.arrayBuffer, &expected.elementBuffer, &expected.uniformBuffer }) {
+                            if (*binding == old) {
+                                *binding = 0;
+                            }
+                        }
+                        for (GLuint& binding : expected.uniformBindings) {
+                            if (binding == old) {
+                                binding = UNKNOWN;
+                                expected.uniformBuffer = UNKNOWN;
+                            }
+                        }
+                        GLuint arrayBuffer = expected.arrayBuffer;
+                        objects.buffers[index] = makeBuffer(cache);
+                        cache.bindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+                        break;
+                    }
+                    case 2: {
+                        GLuint* textures = cube ? objects.texturesCube : objects.textures2D;
+                        GLuint old = textures[index];
+                        cache.deleteTexture(old);
+                        for (int unit = 0; unit < UNITS; unit++) {
+                            for (GLuint* binding : { &expected.textures2D[unit], &expected.texturesCube[unit] }) {
+                                if (*binding == old) {
+                                    *binding = 0;
+                                }
+                            }
+                        }
+                        textures[index] = cache.genTexture();
+                        GLuint unit = expected.unit;
+                        GLenum target = cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+                        GLuint previous = (cube ? expected.texturesCube : expected.textures2D)[unit];
+                        cache.bindTextureUnit(unit, target, textures[index]);
+                        cache.bindTextureUnit(unit, target, previous);
+                        break;
+                    }
+                    case 3: {
+                        GLuint old = objects.framebuffers[index];
+                        cache.deleteFramebuffer(old);
+                        if (expected.framebuffer == old) {
+                            expected.framebuffer = 0;
+                        }
+                        objects.framebuffers[index] = cache.genFramebuffer();
+                        GLuint current = expected.framebuffer;
+                        cache.bindFramebuffer(objects.framebuffers[index]);
+                        cache.bindFramebuffer(current);
+                        break;
+                    }
+                }
+            } else {
+                apply();
+                uint64_t issued = cache.getStats().issued;
+                apply();
+                if (cache.getStats().issued != issued) {
+                    reissued++;
+                }
+            }
+
+            // What the model does not track (a vertex array's element buffer,
+            // the generic uniform binding after a delete) is read back.
+            if (expected.elementBuffer == UNKNOWN) {
+                expected.elementBuffer = getInteger(GL_ELEMENT_ARRAY_BUFFER_BINDING);
+            }
+            if (expected.uniformBuffer == UNKNOWN) {
+                expected.uniformBuffer = getInteger(GL_UNIFORM_BUFFER_BINDING);
+            }
+            if (!matchesDriver(expected)) {
+                std::cerr << "operation " << operation << " (kind " << kind << ") left the driver out of step"
+                          << std::endl;
+                mismatches++;
+                break;
+            }
+        }
+        check(mismatches == 0, "driver state matches every requested state");
+        check(reissued == 0, "re-issuing the current state reaches the driver");
+        check(glGetError() == GL_NO_ERROR, "no GL errors");
+        const GLStateCache::Stats& stats = cache.getStats();
+        std::cout << "GL state cache: " << OPERATIONS << " operations, " << mismatches << " mismatches, "
+                  << stats.issued << " calls issued, " << stats.avoided << " avoided" << std::endl;
+
+        for (int i = 0; i < OBJECTS; i++) {
+            cache.deleteProgram(objects.programs[i]);
+            cache.deleteVertexArray(objects.vertexArrays[i]);
+            cache.deleteBuffer(objects.buffers[i]);
+            cache.deleteTexture(objects.textures2D[i]);
+            cache.deleteTexture(objects.texturesCube[i]);
+            cache.deleteFramebuffer(objects.framebuffers[i]);
+        }
+    }
+
+    void testGpu() {
+        if (!glfwInit()) {
+            std::cout << "GL state cache: skipped, GLFW could not initialize" << std::endl;
+            return;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        GLFWwindow* window = glfwCreateWindow(64, 64, "gl_state_cache_test", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "GL state cache: skipped, no GL 3.3 context" << std::endl;
+            glfwTerminate();
+            return;
+        }
+        glfwMakeContextCurrent(window);
+
+        if (gladLoadGL(glfwGetProcAddress) == 0) {
+            std::cout << "GL state cache: skipped, GL entry points unavailable" << std::endl;
+        } else {
+            testRandomOperations();
+        }
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+}
+
+int main() {
+    testGpu();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "gl_state_cache_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "render/gpu_culler.h"
+#include "render/frustum.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks GpuCuller::cullReference against hand-computed visible sets, then,
+// where a GL 4.3 context can be created, the compute pass against the
+// reference on fixed and generated instances. Without one the GPU half is
+// skipped, not failed.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    constexpr int TREE = static_cast<int>(CullKind::Tree);
+    constexpr int CANE = static_cast<int>(CullKind::Cane);
+    constexpr int SNOWMAN = static_cast<int>(CullKind::Snowman);
+
+    GpuCuller::CullInstance makeBox(CullKind kind, const glm::vec3& center) {
+        AABB bounds(center - glm::vec3(1.0f), center + glm::vec3(1.0f));
+        return GpuCuller::makeInstance(kind, glm::translate(glm::mat4(1.0f), center), bounds);
+    }
+
+    // Looking down -z from the origin into the box |x|, |y| <= 100,
+    // -1000 <= z <= 0. Coverage thresholds 0.5, 0.2 and 0.05.
+    GpuCuller::Frame makeBoxFrame() {
+        GpuCuller::Frame frame;
+        frame.planes[0] = glm::vec4(1.0f, 0.0f, 0.0f, 100.0f);
+        frame.planes[1] = glm::vec4(-1.0f, 0.0f, 0.0f, 100.0f);
+        frame.planes[2] = glm::vec4(0.0f, 1.0f, 0.0f, 100.0f);
+        frame.planes[3] = glm::vec4(0.0f, -1.0f, 0.0f, 100.0f);
+        frame.planes[4] = glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+        frame.planes[5] = glm::vec4(0.0f, 0.0f, 1.0f, 1000.0f);
+        frame.viewPosition = glm::vec3(0.0f);
+        frame.lodThresholdsSq[0] = 0.25f;
+        frame.lodThresholdsSq[1] = 0.04f;
+        frame.lodThresholdsSq[2] = 0.0025f;
+        frame.lodCounts[TREE] = 4;
+        frame.lodCounts[CANE] = 1;
+        frame.lodCounts[SNOWMAN] = 2;
+        for (GLuint& count : frame.primitiveCounts) {
+            count = 1;
+        }
+        return frame;
+    }
+
+    // Three slots; slot 1 is never listed visible.
+    std::vector<GpuCuller::CullInstance> makeBoxInstances() {
+        const GpuCuller::CullInstance unused = { glm::mat4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+        std::vector<GpuCuller::CullInstance> instances(3 * GpuCuller::INSTANCES_PER_SLOT, unused);
+        GpuCuller::CullInstance* slot0 = &instances[0];
+        slot0[0] = makeBox(CullKind::Tree, glm::vec3(0.0f, 0.0f, -2.0f));       // LOD 0
+        slot0[1] = makeBox(CullKind::Tree, glm::vec3(0.0f, 0.0f, -5.0f));       // LOD 1
+        slot0[2] = makeBox(CullKind::Tree, glm::vec3(0.0f, 0.0f, -20.0f));      // LOD 2
+        slot0[3] = makeBox(CullKind::Tree, glm::vec3(0.0f, 0.0f, -100.0f));     // LOD 3
+        slot0[4] = makeBox(CullKind::Tree, glm::vec3(150.0f, 0.0f, -10.0f));    // outside +x
+        slot0[5] = makeBox(CullKind::Tree, glm::vec3(100.5f, 0.0f, -10.0f));    // straddles +x, LOD 3
+        slot0[6] = makeBox(CullKind::Cane, glm::vec3(0.0f, 0.0f, -100.0f));     // single LOD
+        slot0[7] = makeBox(CullKind::Snowman, glm::vec3(0.0f, 0.0f, -20.0f));   // clamped to LOD 1
+        GpuCuller::CullInstance* slot1 = &instances[GpuCuller::INSTANCES_PER_SLOT];
+        slot1[0] = makeBox(CullKind::Tree, glm::vec3(0.0f, 0.0f, -2.0f));
+        GpuCuller::CullInstance* slot2 = &instances[2 * GpuCuller::INSTANCES_PER_SLOT];
+        slot2[0] = makeBox(CullKind::Tree, glm::vec3(0.0f, 0.0f, 5.0f));        // behind the camera
+        slot2[1] = makeBox(CullKind::Tree, glm::vec3(-101.0f, 0.0f, -10.0f));   // touches -x, LOD 3
+        return instances;
+    }
+
+    void testReference() {
+        GpuCuller::Frame frame = makeBoxFrame();
+        std::vector<GpuCuller::CullInstance> instances = makeBoxInstances();
+        std::vector<GLuint> visibleSlots = { 0, 2 };
+
+        GpuCuller::Result expected;
+        expected.ids[TREE][0] = { 0 };
+        expected.ids[TREE][1] = { 1 };
+        expected.ids[TREE][2] = { 2 };
+        expected.ids[TREE][3] = { 3, 5, 19 };
+        expected.ids[CANE][0] = { 6 };
+        expected.ids[SNOWMAN][1] = { 7 };
+
+        GpuCuller::Result result;
+        GpuCuller::cullReference(frame, instances.data(), visibleSlots, result);
+        result.sort();
+        check(result == expected, "reference cull of the fixed instances");
+
+        // A kind without primitives is not drawn at all.
+        frame.primitiveCounts[SNOWMAN] = 0;
+        expected.ids[SNOWMAN][1].clear();
+        GpuCuller::cullReference(frame, instances.data(), visibleSlots, result);
+        result.sort();
+        check(result == expected, "reference cull skips kinds without primitives");
+
+        GpuCuller::cullReference(frame, instances.data(), {}, result);
+        check(result.size() == 0, "reference cull without visible slots");
+    }
+
+    // One command per LOD and a single primitive for every kind.
+    void setPlaceholderCommands(GpuCuller& culler) {
+        std::vector<DrawElementsIndirectCommand> commands;
+        GLuint base[GpuCuller::KIND_COUNT];
+        for (int kind = 0; kind < GpuCuller::KIND_COUNT; kind++) {
+            base[kind] = static_cast<GLuint>(commands.size());
+            for (int lod = 0; lod < GpuCuller::MAX_LODS; lod++) {
+                DrawElementsIndirectCommand command = {};
+                command.baseInstance = GpuCuller::getRegionBaseInstance(kind, lod);
+                commands.push_back(command);
+            }
+        }
+        culler.setCommands(commands, base);
+    }
+
+    void testGpuFixed(GpuCuller& culler) {
+        GpuCuller::Frame frame = makeBoxFrame();
+        std::vector<GpuCuller::CullInstance> instances = makeBoxInstances();
+        int slots[3];
+        for (int slot = 0; slot < 3; slot++) {
+            slots[slot] = culler.allocateSlot(&instances[slot * GpuCuller::INSTANCES_PER_SLOT],
+                                              GpuCuller::INSTANCES_PER_SLOT);
+        }
+        culler.beginFrame();
+        culler.addVisibleSlot(slots[0]);
+        culler.addVisibleSlot(slots[2]);
+        setPlaceholderCommands(culler);
+        check(culler.dispatch(frame), "GPU cull of the fixed instances dispatched");
+        check(culler.verify(frame), "GPU cull of the fixed instances matches the reference");
+        for (int slot : slots) {
+            culler.releaseSlot(slot);
+        }
+    }
+
+    // Boxes of every size scattered around a perspective frustum, so many
+    // sit on a plane or a LOD boundary within rounding.
+    void testGpuGenerated(GpuCuller& culler) {
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(-600.0f, 600.0f);
+        std::uniform_real_distribution<float> halfSize(0.1f, 30.0f);
+        std::uniform_int_distribution<int> kind(0, GpuCuller::KIND_COUNT - 1);
+
+        glm::vec3 eye(0.0f, 50.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(eye, glm::vec3(100.0f, 0.0f, -300.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 1.0f, 800.0f);
+        Frustum frustum(projection * view);
+
+        GpuCuller::Frame frame;
+        for (int i = 0; i < 6; i++) {
+            frame.planes[i] = frustum.getPlane(i);
+        }
+        frame.viewPosition = eye;
+        const float coverage[GpuCuller::MAX_LODS - 1] = { 0.25f, 0.1f, 0.04f };
+        for (int lod = 0; lod < GpuCuller::MAX_LODS - 1; lod++) {
+            float threshold = coverage[lod] / projection[1][1];
+            frame.lodThresholdsSq[lod] = threshold * threshold;
+        }
+        for (int k = 0; k < GpuCuller::KIND_COUNT; k++) {
+            frame.lodCounts[k] = GpuCuller::MAX_LODS - k;
+            frame.primitiveCounts[k] = 1;
+        }
+
+        std::vector<int> slots;
+        culler.beginFrame();
+        for (int slot = 0; slot < GpuCuller::SLOT_COUNT; slot++) {
+            GpuCuller::CullInstance slotInstances[GpuCuller::INSTANCES_PER_SLOT];
+            int count = 1 + slot % GpuCuller::INSTANCES_PER_SLOT;
+            for (int i = 0; i < count; i++) {
+                glm::vec3 center, extents;
+                center.x = position(random);
+                center.y = position(random) * 0.1f;
+                center.z = position(random);
+                extents.x = halfSize(random);
+                extents.y = halfSize(random);
+                extents.z = halfSize(random);
+                slotInstances[i] = GpuCuller::makeInstance(static_cast<CullKind>(kind(random)),
+                                                           glm::translate(glm::mat4(1.0f), center),
+                                                           AABB(center - extents, center + extents));
+            }
+            int allocated = culler.allocateSlot(slotInstances, count);
+            check(allocated >= 0, "slot allocated for generated instances");
+            if (allocated < 0) {
+                break;
+            }
+            slots.push_back(allocated);
+            if (slot % 4 != 3) {
+                culler.addVisibleSlot(allocated);
+            }
+        }
+        setPlaceholderCommands(culler);
+        check(culler.dispatch(frame), "GPU cull of generated instances dispatched");
+        check(culler.verify(frame), "GPU cull of generated instances matches the reference");
+        for (int slot : slots) {
+            culler.releaseSlot(slot);
+        }
+    }
+
+    void testGpu() {
+        if (!glfwInit()) {
+            std::cout << "GPU cull: skipped, GLFW could not initialize" << std::endl;
+            return;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        GLFWwindow* window = glfwCreateWindow(64, 64, "gpu_culler_test", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "GPU cull: skipped, no GL 4.3 context" << std::endl;
+            glfwTerminate();
+            return;
+        }
+        glfwMakeContextCurrent(window);
+
+        {
+            GpuCuller culler;
+            if (gladLoadGL(glfwGetProcAddress) == 0 || !culler.initialize(glfwGetProcAddress)) {
+                std::cout << "GPU cull: skipped, compute pass unavailable" << std::endl;
+            } else {
+                testGpuFixed(culler);
+                testGpuGenerated(culler);
+                const GpuCuller::VerifyStats& stats = culler.getVerifyStats();
+                std::cout << "GPU cull: " << stats.frames << " frames compared, " << stats.mismatches
+                          << " mismatches" << std::endl;
+            }
+        }
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+}
+
+int main() {
+    testReference();
+    testGpu();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "gpu_culler_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include "render/program_binary_cache.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Builds a program cold, stores it in a ProgramBinaryCache and loads it back,
+// then checks that a cache file the driver no longer accepts (a corrupted or
+// truncated binary) is rejected and removed. Needs a GL context whose driver
+// offers a program binary format; without one the test is skipped, not failed.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    constexpr uint64_t SOURCE_HASH = 0x0123456789abcdefull;
+    constexpr uint64_t MISSING_HASH = 0xfedcba9876543210ull;
+    // Size of the header ProgramBinaryCache writes before the binary.
+    constexpr size_t HEADER_SIZE = 32;
+
+    const char* VERTEX_SHADER = R"(#version 330 core
+layout(location = 0) in vec3 position;
+uniform mat4 transform;
+void main() {
+    gl_Position = transform * vec4(position, 1.0);
+}
+)";
+
+    const char* FRAGMENT_SHADER = R"(#version 330 core
+uniform vec4 color;
+out vec4 fragColor;
+void main() {
+    fragColor = color;
+}
+)";
+
+    GLuint compileShader(GLenum type, const char* code) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    GLuint buildProgram() {
+        GLuint vertex = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+        GLuint fragment = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+        glDetachShader(program, vertex);
+        glDetachShader(program, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return program;
+    }
+
+    bool isLinked(GLuint program) {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // The cache writes one file per program; the name is its own business.
+    std::vector<std::filesystem::path> cacheFiles(const std::filesystem::path& directory) {
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            files.push_back(entry.path());
+        }
+        return files;
+    }
+
+    std::vector<char> readFile(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void writeFile(const std::filesystem::path& path, const std::vector<char>& bytes) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), bytes.size());
+    }
+
+    void testCache(const std::filesystem::path& directory) {
+        ProgramBinaryCache cache;
+        if (!cache.initialize(directory.string(), glfwGetProcAddress)) {
+            std::cout << "Program binary cache: skipped, driver has no program binary formats" << std::endl;
+            return;
+        }
+
+        GLuint cold = buildProgram();
+        check(isLinked(cold), "cold program links");
+        GLint coldTransform = glGetUniformLocation(cold, "transform");
+        GLint coldColor = glGetUniformLocation(cold, "color");
+
+        check(cache.load(SOURCE_HASH) == 0, "empty cache misses");
+        cache.store(SOURCE_HASH, cold);
+        glDeleteProgram(cold);
+        std::vector<std::filesystem::path> files = cacheFiles(directory);
+        check(files.size() == 1, "store writes one file and no temporary");
+        if (files.size() != 1) {
+            return;
+        }
+        const std::filesystem::path file = files[0];
+        const std::vector<char> stored = readFile(file);
+        check(stored.size() > HEADER_SIZE, "stored file holds a binary after the header");
+
+        GLuint warm = cache.load(SOURCE_HASH);
+        check(warm != 0, "stored program loads");
+        check(warm != 0 && isLinked(warm), "loaded program is linked");
+        check(glGetUniformLocation(warm, "transform") == coldTransform &&
+              glGetUniformLocation(warm, "color") == coldColor, "loaded program keeps its uniforms");
+        glDeleteProgram(warm);
+        check(cache.load(MISSING_HASH) == 0, "other source misses");
+        check(std::filesystem::exists(file), "a miss leaves other files alone");
+
+        // Every byte of the binary flipped: the header still matches, so the
+        // driver is asked and has to refuse it.
+        std::vector<char> corrupted = stored;
+        for (size_t i = HEADER_SIZE; i < corrupted.size(); i++) {
+            corrupted[i] = static_cast<char>(~corrupted[i]);
+        }
+        writeFile(file, corrupted);
+        check(cache.load(SOURCE_HASH) == 0, "corrupted binary is rejected");
+        check(!std::filesystem::exists(file), "corrupted binary is removed");
+
+        // Cut short, as by a full disk.
+        writeFile(file, std::vector<char>(stored.begin(), stored.begin() + stored.size() / 2));
+        check(cache.load(SOURCE_HASH) == 0, "truncated binary is rejected");
+        check(!std::filesystem::exists(file), "truncated binary is removed");
+
+        // A rebuilt program replaces the removed file and loads again.
+        GLuint rebuilt = buildProgram();
+        cache.store(SOURCE_HASH, rebuilt);
+        glDeleteProgram(rebuilt);
+        GLuint reloaded = cache.load(SOURCE_HASH);
+        check(reloaded != 0 && isLinked(reloaded), "rebuilt program loads after a discard");
+        glDeleteProgram(reloaded);
+        check(glGetError() == GL_NO_ERROR, "no GL errors");
+
+        std::cout << "Program binary cache: " << stored.size() - HEADER_SIZE << " byte binary from "
+                  << glGetString(GL_RENDERER) << std::endl;
+    }
+
+    void testGpu() {
+        if (!glfwInit()) {
+            std::cout << "Program binary cache: skipped, GLFW could not initialize" << std::endl;
+            return;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        GLFWwindow* window = glfwCreateWindow(64, 64, "program_binary_cache_test", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Program binary cache: skipped, no GL 3.3 context" << std::endl;
+            glfwTerminate();
+            return;
+        }
+        glfwMakeContextCurrent(window);
+
+        if (gladLoadGL(glfwGetProcAddress) == 0) {
+            std::cout << "Program binary cache: skipped, GL entry points unavailable" << std::endl;
+        } else {
+            std::filesystem::path directory =
+                std::filesystem::temp_directory_path() / "wonderland_program_binary_cache_test";
+            std::filesystem::remove_all(directory);
+            testCache(directory);
+            std::filesystem::remove_all(directory);
+        }
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+}
+
+int main() {
+    testGpu();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "program_binary_cache_test passed" << std::endl;
+    return 0;
+}
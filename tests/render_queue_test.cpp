@@ -0,0 +1,506 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "render/render_queue.h"
+#include "render/gl_state_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Checks the RenderQueue sort key order, then, where a GL 4.3 context can be
+// created, flushes the same packets once drawn one by one and once through
+// glMultiDrawElementsIndirect. The draw entry points are wrapped to record
+// what each draw asked for (index count and first index, base vertex,
+// instance range, ObjectBlock slot, program, VAO and texture), and both
+// paths must match what the packets describe and render the same image.
+// Without a GL 4.3 context the GL half is skipped, not failed.
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    void testSortKeys() {
+        const GLuint program = 3;
+        const GLuint texture = 5;
+        const GLuint vertexArray = 7;
+        uint64_t base = RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray, 10.0f);
+        check(base < RenderQueue::makeSortKey(RenderLayer::Ground, 0, 0, 0, 0.0f), "layer sorts first");
+        check(base < RenderQueue::makeSortKey(RenderLayer::Opaque, program + 1, 0, 0, 0.0f), "program sorts before texture");
+        check(base < RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture + 1, 0, 0.0f), "texture sorts before VAO");
+        check(base < RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray + 1, 0.0f), "VAO sorts before depth");
+        check(base < RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray, 11.0f), "near sorts before far");
+        check(RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray, -5.0f) ==
+              RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray, 0.0f), "negative depth clamps");
+        check(RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray, 1e9f) ==
+              RenderQueue::makeSortKey(RenderLayer::Opaque, program, texture, vertexArray, RenderQueue::MAX_SORT_DEPTH),
+              "far depth clamps");
+    }
+
+    // What one draw asked the driver for, with the instance range resolved
+    // from whichever of attribute offset and base instance carried it.
+    struct Draw {
+        GLenum mode;
+        GLenum indexType;
+        GLuint count;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint instanceCount;
+        GLuint firstInstance;
+        GLint objectOffset;
+        GLuint program;
+        GLuint vertexArray;
+        GLuint texture;
+
+        bool operator==(const Draw& other) const { return std::memcmp(this, &other, sizeof(Draw)) == 0; }
+    };
+
+    constexpr GLenum DRAW_INDIRECT_BUFFER_BINDING = 0x8F43;
+    constexpr int SIZE = 64;
+    // A 4x4 grid of quads in the top half of the target, 4 vertices each.
+    constexpr int QUADS = 16;
+    constexpr int INSTANCES = 12;
+    constexpr size_t INSTANCE_STRIDE = sizeof(glm::vec2);
+
+    typedef void (GLAD_API_PTR *MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect,
+                                                               GLsizei drawCount, GLsizei stride);
+
+    PFNGLDRAWELEMENTSBASEVERTEXPROC realDrawElementsBaseVertex = nullptr;
+    PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC realDrawElementsInstancedBaseVertex = nullptr;
+    MultiDrawElementsIndirectProc realMultiDrawElementsIndirect = nullptr;
+    std::vector<Draw> recorded;
+    // Where prepare last pointed the instance attribute.
+    size_t instanceByteOffset = 0;
+
+    GLuint indexSize(GLenum indexType) {
+        return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    }
+
+    GLint getInteger(GLenum name) {
+        GLint value = 0;
+        glGetIntegerv(name, &value);
+        return value;
+    }
+
+    Draw currentDraw(GLenum mode, GLenum indexType) {
+        Draw draw = {};
+        draw.mode = mode;
+        draw.indexType = indexType;
+        draw.program = getInteger(GL_CURRENT_PROGRAM);
+        draw.vertexArray = getInteger(GL_VERTEX_ARRAY_BINDING);
+        draw.texture = getInteger(GL_TEXTURE_BINDING_2D);
+        glGetIntegeri_v(GL_UNIFORM_BUFFER_START, OBJECT_BLOCK_BINDING, &draw.objectOffset);
+        draw.firstInstance = static_cast<GLuint>(instanceByteOffset / INSTANCE_STRIDE);
+        return draw;
+    }
+
+    void GLAD_API_PTR recordDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                                   GLint baseVertex) {
+        Draw draw = currentDraw(mode, type);
+        draw.count = count;
+        draw.firstIndex = static_cast<GLuint>(reinterpret_cast<size_t>(indices) / indexSize(type));
+        draw.baseVertex = baseVertex;
+        draw.instanceCount = 1;
+        recorded.push_back(draw);
+        realDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+    }
+
+    void GLAD_API_PTR recordDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type,
+                                                            const void* indices, GLsizei instanceCount,
+                                                            GLint baseVertex) {
+        Draw draw = currentDraw(mode, type);
+        draw.count = count;
+        draw.firstIndex = static_cast<GLuint>(reinterpret_cast<size_t>(indices) / indexSize(type));
+        draw.baseVertex = baseVertex;
+        draw.instanceCount = instanceCount;
+        recorded.push_back(draw);
+        realDrawElementsInstancedBaseVertex(mode, count, type, indices, instanceCount, baseVertex);
+    }
+
+    // Reads the commands back from the bound indirect buffer.
+    void GLAD_API_PTR recordMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect,
+                                                      GLsizei drawCount, GLsizei stride) {
+        GLint buffer = getInteger(DRAW_INDIRECT_BUFFER_BINDING);
+        std::vector<DrawElementsIndirectCommand> commands(drawCount);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, reinterpret_cast<GLintptr>(indirect),
+                           drawCount * sizeof(DrawElementsIndirectCommand), commands.data());
+        for (const DrawElementsIndirectCommand& command : commands) {
+            Draw draw = currentDraw(mode, type);
+            draw.count = command.count;
+            draw.firstIndex = command.firstIndex;
+            draw.baseVertex = command.baseVertex;
+            draw.instanceCount = command.instanceCount;
+            draw.firstInstance += command.baseInstance;
+            recorded.push_back(draw);
+        }
+        realMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+    }
+
+    GLADapiproc recordingLoad(const char* name) {
+        GLADapiproc proc = reinterpret_cast<GLADapiproc>(glfwGetProcAddress(name));
+        if (proc && std::strcmp(name, "glMultiDrawElementsIndirect") == 0) {
+            realMultiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirectProc>(proc);
+            return reinterpret_cast<GLADapiproc>(&recordMultiDrawElementsIndirect);
+        }
+        return proc;
+    }
+
+    const char* VERTEX_SHADER = R"(#version 330 core
+layout(std140) uniform FrameBlock {
+    mat4 viewProjectionMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec3 viewPosition;
+};
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+};
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 instanceOffset;
+void main() {
+    gl_Position = viewProjectionMatrix * modelMatrix * vec4(position + instanceOffset, 0.0, 1.0);
+}
+)";
+
+    const char* FRAGMENT_SHADER = R"(#version 330 core
+uniform sampler2D textureSampler;
+out vec4 color;
+void main() {
+    color = texture(textureSampler, vec2(0.5)) * TINT;
+}
+)";
+
+    GLuint buildProgram(const char* tint) {
+        std::string fragmentCode = std::string(FRAGMENT_SHADER);
+        fragmentCode.replace(fragmentCode.find("TINT"), 4, tint);
+        const char* fragmentSource = fragmentCode.c_str();
+        GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &VERTEX_SHADER, NULL);
+        glCompileShader(vertex);
+        GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fragmentSource, NULL);
+        glCompileShader(fragment);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameBlock"), FRAME_BLOCK_BINDING);
+        glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ObjectBlock"), OBJECT_BLOCK_BINDING);
+        return program;
+    }
+
+    // Two VAOs over the same vertices and instances, one with 32-bit and one
+    // with 16-bit indices. Each index buffer holds every quad's indices in
+    // place (quad k at index 6k) followed by one quad relative to vertex 0,
+    // so a packet picks its quad by index offset or by base vertex.
+    struct Scene {
+        GLuint programs[2];
+        GLuint textures[2];
+        GLuint vertexArrays[2];
+        GLenum indexTypes[2] = { GL_UNSIGNED_INT, GL_UNSIGNED_SHORT };
+        GLuint vertexBuffer;
+        GLuint instanceBuffer;
+        GLuint indexBuffers[2];
+        GLuint framebuffer;
+        GLuint colorTexture;
+        std::vector<DrawPacket> packets;
+        std::vector<glm::mat4> objects;
+    };
+
+    constexpr size_t RELATIVE_QUAD = 6 * QUADS;
+
+    void prepareDraw(const RenderQueue& queue, const DrawPacket& packet, bool programChanged) {
+        const Scene* scene = static_cast<const Scene*>(packet.owner);
+        (void)programChanged;
+        instanceByteOffset = queue.getInstanceByteOffset(packet, INSTANCE_STRIDE);
+        GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, scene->instanceBuffer);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, INSTANCE_STRIDE, BUFFER_OFFSET(instanceByteOffset));
+    }
+
+    void createScene(Scene& scene) {
+        GLStateCache& glState = GLStateCache::getInstance();
+        scene.programs[0] = buildProgram("vec4(1.0, 0.5, 0.25, 1.0)");
+        scene.programs[1] = buildProgram("vec4(0.25, 1.0, 0.5, 1.0)");
+
+        const unsigned char texels[2][4] = { { 255, 128, 64, 255 }, { 64, 255, 255, 255 } };
+        for (int i = 0; i < 2; i++) {
+            scene.textures[i] = glState.genTexture();
+            glState.bindTextureUnit(0, GL_TEXTURE_2D, scene.textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        std::vector<glm::vec2> vertices;
+        for (int quad = 0; quad < QUADS; quad++) {
+            glm::vec2 corner(-1.0f + 0.5f * (quad % 4), 1.0f - 0.25f * (quad / 4 + 1));
+            for (int v = 0; v < 4; v++) {
+                vertices.push_back(corner + glm::vec2(0.375f * (v % 2), 0.1875f * (v / 2)));
+            }
+        }
+        std::vector<glm::vec2> instances;
+        for (int i = 0; i < INSTANCES; i++) {
+            instances.push_back(glm::vec2(0.125f * (i % 3), -1.0f - 0.0625f * i));
+        }
+        const GLuint quadIndices[6] = { 0, 1, 2, 2, 1, 3 };
+        std::vector<GLuint> indices32;
+        for (int quad = 0; quad < QUADS; quad++) {
+            for (GLuint index : quadIndices) {
+                indices32.push_back(4 * quad + index);
+            }
+        }
+        indices32.insert(indices32.end(), quadIndices, quadIndices + 6);
+        std::vector<GLushort> indices16(indices32.begin(), indices32.end());
+
+        scene.vertexBuffer = glState.genBuffer();
+        glState.bindBuffer(GL_ARRAY_BUFFER, scene.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), vertices.data(), GL_STATIC_DRAW);
+        scene.instanceBuffer = glState.genBuffer();
+        glState.bindBuffer(GL_ARRAY_BUFFER, scene.instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * INSTANCE_STRIDE, instances.data(), GL_STATIC_DRAW);
+
+        for (int i = 0; i < 2; i++) {
+            scene.vertexArrays[i] = glState.genVertexArray();
+            glState.bindVertexArray(scene.vertexArrays[i]);
+            glState.bindBuffer(GL_ARRAY_BUFFER, scene.vertexBuffer);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), BUFFER_OFFSET(0));
+            glState.bindBuffer(GL_ARRAY_BUFFER, scene.instanceBuffer);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, INSTANCE_STRIDE, BUFFER_OFFSET(0));
+            glVertexAttribDivisor(1, 1);
+            scene.indexBuffers[i] = glState.genBuffer();
+            glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.indexBuffers[i]);
+            if (scene.indexTypes[i] == GL_UNSIGNED_INT) {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices32.size() * 4, indices32.data(), GL_STATIC_DRAW);
+            } else {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices16.size() * 2, indices16.data(), GL_STATIC_DRAW);
+            }
+        }
+        glState.bindVertexArray(0);
+
+        scene.colorTexture = glState.genTexture();
+        glState.bindTextureUnit(0, GL_TEXTURE_2D, scene.colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SIZE, SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        scene.framebuffer = glState.genFramebuffer();
+        glState.bindFramebuffer(scene.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene.colorTexture, 0);
+        glState.bindTextureUnit(0, GL_TEXTURE_2D, 0);
+
+        // Four batches: two runs of non-instanced quads, picked by index
+        // offset or by base vertex, and two of instanced ones; the second
+        // pair uses 16-bit indices and one non-instanced draw reads its
+        // instance attribute from a base instance.
+        struct Spec {
+            int program, texture, vertexArray, object;
+            int quad;
+            bool relative;
+            GLsizei instanceCount;
+            GLuint baseInstance;
+            float depth;
+        };
+        const Spec specs[] = {
+            { 0, 0, 0, 0, 0, false, 0, 0, 1.0f },
+            { 0, 0, 0, 0, 1, false, 0, 0, 2.0f },
+            { 0, 0, 0, 0, 2, true, 0, 0, 3.0f },
+            { 0, 0, 0, 1, 3, false, 4, 2, 10.0f },
+            { 0, 0, 0, 1, 4, true, 3, 7, 11.0f },
+            { 1, 1, 1, 2, 5, false, 0, 0, 1.0f },
+            { 1, 1, 1, 2, 6, false, 0, 0, 2.0f },
+            { 1, 1, 1, 2, 7, true, 0, 5, 3.0f },
+            { 1, 0, 1, 3, 8, false, 2, 1, 1.0f },
+        };
+        for (int object = 0; object < 4; object++) {
+            scene.objects.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(0.0625f * object, 0.0f, 0.0f)));
+        }
+        // Submitted out of order so the sort has something to do.
+        for (int i : { 4, 8, 0, 6, 2, 3, 7, 1, 5 }) {
+            const Spec& spec = specs[i];
+            DrawPacket packet;
+            packet.program = scene.programs[spec.program];
+            packet.texture = scene.textures[spec.texture];
+            packet.vertexArray = scene.vertexArrays[spec.vertexArray];
+            packet.indexType = scene.indexTypes[spec.vertexArray];
+            packet.indexCount = 6;
+            size_t firstIndex = spec.relative ? RELATIVE_QUAD : 6 * spec.quad;
+            packet.indexOffset = firstIndex * indexSize(packet.indexType);
+            packet.baseVertex = spec.relative ? 4 * spec.quad : 0;
+            packet.instanceCount = spec.instanceCount;
+            packet.baseInstance = spec.baseInstance;
+            packet.objectIndex = spec.object;
+            packet.sortKey = RenderQueue::makeSortKey(RenderLayer::Opaque, packet.program, packet.texture,
+                                                      packet.vertexArray, spec.depth);
+            packet.prepare = &prepareDraw;
+            packet.owner = &scene;
+            scene.packets.push_back(packet);
+        }
+    }
+
+    void destroyScene(Scene& scene) {
+        GLStateCache& glState = GLStateCache::getInstance();
+        glState.bindFramebuffer(0);
+        glState.deleteFramebuffer(scene.framebuffer);
+        for (int i = 0; i < 2; i++) {
+            glState.deleteProgram(scene.programs[i]);
+            glState.deleteTexture(scene.textures[i]);
+            glState.deleteVertexArray(scene.vertexArrays[i]);
+            glState.deleteBuffer(scene.indexBuffers[i]);
+        }
+        glState.deleteTexture(scene.colorTexture);
+        glState.deleteBuffer(scene.vertexBuffer);
+        glState.deleteBuffer(scene.instanceBuffer);
+    }
+
+    // The draws the packets describe, in sort order.
+    std::vector<Draw> expectedDraws(const Scene& scene, size_t objectStride) {
+        std::vector<DrawPacket> sorted = scene.packets;
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const DrawPacket& a, const DrawPacket& b) { return a.sortKey < b.sortKey; });
+        std::vector<Draw> draws;
+        for (const DrawPacket& packet : sorted) {
+            Draw draw = {};
+            draw.mode = packet.mode;
+            draw.indexType = packet.indexType;
+            draw.count = packet.indexCount;
+            draw.firstIndex = static_cast<GLuint>(packet.indexOffset / indexSize(packet.indexType));
+            draw.baseVertex = packet.baseVertex;
+            draw.instanceCount = std::max<GLsizei>(packet.instanceCount, 1);
+            draw.firstInstance = packet.baseInstance;
+            draw.objectOffset = static_cast<GLint>(packet.objectIndex * objectStride);
+            draw.program = packet.program;
+            draw.vertexArray = packet.vertexArray;
+            draw.texture = packet.texture;
+            draws.push_back(draw);
+        }
+        return draws;
+    }
+
+    std::vector<unsigned char> drawScene(RenderQueue& queue, const Scene& scene) {
+        GLStateCache& glState = GLStateCache::getInstance();
+        glState.bindFramebuffer(scene.framebuffer);
+        glState.viewport(0, 0, SIZE, SIZE);
+        glState.clearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        recorded.clear();
+        queue.begin(FrameUniforms());
+        for (const glm::mat4& object : scene.objects) {
+            queue.pushObject(object);
+        }
+        for (const DrawPacket& packet : scene.packets) {
+            queue.submit(packet);
+        }
+        queue.flush();
+
+        std::vector<unsigned char> pixels(SIZE * SIZE * 4);
+        glReadPixels(0, 0, SIZE, SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+
+    void testFlush() {
+        Scene scene;
+        createScene(scene);
+        RenderQueue queue;
+        if (!queue.initializeIndirectDraws(recordingLoad)) {
+            std::cout << "Render queue: skipped, no glMultiDrawElementsIndirect" << std::endl;
+            queue.cleanup();
+            destroyScene(scene);
+            return;
+        }
+        realDrawElementsBaseVertex = glad_glDrawElementsBaseVertex;
+        realDrawElementsInstancedBaseVertex = glad_glDrawElementsInstancedBaseVertex;
+        glad_glDrawElementsBaseVertex = &recordDrawElementsBaseVertex;
+        glad_glDrawElementsInstancedBaseVertex = &recordDrawElementsInstancedBaseVertex;
+
+        GLint alignment = std::max(1, getInteger(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT));
+        size_t objectStride = (sizeof(ObjectBlock) + alignment - 1) / alignment * alignment;
+        std::vector<Draw> expected = expectedDraws(scene, objectStride);
+
+        queue.setIndirectDraws(false);
+        std::vector<unsigned char> loopImage = drawScene(queue, scene);
+        std::vector<Draw> loopDraws = recorded;
+        RenderQueueStats loopStats = queue.getStats();
+
+        queue.setIndirectDraws(true);
+        std::vector<unsigned char> indirectImage = drawScene(queue, scene);
+        std::vector<Draw> indirectDraws = recorded;
+        RenderQueueStats indirectStats = queue.getStats();
+
+        glad_glDrawElementsBaseVertex = realDrawElementsBaseVertex;
+        glad_glDrawElementsInstancedBaseVertex = realDrawElementsInstancedBaseVertex;
+
+        check(loopDraws == expected, "draws one by one match the packets");
+        check(indirectDraws == expected, "indirect commands match the packets");
+        check(loopStats.batches == 4 && indirectStats.batches == 4, "packets form four batches");
+        check(loopStats.draws == static_cast<int>(scene.packets.size()), "one draw per packet without indirect draws");
+        check(indirectStats.draws == indirectStats.batches, "one draw per batch with indirect draws");
+        check(indirectStats.objectBinds == 4 && loopStats.objectBinds == 4, "one ObjectBlock bind per object");
+        for (const Draw& draw : indirectDraws) {
+            check(draw.objectOffset % alignment == 0, "ObjectBlock slots are aligned");
+        }
+
+        size_t covered = 0;
+        for (size_t i = 3; i < loopImage.size(); i += 4) {
+            covered += loopImage[i] != 0 ? 1 : 0;
+        }
+        check(covered > 0, "the scene draws something");
+        check(loopImage == indirectImage, "both paths render the same image");
+        check(glGetError() == GL_NO_ERROR, "no GL errors");
+        std::cout << "Render queue: " << expected.size() << " packets, " << indirectStats.batches << " batches, "
+                  << covered << " pixels covered, ObjectBlock stride " << objectStride << std::endl;
+
+        queue.cleanup();
+        destroyScene(scene);
+    }
+
+    void testGpu() {
+        if (!glfwInit()) {
+            std::cout << "Render queue: skipped, GLFW could not initialize" << std::endl;
+            return;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        GLFWwindow* window = glfwCreateWindow(64, 64, "render_queue_test", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Render queue: skipped, no GL 4.3 context" << std::endl;
+            glfwTerminate();
+            return;
+        }
+        glfwMakeContextCurrent(window);
+
+        if (gladLoadGL(glfwGetProcAddress) == 0) {
+            std::cout << "Render queue: skipped, GL entry points unavailable" << std::endl;
+        } else {
+            testFlush();
+        }
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+}
+
+int main() {
+    testSortKeys();
+    testGpu();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "render_queue_test passed" << std::endl;
+    return 0;
+}